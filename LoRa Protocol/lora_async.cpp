@@ -28,14 +28,11 @@ void onLoRaReceive(int packetSize)
     byte incomingMsgId = lora->read();  // incoming msg ID
     byte incomingLength = lora->read(); // incoming msg length
 
-    String incoming = ""; // payload of packet
+    // payload of packet: read at once in a static buffer, nothing is allocated in the callback
+    static uint8_t incoming[256];
+    int payloadLength = lora->readBytes(incoming, lora->available());
 
-    while (lora->available())
-    {                                  // can't use readString() in callback, so
-        incoming += (char)lora->read(); // add bytes one by one
-    }
-
-    if (incomingLength != incoming.length())
+    if (incomingLength != payloadLength)
     { // check length for error
         Serial.println("error: message length does not match length");
         return; // skip rest of function
@@ -49,7 +46,7 @@ void onLoRaReceive(int packetSize)
     display->printf("Message ID: %d\n", incomingMsgId);
     display->printf("Count: %d\n", count);
     display->printf("Message length: %d\n", incomingLength);
-    display->printf("Message: %s\n", incoming);
+    display->printf("Message: %.*s\n", payloadLength, (const char *)incoming);
     display->printf("RSSI: %d\n", lora->packetRssi());
     display->printf("Snr: %02f\n", lora->packetSnr());
     displayNeedUpdate = true;
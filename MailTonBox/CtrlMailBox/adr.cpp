@@ -0,0 +1,55 @@
+/**
+ * @file adr.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Adaptive data rate of the CtrlMailBox links, computed by MailTon (see adr.h).
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <math.h>
+#include "adr.h"
+
+void adrReset(AdrLinkStats &stats) {
+    stats = {};
+    stats.reportedTxPower = ADR_MAX_TX_POWER;
+}
+
+void adrRecordUplink(AdrLinkStats &stats, int rssi, float snr, int8_t txPower) {
+    // the history is normalized to the maximum power, so it stays valid when the power changes
+    stats.snr[stats.next] = snr + (ADR_MAX_TX_POWER - txPower);
+    stats.next = (stats.next + 1) % ADR_HISTORY;
+    if (stats.count < ADR_HISTORY) stats.count++;
+
+    stats.lastRssi = rssi;
+    stats.lastSnr = snr;
+    stats.reportedTxPower = txPower;
+    stats.packets++;
+}
+
+float adrRequiredSnr(uint8_t spreadingFactor) {
+    // -7.5 dB at SF7, 2.5 dB less for every step of SF
+    return -7.5f - 2.5f * (spreadingFactor - 7);
+}
+
+int8_t adrRecommendTxPower(const AdrLinkStats &stats, uint8_t spreadingFactor) {
+    if (stats.count == 0) return stats.reportedTxPower;
+
+    float maxSnr = stats.snr[0];
+    for (uint8_t i = 1; i < stats.count; i++) {
+        if (stats.snr[i] > maxSnr) maxSnr = stats.snr[i];
+    }
+
+    // every 3 dB of margin at full power is a step of power that can be saved
+    float margin = maxSnr - adrRequiredSnr(spreadingFactor) - ADR_MARGIN_DB;
+    int steps = (int)floorf(margin / ADR_STEP_DB);
+    int power = ADR_MAX_TX_POWER - steps * ADR_STEP_DB;
+
+    if (power < ADR_MIN_TX_POWER) power = ADR_MIN_TX_POWER;
+    if (power > ADR_MAX_TX_POWER) power = ADR_MAX_TX_POWER;
+    // lower the power only with enough history, raise it as soon as the margin is missing
+    if (stats.count < ADR_MIN_SAMPLES && power < stats.reportedTxPower) power = stats.reportedTxPower;
+    return (int8_t)power;
+}
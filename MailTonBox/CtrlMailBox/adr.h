@@ -0,0 +1,49 @@
+/**
+ * @file adr.h
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Adaptive data rate of the CtrlMailBox links, computed by MailTon.
+ *
+ * MailTon keeps the link margin of every CtrlMailBox from the SNR of its
+ * uplinks and piggybacks a TX power recommendation in the ACK (ADR_PW=dBm).
+ * The algorithm is the LoRaWAN one: the margin above the SNR required by the
+ * spreading factor, minus an installation margin, is converted in 3 dB steps.
+ * The spreading factor is not changed, because the SX127x of MailTon listens
+ * on a single SF: the steps are used to lower the TX power of close mailboxes
+ * and to raise it for the far ones.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef ADR_H
+#define ADR_H
+
+#include <stdint.h>
+
+#define ADR_HISTORY 8           // uplinks kept for the margin
+#define ADR_MIN_SAMPLES 4       // uplinks needed before lowering the power
+#define ADR_MARGIN_DB 10        // installation margin
+#define ADR_STEP_DB 3
+#define ADR_MIN_TX_POWER 2      // dBm
+#define ADR_MAX_TX_POWER 14     // dBm, EU868 limit
+
+struct AdrLinkStats {
+    float snr[ADR_HISTORY];     // SNR of the last uplinks normalized to ADR_MAX_TX_POWER (circular)
+    uint8_t count;
+    uint8_t next;
+    int16_t lastRssi;
+    float lastSnr;
+    uint32_t packets;
+    int8_t reportedTxPower;     // TX power declared by the CtrlMailBox in the last uplink
+};
+
+void adrReset(AdrLinkStats &stats);
+void adrRecordUplink(AdrLinkStats &stats, int rssi, float snr, int8_t txPower);
+// SNR needed to demodulate at the given spreading factor
+float adrRequiredSnr(uint8_t spreadingFactor);
+// TX power the CtrlMailBox should use, based on the best SNR of the last uplinks
+int8_t adrRecommendTxPower(const AdrLinkStats &stats, uint8_t spreadingFactor);
+
+#endif
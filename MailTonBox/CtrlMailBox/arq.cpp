@@ -0,0 +1,234 @@
+/**
+ * @file arq.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Selective-repeat ARQ used by CtrlMailBox (see arq.h).
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <string.h>
+#include "arq.h"
+
+static ArqMessage queue[ARQ_QUEUE_SIZE];
+static ArqStats stats = {};
+static uint8_t nextSeq = 0;
+static uint32_t nextOrder = 0;
+static uint32_t randomState = 1;
+static uint32_t lastSentAt = 0;
+static bool sentOnce = false;
+static uint32_t reportedRttSamples = 0;
+
+// xorshift32, only used for the jitter of the retransmissions
+static uint32_t nextRandom() {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+static bool expired(uint32_t nowMs, uint32_t deadline) {
+    return (int32_t)(nowMs - deadline) >= 0;
+}
+
+// timeout doubled at every transmission, plus up to 50% of random jitter
+static uint32_t backoff(uint8_t transmissions) {
+    uint32_t timeout = ARQ_BASE_TIMEOUT_MS;
+    for (uint8_t i = 1; i < transmissions && timeout < ARQ_MAX_TIMEOUT_MS; i++) timeout *= 2;
+    if (timeout > ARQ_MAX_TIMEOUT_MS) timeout = ARQ_MAX_TIMEOUT_MS;
+    return timeout + nextRandom() % (timeout / 2 + 1);
+}
+
+static void release(ArqMessage &message) {
+    message.used = false;
+    message.inFlight = false;
+}
+
+void arqInit(uint32_t seed) {
+    memset(queue, 0, sizeof(queue));
+    stats = {};
+    nextOrder = 0;
+    sentOnce = false;
+    reportedRttSamples = 0;
+    randomState = seed ? seed : 1;
+    nextSeq = (uint8_t)nextRandom(); // a fresh start does not reuse the sequences of the last boot
+}
+
+bool arqEnqueue(const char *data, uint32_t nowMs, bool urgent, uint32_t *order) {
+    for (ArqMessage &message : queue) {
+        if (message.used) continue;
+        strncpy(message.data, data, ARQ_DATA_LENGTH - 1);
+        message.data[ARQ_DATA_LENGTH - 1] = '\0';
+        message.used = true;
+        message.inFlight = false;
+        message.urgent = urgent;
+        message.transmissions = 0;
+        message.order = nextOrder++;
+        if (order != nullptr) *order = message.order;
+        message.queuedAt = nowMs;
+        stats.enqueued++;
+        return true;
+    }
+    stats.overflows++;
+    return false;
+}
+
+ArqStatus arqStatus(uint32_t order) {
+    for (const ArqMessage &message : queue) {
+        if (message.used && message.order == order) return message.inFlight ? ARQ_IN_FLIGHT : ARQ_QUEUED;
+    }
+    return ARQ_DONE;
+}
+
+uint8_t arqNextSeq() {
+    return nextSeq;
+}
+
+uint8_t arqBase() {
+    const ArqMessage *oldest = nullptr;
+    for (const ArqMessage &message : queue) {
+        if (message.used && message.inFlight && (oldest == nullptr || message.order < oldest->order)) {
+            oldest = &message;
+        }
+    }
+    return oldest ? oldest->seq : nextSeq;
+}
+
+ArqMessage *arqNextToSend(uint32_t nowMs, bool urgentOnly) {
+    if (sentOnce && nowMs - lastSentAt < ARQ_TX_GAP_MS) return nullptr;
+
+    ArqMessage *retransmission = nullptr;
+    ArqMessage *fresh = nullptr;
+
+    for (ArqMessage &message : queue) {
+        if (!message.used) continue;
+        if (message.inFlight) {
+            if (urgentOnly && !message.urgent) continue;
+            if (!expired(nowMs, message.nextRetryAt)) continue;
+            if (message.transmissions >= ARQ_MAX_RETRIES) {
+                stats.failures++;
+                release(message);
+                continue;
+            }
+            if (retransmission == nullptr || message.order < retransmission->order) retransmission = &message;
+        } else if ((!urgentOnly || message.urgent) && (fresh == nullptr || message.order < fresh->order)) {
+            fresh = &message;
+        }
+    }
+
+    if (retransmission) return retransmission;
+    // a new sequence must stay within ARQ_WINDOW of the oldest one not acknowledged
+    if (fresh && arqInFlight() < ARQ_WINDOW && (uint8_t)(nextSeq - arqBase()) < ARQ_WINDOW) return fresh;
+    return nullptr;
+}
+
+void arqOnSent(ArqMessage *message, uint32_t nowMs) {
+    if (!message->inFlight) {
+        message->seq = nextSeq++;
+        message->inFlight = true;
+    } else {
+        stats.retransmissions++;
+    }
+    message->transmissions++;
+    message->sentAt = nowMs;
+    lastSentAt = nowMs;
+    sentOnce = true;
+    message->nextRetryAt = nowMs + backoff(message->transmissions);
+}
+
+void arqOnAck(uint8_t seq, int cumulative, uint32_t nowMs) {
+    for (ArqMessage &message : queue) {
+        if (!message.used || !message.inFlight) continue;
+        bool acked = message.seq == seq ||
+                     (cumulative >= 0 && (int8_t)((uint8_t)cumulative - message.seq) >= 0);
+        if (!acked) continue;
+
+        uint32_t latency = nowMs - message.queuedAt;
+        stats.delivered++;
+        stats.lastLatencyMs = latency;
+        stats.avgLatencyMs = stats.delivered == 1 ? latency : (stats.avgLatencyMs * 7 + latency) / 8;
+        if (latency > stats.maxLatencyMs) stats.maxLatencyMs = latency;
+        // a retransmitted message does not tell which transmission was acknowledged
+        if (message.seq == seq && message.transmissions == 1) {
+            stats.lastRttMs = nowMs - message.sentAt;
+            stats.rttSamples++;
+        }
+        release(message);
+    }
+}
+
+void arqOnNack(uint8_t seq, uint32_t nowMs) {
+    for (ArqMessage &message : queue) {
+        if (message.used && message.inFlight && message.seq == seq) {
+            message.nextRetryAt = nowMs + backoff(message.transmissions);
+        }
+    }
+}
+
+bool arqNextDeadline(uint32_t nowMs, uint32_t *deadlineMs) {
+    bool windowOpen = arqInFlight() < ARQ_WINDOW && (uint8_t)(nextSeq - arqBase()) < ARQ_WINDOW;
+    bool found = false;
+    for (const ArqMessage &message : queue) {
+        if (!message.used || (!message.inFlight && !windowOpen)) continue;
+        uint32_t due = message.inFlight ? message.nextRetryAt : nowMs;
+        if (sentOnce && !expired(due, lastSentAt + ARQ_TX_GAP_MS)) due = lastSentAt + ARQ_TX_GAP_MS;
+        if (!found || !expired(due, *deadlineMs)) *deadlineMs = due;
+        found = true;
+    }
+    return found;
+}
+
+int arqPending() {
+    int pending = 0;
+    for (const ArqMessage &message : queue) pending += message.used;
+    return pending;
+}
+
+int arqInFlight() {
+    int inFlight = 0;
+    for (const ArqMessage &message : queue) inFlight += message.used && message.inFlight;
+    return inFlight;
+}
+
+const ArqStats &arqStats() {
+    return stats;
+}
+
+bool arqUnreportedRtt(uint32_t *rttMs) {
+    if (stats.rttSamples == reportedRttSamples) return false;
+    *rttMs = stats.lastRttMs;
+    return true;
+}
+
+void arqRttReported() {
+    reportedRttSamples = stats.rttSamples;
+}
+
+void arqSave(ArqSnapshot &snapshot) {
+    memcpy(snapshot.queue, queue, sizeof(queue));
+    snapshot.stats = stats;
+    snapshot.nextSeq = nextSeq;
+    snapshot.nextOrder = nextOrder;
+    snapshot.randomState = randomState;
+    snapshot.lastSentAt = lastSentAt;
+    snapshot.sentOnce = sentOnce;
+    snapshot.reportedRttSamples = reportedRttSamples;
+}
+
+void arqRestore(const ArqSnapshot &snapshot, uint32_t shiftMs) {
+    memcpy(queue, snapshot.queue, sizeof(queue));
+    for (ArqMessage &message : queue) {
+        message.queuedAt += shiftMs;
+        message.sentAt += shiftMs;
+        message.nextRetryAt += shiftMs;
+    }
+    stats = snapshot.stats;
+    nextSeq = snapshot.nextSeq;
+    nextOrder = snapshot.nextOrder;
+    randomState = snapshot.randomState;
+    lastSentAt = snapshot.lastSentAt + shiftMs;
+    sentOnce = snapshot.sentOnce;
+    reportedRttSamples = snapshot.reportedRttSamples;
+}
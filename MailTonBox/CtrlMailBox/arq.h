@@ -0,0 +1,109 @@
+/**
+ * @file arq.h
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Selective-repeat ARQ used by CtrlMailBox to deliver its events to MailTon.
+ *
+ * Frames (events and telemetry aggregated by uplink.h) are kept in a bounded
+ * queue and sent with an 8-bit sequence number (the message ID of the LoRa
+ * header). Up to ARQ_WINDOW messages can wait for
+ * their ACK at the same time, each one with its own retransmission timer
+ * (exponential backoff with jitter). MailTon acknowledges every frame with its
+ * sequence number (selective ACK) and the highest sequence received in order
+ * (cumulative ACK), so a lost ACK is recovered by the next one.
+ * The uplink carries the oldest unacknowledged sequence (BASE), which lets
+ * MailTon move its cumulative ACK past the messages that were given up.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef ARQ_H
+#define ARQ_H
+
+#include <stdint.h>
+
+#define ARQ_QUEUE_SIZE 8             // events waiting to be delivered
+#define ARQ_WINDOW 4                 // messages in flight at the same time
+#define ARQ_MAX_RETRIES 8            // transmissions before giving up a message
+#define ARQ_BASE_TIMEOUT_MS 5000     // first retransmission timeout
+#define ARQ_MAX_TIMEOUT_MS 60000
+#define ARQ_TX_GAP_MS 1500          // pause between frames, leaves room for the ACK of the previous one
+#define ARQ_DATA_LENGTH 80           // DATA and TLM fields of a frame built by the uplink aggregator
+
+struct ArqMessage {
+    char data[ARQ_DATA_LENGTH];
+    uint8_t seq;
+    uint8_t transmissions;
+    bool used;
+    bool inFlight;
+    bool urgent;             // event sent in the contention slots, the others wait for the own slot
+    uint32_t order;          // enqueue order, messages are sent first-in first-out (unique)
+    uint32_t queuedAt;
+    uint32_t sentAt;         // last transmission
+    uint32_t nextRetryAt;
+};
+
+struct ArqStats {
+    uint32_t enqueued;
+    uint32_t delivered;
+    uint32_t retransmissions;
+    uint32_t overflows;       // events rejected because the queue was full
+    uint32_t failures;        // messages given up after ARQ_MAX_RETRIES
+    uint32_t lastLatencyMs;   // from the event to its ACK
+    uint32_t avgLatencyMs;    // moving average
+    uint32_t maxLatencyMs;
+    uint32_t lastRttMs;       // from the transmission to its ACK, only for messages sent once (Karn)
+    uint32_t rttSamples;
+};
+
+// state of the ARQ kept in the RTC memory during a deep sleep (see power.h)
+struct ArqSnapshot {
+    ArqMessage queue[ARQ_QUEUE_SIZE];
+    ArqStats stats;
+    uint8_t nextSeq;
+    uint32_t nextOrder;
+    uint32_t randomState;
+    uint32_t lastSentAt;
+    bool sentOnce;
+    uint32_t reportedRttSamples;
+};
+
+void arqInit(uint32_t seed);
+enum ArqStatus : uint8_t {
+    ARQ_QUEUED = 0,     // waiting for its first transmission
+    ARQ_IN_FLIGHT,      // sent, waiting for the ACK
+    ARQ_DONE            // acknowledged or given up
+};
+
+// queues a frame, returns false if the queue is full; `*order` identifies it in arqStatus()
+bool arqEnqueue(const char *data, uint32_t nowMs, bool urgent, uint32_t *order);
+ArqStatus arqStatus(uint32_t order);
+// next message to transmit now (an expired retransmission or a new message in the window), or nullptr;
+// with urgentOnly the non-urgent messages are skipped
+ArqMessage *arqNextToSend(uint32_t nowMs, bool urgentOnly);
+// to be called when the message is on air, arms its retransmission timer
+void arqOnSent(ArqMessage *message, uint32_t nowMs);
+// cumulative ACK (every seq up to `cumulative`) plus selective ACK of `seq`
+void arqOnAck(uint8_t seq, int cumulative, uint32_t nowMs);
+// MailTon rejected the message: retry it after the backoff
+void arqOnNack(uint8_t seq, uint32_t nowMs);
+// sequence that the next new message will get
+uint8_t arqNextSeq();
+// oldest sequence not yet acknowledged (the next one to be assigned if nothing is in flight)
+uint8_t arqBase();
+// earliest time the ARQ has something to send, false if the queue is empty or waits for the window
+bool arqNextDeadline(uint32_t nowMs, uint32_t *deadlineMs);
+int arqPending();
+int arqInFlight();
+const ArqStats &arqStats();
+// round trip of the last ACK not yet reported to MailTon (RTT=ms in the uplink)
+bool arqUnreportedRtt(uint32_t *rttMs);
+// the uplink with the round trip went on air
+void arqRttReported();
+void arqSave(ArqSnapshot &snapshot);
+// the times of the snapshot are moved by shiftMs (the clock restarted after the deep sleep)
+void arqRestore(const ArqSnapshot &snapshot, uint32_t shiftMs);
+
+#endif
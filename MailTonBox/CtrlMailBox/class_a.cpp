@@ -0,0 +1,59 @@
+/**
+ * @file class_a.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Class A receive windows after the uplinks of CtrlMailBox (see class_a.h).
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include "class_a.h"
+
+static bool reached(uint32_t nowMs, uint32_t deadline) {
+    return (int32_t)(nowMs - deadline) >= 0;
+}
+
+void classAStart(ClassAWindows &windows, uint32_t txDoneMs) {
+    windows.txDoneAt = txDoneMs;
+    windows.state = CLASS_A_WAIT_RX1;
+}
+
+ClassAAction classAUpdate(ClassAWindows &windows, uint32_t nowMs) {
+    const uint32_t windowMs = 2 * CLASS_A_MARGIN_MS + CLASS_A_MAX_REPLY_MS;
+    uint32_t rx1 = windows.txDoneAt + CLASS_A_RX1_DELAY_MS - CLASS_A_MARGIN_MS;
+    uint32_t rx2 = windows.txDoneAt + CLASS_A_RX2_DELAY_MS - CLASS_A_MARGIN_MS;
+
+    switch (windows.state) {
+    case CLASS_A_WAIT_RX1:
+        if (!reached(nowMs, rx1)) return CLASS_A_NONE;
+        windows.state = CLASS_A_RX1;
+        windows.opened++;
+        return CLASS_A_OPEN;
+    case CLASS_A_RX1:
+        if (!reached(nowMs, rx1 + windowMs)) return CLASS_A_NONE;
+        windows.state = CLASS_A_WAIT_RX2;
+        return CLASS_A_CLOSE;
+    case CLASS_A_WAIT_RX2:
+        if (!reached(nowMs, rx2)) return CLASS_A_NONE;
+        windows.state = CLASS_A_RX2;
+        windows.opened++;
+        return CLASS_A_OPEN;
+    case CLASS_A_RX2:
+        if (!reached(nowMs, rx2 + windowMs)) return CLASS_A_NONE;
+        windows.state = CLASS_A_IDLE;
+        windows.missed++;
+        return CLASS_A_CLOSE;
+    default:
+        return CLASS_A_NONE;
+    }
+}
+
+void classAOnReply(ClassAWindows &windows) {
+    windows.state = CLASS_A_IDLE;
+}
+
+bool classAWindowOpen(const ClassAWindows &windows) {
+    return windows.state == CLASS_A_RX1 || windows.state == CLASS_A_RX2;
+}
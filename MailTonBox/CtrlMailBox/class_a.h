@@ -0,0 +1,60 @@
+/**
+ * @file class_a.h
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Class A receive windows (as in LoRaWAN) after the uplinks of CtrlMailBox.
+ *
+ * Shared by MailTon and CtrlMailBox (keep the two copies identical).
+ * A CtrlMailBox in class A keeps the radio asleep and listens only in two
+ * short windows, CLASS_A_RX1_DELAY_MS and CLASS_A_RX2_DELAY_MS after the end
+ * of its uplink. It asks for them with RXW=1 in the uplink; MailTon then
+ * sends the reply in the first window it can still reach, counted from the
+ * end of the reception of the uplink (see replyStartTime in mailTon.cpp).
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef CLASS_A_H
+#define CLASS_A_H
+
+#include <stdint.h>
+#include "tdma.h"
+
+#define CLASS_A_RX1_DELAY_MS 1000
+#define CLASS_A_RX2_DELAY_MS 2000
+#define CLASS_A_MARGIN_MS 30       // the window opens this much earlier and stays open this much later
+// time on air of the longest reply, the window covers all of it (as the TDMA slot, see tdma.cpp)
+#define CLASS_A_MAX_REPLY_MS loraTimeOnAirMs(TDMA_MAX_REPLY_LENGTH)
+
+enum ClassAState : uint8_t {
+    CLASS_A_IDLE = 0,   // radio asleep, no reply expected
+    CLASS_A_WAIT_RX1,
+    CLASS_A_RX1,        // first window open
+    CLASS_A_WAIT_RX2,
+    CLASS_A_RX2         // second window open
+};
+
+// what the radio of the CtrlMailBox must do
+enum ClassAAction : uint8_t {
+    CLASS_A_NONE = 0,
+    CLASS_A_OPEN,       // start receiving
+    CLASS_A_CLOSE       // put the radio to sleep
+};
+
+struct ClassAWindows {
+    ClassAState state;
+    uint32_t txDoneAt;      // end of the uplink
+    uint32_t opened;        // windows opened
+    uint32_t missed;        // uplinks without a reply in both windows
+};
+
+// CtrlMailBox: the uplink is on air until txDoneMs
+void classAStart(ClassAWindows &windows, uint32_t txDoneMs);
+ClassAAction classAUpdate(ClassAWindows &windows, uint32_t nowMs);
+// a reply arrived: the radio can go back to sleep
+void classAOnReply(ClassAWindows &windows);
+bool classAWindowOpen(const ClassAWindows &windows);
+
+#endif
@@ -9,7 +9,8 @@
  * - Ultrasonic sensor for detecting the presence of mail.
  * - Rotary encoder for manual control of the mailbox state.
  * - Servo motor for automated opening and closing of the mailbox.
- * - OLED display for real-time status updates.
+ * - OLED display for real-time status updates, with the diagnostics on further pages
+ *   (hold button 2 to change page).
  * 
  * The system supports saving and loading device credentials using non-volatile storage (Preferences),
  * and provides a web interface for configuration. It also includes mechanisms for message acknowledgment
@@ -32,7 +33,31 @@
 #include <DNSServer.h>
 #include <Preferences.h>
 #include <WiFiClientSecure.h>
+#include <esp_sleep.h>
+#include <driver/rtc_io.h>
+#include <sys/time.h>
 #include <index_html.h>
+#include "lora_airtime.h"
+#include "lora_tx.h"
+#include "packet_pool.h"
+#include "arq.h"
+#include "frame_auth.h"
+#include "adr.h"
+#include "lbt.h"
+#include "tdma.h"
+#include "class_a.h"
+#include "energy.h"
+#include "uplink.h"
+#include "ultrasonic.h"
+#include "distance_filter.h"
+#include "servo.h"
+#include "encoder.h"
+#include "mailbox_fsm.h"
+#include "mail_classifier.h"
+#include "power.h"
+
+// the slots of the beacon are sized for the longest frame
+static_assert(UPLINK_MAX_PAYLOAD <= TDMA_MAX_UPLINK_LENGTH, "a frame would overrun its TDMA slot");
 
 #define TRIG D0
 #define ECHO D1
@@ -40,6 +65,14 @@
 #define ROTARY_DT D8   // Pin del rotary encoder (Data)
 
 #define SERVO_PIN A6 // Pin di controllo del servo
+#define SERVO_CLOSED_ANGLE 90
+#define SERVO_OPEN_ANGLE -30
+#define SERVO_SLEW_DEG_PER_S 240  // motion profile of the servo, 0 = jump to the target
+#define WAKE_BUTTON_PIN -1         // RTC GPIO of a button that wakes the board from the deep sleep, -1 if none
+
+#ifndef digitalPinToGPIONumber
+#define digitalPinToGPIONumber(pin) (pin)
+#endif
 
 //server object port 80 
 AsyncWebServer server(80);
@@ -58,10 +91,20 @@ Preferences preferences;
 String CTRLMAILBOX_KEY = "VSJ5KNVS903N";
 String CTRLMAILBOX_NAME = ""; // CMBX1
 String MAILTON_KEY = ""; // 00BKFWR39FN4
+// the keys are not sent on air, the frames carry a MIC computed with a key derived from them
+FrameAuthKey frameKey;
+uint32_t uplinkCounter = 0;        // frame counter of the next uplink
+uint32_t savedUplinkCounter = 0;   // last value written in the preferences
+uint32_t downlinkCounter = 0;      // frame counter of the last downlink accepted
+bool downlinkCounterValid = false;
+// slots assigned by the beacons of MailTon, authenticated with a key derived from the MailTon key
+TdmaSync tdmaSync = {};
+FrameAuthKey beaconKey;
+uint32_t beaconCounter = 0;
+bool beaconCounterValid = false;
 
 bool loraFlagReceived = false;
 int count = 0;
-int count_sent = 0;
 bool displayNeedUpdate = false;
 
 // for LoRa communication
@@ -69,31 +112,129 @@ uint16_t localAddress = 0x01;
 uint16_t mtAddress = 0;       
 int theshold = 2;
 bool mail_detected = false;
-int readings_made = 0;
-String last_lora_msg = "New Mail";
-String lora_msg = "";
+// events of the sensors, from the detection to the ACK (see mailbox_fsm.h)
+MailboxFsm mailboxFsm;
+MailHistory mailHistory;      // last measures, classified when a deviation lasts (see mail_classifier.h)
+uint32_t fsmEventNumber = 0;  // number of the last event of the state machine in the aggregator, 0 if none
+bool fsmEventRefused = false; // the aggregator was full, the state machine offers the event again
+uint32_t fsmEventOrder = 0;   // ARQ frame that carries it
+bool fsmEventInArq = false;
 bool lora_priority = false;
 String last_message_received;
+int ackSeq = -1;        // sequence acknowledged by the last reply, -1 if missing
+int ackCumulative = -1; // cumulative ACK of the last reply, -1 if missing
 
-// variables for ultrasound sensor
-long signal_duration;
-int initial_distance = 0;
+// variables for ultrasound sensor: the measures come from a ring buffer filled by interrupts,
+// the distance is filtered (median + Kalman) and the initial distance is the baseline of the filter
+double initial_distance = 0;
 double distance = 0;
-int distance_update = 15;
+DistanceFilter distanceFilter;
 
-// Rotary encoder
+// Rotary encoder: the knob opens the mailbox after OPEN_THRESHOLD detents in the opening direction
+// and closes it after CLOSE_THRESHOLD detents back, counted from the farthest position reached (hysteresis)
 bool mailbox_open = false;
-int rotationCount = 5; 
-const int CLOSE_THRESHOLD = 15;
-const int OPEN_THRESHOLD = -15;
+int32_t rotationCount = 0;     // position of the encoder, detents
+int32_t rotationAnchor = 0;    // farthest position since the last change of state
+const int CLOSE_THRESHOLD = 2;
+const int OPEN_THRESHOLD = 2;
+const unsigned long ROTARY_ACTIVE_MS = 150; // the knob is being turned
 bool wait_rotary = false;
 // servo
 bool wait_servo = false;
 bool servo_open = false;
 
-unsigned long lastSendTime = 0;
-const unsigned long waitTime = 20000; // Waiting time for the answer (20 seconds)
-bool waitingForResponse = false;
+// duty cycle: the message is postponed until the sub-band has enough budget
+bool txDeferred = false;
+unsigned long txDeferredUntil = 0;
+// listen-before-talk: a CAD runs before every frame, a busy channel postpones it
+const bool LBT_ENABLED = true;
+Lbt lbt;
+volatile bool cadPending = false;    // CAD running, waiting for onCadDone()
+volatile bool cadDone = false;
+volatile bool cadBusy = false;
+unsigned long cadStartTime = 0;
+unsigned long lbtBackoffUntil = 0;
+// class A: the radio sleeps and listens only in the two windows after an uplink (battery operation),
+// the TDMA beacons are not followed and the messages use random access with LBT
+const bool CLASS_A_ENABLED = false;
+const unsigned long CLASS_A_IDLE_MS = 20;   // pause of the loop when there is nothing to do
+ClassAWindows rxWindows = {};
+// the uplink goes on air without waiting, onTxDone() ends it (see lora_tx.h)
+LoraTx loraTx;
+
+// adaptive data rate: TX power recommended by MailTon in the ACK, applied with hysteresis (limits in adr.h)
+const int ADR_HYSTERESIS_DB = 2;     // smaller decreases are ignored
+const int ADR_CONFIRMATIONS = 3;     // consecutive ACKs needed to lower the power
+int txPower = ADR_MAX_TX_POWER;
+int adrRecommendedPower = -1;        // from the last ACK, -1 if missing
+int adrCandidatePower = ADR_MAX_TX_POWER;
+int adrConfirmations = 0;
+
+// last telemetry sample
+uint32_t telemetrySampleTime = 0;
+uint8_t telemetryFlags = 0;
+bool telemetrySampled = false;
+
+// deep sleep between the ranging bursts, woken by the timer, the knob or the button (see power.h);
+// it needs CLASS_A_ENABLED: the radio does not listen while the MCU sleeps
+const bool DEEP_SLEEP_ENABLED = false;
+#define RETAINED_MAGIC 0x434D4258UL  // "CMBX"
+// state kept in the RTC memory during the deep sleep: after a wake-up the node goes on
+// without reading the preferences, deriving the keys, warming up the filter or starting the WiFi
+struct RetainedState {
+    uint32_t magic;
+    PowerManager power;
+    char name[64];
+    char mailTonKey[32];
+    uint16_t mtAddress;
+    uint8_t frameKey[FRAME_AUTH_KEY_LENGTH];
+    uint8_t beaconKey[FRAME_AUTH_KEY_LENGTH];
+    uint32_t uplinkCounter;
+    uint32_t savedUplinkCounter;
+    uint32_t downlinkCounter;
+    bool downlinkCounterValid;
+    int txPower;
+    int adrCandidatePower;
+    int adrConfirmations;
+    DistanceFilter distanceFilter;
+    MailHistory mailHistory;
+    MailboxFsm mailboxFsm;
+    ArqSnapshot arq;
+    UplinkSnapshot uplink;
+    DutyCycleSnapshot dutyCycle;
+    uint32_t telemetrySampleTime;
+    uint8_t telemetryFlags;
+    bool telemetrySampled;
+    uint32_t sleepAtMs;     // millis() when the node went to sleep
+    int64_t sleepAtUs;      // RTC time when the node went to sleep
+};
+RTC_DATA_ATTR RetainedState retained;
+bool resumed = false;       // woken from the deep sleep with the retained state
+
+// configuration portal (soft-AP, DNS and web server): opened when the credentials are missing or with a
+// long press of button 1, closed after a successful save or after PORTAL_IDLE_TIMEOUT_MS without clients
+const unsigned long PORTAL_LONG_PRESS_MS = 3000;
+const unsigned long PORTAL_IDLE_TIMEOUT_MS = 300000;
+const unsigned long PORTAL_CLOSE_DELAY_MS = 3000;   // the page gets the answer of the save before the AP goes down
+bool portalActive = false;
+bool portalRoutes = false;          // the routes are registered once, the server is started at every opening
+volatile bool portalSaved = false;
+volatile unsigned long portalSavedTime = 0;
+volatile unsigned long portalActivityTime = 0;
+unsigned long btn1PressTime = 0;
+bool btn1Pressed = false;
+bool btn1LongPress = false;         // the release of the long press does not send the test message
+
+// status screen: page 0 is the device status, the others the diagnostics of the radio and of the mailbox;
+// holding button 2 shows the next page, the release of that press does not toggle the mailbox
+const unsigned long DISPLAY_PAGE_PRESS_MS = 800;
+const unsigned long DISPLAY_REFRESH_MS = 250;
+const uint8_t DISPLAY_PAGES = 3;
+uint8_t displayPage = 0;
+unsigned long displayRefreshTime = 0;
+unsigned long btn2PressTime = 0;
+bool btn2Pressed = false;
+bool btn2LongPress = false;
 
 void resetDevice() {
     preferences.begin("device", false);
@@ -107,6 +248,40 @@ void resetDevice() {
     ESP.restart();
 }
     
+// derives the key of the frames from the CtrlMailBox key, the MailTon key and the name
+void setupFrameKey() {
+    uint8_t key[FRAME_AUTH_KEY_LENGTH];
+    frameAuthDeriveKey(CTRLMAILBOX_KEY.c_str(), MAILTON_KEY.c_str(), CTRLMAILBOX_NAME.c_str(), key);
+    frameAuthSetKey(frameKey, key);
+    memcpy(retained.frameKey, key, sizeof(key));
+    downlinkCounterValid = false;
+    frameAuthDeriveKey(MAILTON_KEY.c_str(), MAILTON_KEY.c_str(), TDMA_BEACON_KEY_NAME, key);
+    frameAuthSetKey(beaconKey, key);
+    memcpy(retained.beaconKey, key, sizeof(key));
+    beaconCounterValid = false;
+}
+
+// the uplink counter must never go back: after a restart it starts after the last
+// value saved, which is saved again every FRAME_COUNTER_SAVE_PERIOD frames
+void loadFrameCounter() {
+    preferences.begin("device", false);
+    uplinkCounter = preferences.getUInt("fcnt", 0) + FRAME_COUNTER_JUMP;
+    preferences.putUInt("fcnt", uplinkCounter);
+    preferences.end();
+    savedUplinkCounter = uplinkCounter;
+}
+
+uint32_t nextFrameCounter() {
+    uint32_t counter = uplinkCounter++;
+    if (uplinkCounter - savedUplinkCounter >= FRAME_COUNTER_SAVE_PERIOD) {
+        preferences.begin("device", false);
+        preferences.putUInt("fcnt", uplinkCounter);
+        preferences.end();
+        savedUplinkCounter = uplinkCounter;
+    }
+    return counter;
+}
+
 bool saveDeviceCredentials (const String &newMailTon_key, const String &newCtrlMailBox_name, uint16_t &newMailTon_address) {
     preferences.begin("device", false);
     preferences.putString("MailTon_key", newMailTon_key);
@@ -114,6 +289,7 @@ bool saveDeviceCredentials (const String &newMailTon_key, const String &newCtrlM
     preferences.putUShort("MailTon_address", newMailTon_address);
 
     preferences.end();
+    setupFrameKey();
 
     display->println("Saved Account credentials:");
     display->println("CtrlMailBox name: " + newCtrlMailBox_name);
@@ -135,6 +311,7 @@ bool loadDeviceCredentials() {
         Serial.println("Account credentials don't find =^.^=");
         return false;
     }
+    setupFrameKey();
 
     display->println("Account credentials loaded:");
     display->println("MailTon key: " + MAILTON_KEY);
@@ -146,11 +323,13 @@ bool loadDeviceCredentials() {
 
 // Callback for the main page
 void handleRoot(AsyncWebServerRequest *request) {
+    portalActivityTime = millis();
     request->send(200, "text/html", index_html);
 }
 
 // Callback to manage the form
 void handleSave(AsyncWebServerRequest *request) {
+    portalActivityTime = millis();
     if(request->hasParam("ctrlmailboxname", true) && request->hasParam("mailtonkey", true) && request->hasParam("mailtonaddress", true)) {
         CTRLMAILBOX_NAME = request->getParam("ctrlmailboxname", true)->value();
         MAILTON_KEY = request->getParam("mailtonkey", true)->value();
@@ -165,6 +344,11 @@ void handleSave(AsyncWebServerRequest *request) {
         // use preferences to save
         if (saveDeviceCredentials(MAILTON_KEY, CTRLMAILBOX_NAME, mtAddress)) {
             request->send(200, "text", "document.getElementById('savedCredentials').style.display='block';");
+            // complete credentials: loop() closes the portal
+            if (!MAILTON_KEY.isEmpty() && !CTRLMAILBOX_NAME.isEmpty() && mtAddress != 0) {
+                portalSavedTime = millis();
+                portalSaved = true;
+            }
         } else {
             request->send(500, "text", "document.getElementById('errorCredentials').style.display='block';");
         }        
@@ -182,8 +366,9 @@ void handleSave(AsyncWebServerRequest *request) {
     }
 }  
 
-void configureWiFi() {
+void startConfigPortal() {
     // configure the form as an access point
+    WiFi.mode(WIFI_AP);
     WiFi.softAPConfig(local_IP, gateway, subnet);
 
     WiFi.softAP(ssidAP, passwordAP);
@@ -192,41 +377,96 @@ void configureWiFi() {
     dnsServer.start(DNS_PORT, "*", WiFi.softAPIP());
 
     // HTTP | configure the server routes
-    server.on("/", HTTP_GET, handleRoot);
-    server.on("/", HTTP_POST, handleSave);
+    if (!portalRoutes) {
+        server.on("/", HTTP_GET, handleRoot);
+        server.on("/", HTTP_POST, handleSave);
+        portalRoutes = true;
+    }
     server.begin();
+    portalSaved = false;
+    portalActivityTime = millis();
+    portalActive = true;
+    display->println("Config portal: " + String(ssidAP));
+    display->display();
+}
+
+// the WiFi radio is turned off and the memory of the servers is given back to the sensing path
+void stopConfigPortal() {
+    server.end();
+    dnsServer.stop();
+    WiFi.softAPdisconnect(true);
+    WiFi.mode(WIFI_OFF);
+    portalActive = false;
+}
+
+// opens the portal on a long press of button 1 and closes it once provisioned or idle
+void updateConfigPortal() {
+    bool pressed = digitalRead(BTN_1) == LOW;
+    if (pressed && !btn1Pressed) btn1PressTime = millis();
+    if (pressed && !btn1LongPress && millis() - btn1PressTime >= PORTAL_LONG_PRESS_MS) {
+        btn1LongPress = true;
+        if (!portalActive) startConfigPortal();
+    }
+    btn1Pressed = pressed;
+
+    if (!portalActive) return;
+    dnsServer.processNextRequest();
+    if (WiFi.softAPgetStationNum() > 0) portalActivityTime = millis();
+    if ((portalSaved && millis() - portalSavedTime >= PORTAL_CLOSE_DELAY_MS) ||
+        millis() - portalActivityTime >= PORTAL_IDLE_TIMEOUT_MS) {
+        stopConfigPortal();
+    }
 }
 
-void IRAM_ATTR rotaryChanged() {
-    wait_rotary = true;
-    if (digitalRead(ROTARY_CLK) == digitalRead(ROTARY_DT)) {
-        mailbox_open = false;
+// open/closed state from the position of the encoder; the state is changed only when a threshold is crossed,
+// so the button and the auto-close keep their effect until the knob is turned again
+void updateRotary() {
+    rotationCount = encoderPosition();
+    wait_rotary = millis() - encoderLastMoveMs() < ROTARY_ACTIVE_MS;
+    if (!mailbox_open) {
+        rotationAnchor = min(rotationAnchor, rotationCount);
+        if (rotationCount - rotationAnchor >= OPEN_THRESHOLD) {
+            mailbox_open = true;
+            rotationAnchor = rotationCount;
+        }
     } else {
-        mailbox_open = true;
+        rotationAnchor = max(rotationAnchor, rotationCount);
+        if (rotationAnchor - rotationCount >= CLOSE_THRESHOLD) {
+            mailbox_open = false;
+            rotationAnchor = rotationCount;
+        }
     }
-    wait_rotary = false;
 }
 
-// function to generate the PWM signal for the servant
+// moves the servo to `angle`: the LEDC generates the pulses and servoUpdate() completes the motion in loop()
 void writeServo(int angle) {
-    wait_servo = true;
-    // per mappare l'angolo in un intervallo di larghezza dell'impulso
-    int pulseWidth = map(angle, 0, 180, 1000, 2000); 
-    
+    servoSetTarget(angle, millis());
+    servo_open = angle != SERVO_CLOSED_ANGLE;
+}
 
-    /**
-     * @brief  PWM signal 
-     * 
-     * @param pulseWidth variable width impulse/ impulso di larghezza variabile
-     */
-    digitalWrite(SERVO_PIN, HIGH);
-    delayMicroseconds(pulseWidth);  
-    digitalWrite(SERVO_PIN, LOW);
-    delay(20 - pulseWidth / 1000);  // PWM  cycle (20 ms)
+void applyTxPower(int power) {
+    txPower = constrain(power, ADR_MIN_TX_POWER, ADR_MAX_TX_POWER);
+    lora->setTxPower(txPower);
+}
 
-    if(angle == 90) servo_open = false;
-    else servo_open = true;
-    wait_servo = false;
+// raise the power at once when the link gets worse, lower it only after a few confirmations
+void handleAdrRecommendation(int recommended) {
+    if (recommended < 0) return;
+    if (recommended >= txPower) {
+        if (recommended > txPower) applyTxPower(recommended);
+        adrConfirmations = 0;
+        return;
+    }
+    if (txPower - recommended < ADR_HYSTERESIS_DB) {
+        adrConfirmations = 0;
+        return;
+    }
+    // keep the least aggressive of the confirmed recommendations
+    adrCandidatePower = adrConfirmations == 0 ? recommended : max(adrCandidatePower, recommended);
+    if (++adrConfirmations >= ADR_CONFIRMATIONS) {
+        applyTxPower(adrCandidatePower);
+        adrConfirmations = 0;
+    }
 }
 
 bool isAckMessage(const String& message) {
@@ -243,54 +483,104 @@ String extractValue(String message, String key) {
     return message.substring(startIndex, endIndex);
 }
 
-// function to receive messages Lora
+// radio back to rest: asleep in class A (outside the windows), receiving otherwise
+void radioIdle() {
+    if (CLASS_A_ENABLED && !classAWindowOpen(rxWindows)) {
+        lora->sleep();
+        energyRadio(RADIO_SLEEP, millis());
+    } else {
+        lora->receive();
+        energyRadio(RADIO_RX, millis());
+    }
+}
+
+// function to receive messages Lora: the packet is read at once in a buffer of the pool
+// and parsed by loop(), nothing is allocated here
 void onLoRaReceive(int packetSize) {
     // if there's no packet, return
     if (packetSize == 0)
         return; 
 
-    // read packet header bytes:
-    uint16_t recipient = lora->read();  // recipient address
-    uint16_t sender = lora->read();     // sender address
-    byte incomingMsgId = lora->read();  // incoming msg ID
-    byte incomingLength = lora->read(); // incoming msg length
-    byte receivedChecksum = lora->read(); // read checksum
-
-    String incoming = ""; // payload of packet
+    PacketBuffer *packet = packetAcquire();
+    if (packet == nullptr) return; // pool exhausted, counted in its stats
+    packet->length = lora->readBytes(packet->data, packetSize < PACKET_BUFFER_SIZE ? packetSize : PACKET_BUFFER_SIZE);
+    packet->rssi = lora->packetRssi();
+    packet->snr = lora->packetSnr();
+    packet->receivedAt = millis();
+    packetQueuePush(packet);
+    packetRelease(packet);
+}
 
-    while (lora->available()){          // can't use readString() in callback, so
-        incoming += (char)lora->read(); // add bytes one by one
-    }
+// function to handle the LoRa messages received, called by loop() for each packet of the queue
+void handleLoRaPacket(const PacketBuffer &packet) {
+    // packet header bytes: recipient, sender, msg ID, msg length, checksum
+    const uint8_t *header = packet.data;
+    uint16_t recipient = header[0];
+    uint16_t sender = header[1];
+    byte incomingMsgId = header[2];
+    byte incomingLength = header[3];
+    byte receivedChecksum = header[4];
+
+    const uint8_t *payload = packet.data + LORA_HEADER_LENGTH;
+    int payloadLength = packet.length > LORA_HEADER_LENGTH ? packet.length - LORA_HEADER_LENGTH : 0;
     
     byte calculatedChecksum = 0;
-    for (int i = 0; i < incoming.length(); i++) {
-        calculatedChecksum ^= incoming[i];
+    for (int i = 0; i < payloadLength; i++) {
+        calculatedChecksum ^= payload[i];
     }
     
     // receivedChecksum != calculatedChecksum 
-    if (incomingLength != incoming.length() || receivedChecksum != calculatedChecksum){ 
+    if (packet.length < LORA_HEADER_LENGTH || incomingLength != payloadLength || payloadLength < FRAME_AUTH_TRAILER_LENGTH || receivedChecksum != calculatedChecksum){ 
         display->clearDisplay();
         display->setCursor(0,0);
         display->println("error: message length or checksum does not match");
         return;
     }
 
-    // Estrai nome, key e dati
+    // the text is followed by the frame counter and the MIC
+    int textLength = payloadLength - FRAME_AUTH_TRAILER_LENGTH;
+
+    // beacon of MailTon: binary payload with the slot assignments
+    if (recipient == TDMA_BROADCAST_ADDRESS) {
+        uint32_t beaconFrameCounter;
+        if (sender == mtAddress &&
+            frameAuthVerify(beaconKey, FRAME_DOWNLINK, header, payload, textLength, payload + textLength, &beaconFrameCounter) &&
+            (!beaconCounterValid || beaconFrameCounter > beaconCounter)) {
+            beaconCounter = beaconFrameCounter;
+            beaconCounterValid = true;
+            tdmaParseBeacon(tdmaSync, payload, textLength, localAddress, packet.receivedAt);
+        }
+        radioIdle();
+        return;
+    }
+    uint32_t frameCounter;
+    bool authentic = frameAuthVerify(frameKey, FRAME_DOWNLINK, header, payload, textLength, payload + textLength, &frameCounter);
+    String incoming = "";
+    incoming.concat((const char *)payload, textLength);
+
+    // Estrai nome e dati
     String receiverName = extractValue(incoming, "NAME");
-    String receiverKey = extractValue(incoming, "CTRLMAILBOX_KEY");
-    String senderKey = extractValue(incoming, "MAILTON_KEY");
     String data = extractValue(incoming, "DATA");
-
-    if (receiverName != CTRLMAILBOX_NAME ||  receiverKey != CTRLMAILBOX_KEY || senderKey != MAILTON_KEY) {
-        display->println("Address or key mismatch detected:");
-        display->println("Recipient: " + recipientStr + ", Local: " + localAddressStr);
-        display->println("Sender: " + senderStr + ", CMB: " + ctrlmbAddressStr);
+    String adrPower = extractValue(incoming, "ADR_PW");
+    String replySeq = extractValue(incoming, "SEQ");
+    String replyCumulative = extractValue(incoming, "CUM");
+
+    if (receiverName != CTRLMAILBOX_NAME || !authentic) {
+        display->println("Name or MIC mismatch detected:");
+        display->printf("Recipient: %04X, Local: %04X\n", recipient, localAddress);
+        display->printf("Sender: %04X, MT: %04X\n", sender, mtAddress);
         display->println("Receiver Name: " + receiverName + ", Expected: " + CTRLMAILBOX_NAME);
-        display->println("Sender Key: " + senderKey + ", Expected: " + MAILTON_KEY);
-        display->println("Receiver Key: " + receiverKey + ", Expected: " + CTRLMAILBOX_KEY);
         //display->display();
         return;
     }
+
+    // a frame counter already seen is a replay of an old frame
+    if (downlinkCounterValid && frameCounter <= downlinkCounter) {
+        display->printf("Replayed frame: %u\n", (unsigned)frameCounter);
+        return;
+    }
+    downlinkCounter = frameCounter;
+    downlinkCounterValid = true;
     
     count++;
     display->clearDisplay();
@@ -301,88 +591,378 @@ void onLoRaReceive(int packetSize) {
     display->printf("Count: %d\n", count);
     display->printf("Message length: %d\n", incomingLength);
     display->printf("Message: %s\n", data);
-    display->printf("RSSI: %d\n", lora->packetRssi());
-    display->printf("Snr: %02f\n", lora->packetSnr());
+    display->printf("RSSI: %d\n", packet.rssi);
+    display->printf("Snr: %02f\n", packet.snr);
     
-    lora->receive();
+    radioIdle();
     last_message_received = data;
+    adrRecommendedPower = adrPower.isEmpty() ? -1 : adrPower.toInt();
+    ackSeq = replySeq.isEmpty() ? -1 : replySeq.toInt();
+    ackCumulative = replyCumulative.isEmpty() ? -1 : replyCumulative.toInt();
     loraFlagReceived = true; // set the reception flag
 }
 
 void onLoRaSend() {
+    loraTxOnDone(loraTx, millis());
+}
+
+// next message allowed by the TDMA schedule (any message without beacons), or nullptr
+ArqMessage *nextScheduledMessage() {
+    TdmaWindow window = CLASS_A_ENABLED ? TDMA_UNSYNCED : tdmaWindow(tdmaSync, millis());
+    if (window == TDMA_OTHER_SLOT) return nullptr;
+    return arqNextToSend(millis(), window == TDMA_CONTENTION);
 }
 
-void sendMessageLoRa() {
+void onCadDone(boolean detected) {
+    cadBusy = detected;
+    cadDone = true;
+}
+
+// send a message of the ARQ queue, returns false if postponed by the duty cycle
+bool sendMessageLoRa(ArqMessage *message) {
+    // the sequence of a new message is assigned when it goes on air
+    uint8_t seq = message->inFlight ? message->seq : arqNextSeq();
+    String messageToSend = "NAME=" + CTRLMAILBOX_NAME + ";" + message->data + ";TXP=" + String(txPower) + ";BASE=" + String(arqBase());
+    if (CLASS_A_ENABLED) messageToSend += ";RXW=1"; // MailTon must reply in the receive windows
+    uint32_t rttMs;
+    bool rttReport = arqUnreportedRtt(&rttMs);  // round trip of the last ACK, for the link stats of MailTon
+    if (rttReport) messageToSend += ";RTT=" + String(min(rttMs, (uint32_t)65535));
+    size_t payloadLength = messageToSend.length() + FRAME_AUTH_TRAILER_LENGTH;
+
+    // respect the duty cycle of the sub-band, otherwise retry when there is budget
+    uint32_t waitMs;
+    uint32_t airtimeMs = loraTimeOnAirMs(LORA_HEADER_LENGTH + payloadLength);
+    if (!dutyCycleTryTransmit(LORA_FREQUENCY, airtimeMs, millis(), &waitMs)) {
+        txDeferred = true;
+        txDeferredUntil = millis() + waitMs;
+        return false;
+    }
+    txDeferred = false;
+
+    // a retransmission means no ACK: the link may be too weak for the power set by the ADR
+    if (message->inFlight) {
+        if (txPower < ADR_MAX_TX_POWER) applyTxPower(txPower + ADR_STEP_DB);
+        adrConfirmations = 0;
+    }
+
     lora_priority = true;
     digitalWrite(LED_GREEN, HIGH);
-    last_lora_msg = lora_msg; // modified at each call
-    
-    String messageToSend = "NAME=" + CTRLMAILBOX_NAME + ";CTRLMAILBOX_KEY=" + CTRLMAILBOX_KEY + ";MAILTON_KEY=" + MAILTON_KEY + ";DATA=" + lora_msg;
-
     lora->beginPacket();
 
-    lora->write(mtAddress);                // add mtAddress address
-    lora->write(localAddress);             // add sender address
-    lora->write(count_sent);               // add message ID
-    lora->write(messageToSend.length());   // add payload length
+    uint8_t header[FRAME_AUTH_HEADER_LENGTH] = {
+        (uint8_t)mtAddress,                // mtAddress address
+        (uint8_t)localAddress,             // sender address
+        seq,                               // message ID (ARQ sequence)
+        (uint8_t)payloadLength             // payload length, trailer included
+    };
+    uint8_t trailer[FRAME_AUTH_TRAILER_LENGTH];
+    frameAuthSign(frameKey, FRAME_UPLINK, header, nextFrameCounter(),
+                  (const uint8_t *)messageToSend.c_str(), messageToSend.length(), trailer);
 
     // XOR 
     byte checksum = 0;
     for (int i = 0; i < messageToSend.length(); i++) {
         checksum ^= messageToSend[i];
     }
+    for (int i = 0; i < FRAME_AUTH_TRAILER_LENGTH; i++) {
+        checksum ^= trailer[i];
+    }
+    lora->write(header, sizeof(header));   // add header
     lora->write(checksum); // add checksum
     lora->print(messageToSend); // add payload
+    lora->write(trailer, sizeof(trailer)); // add frame counter and MIC
 
     lora->endPacket(true); // true = async / non-blocking mode
-    delay(100);
+    loraTxStart(loraTx, airtimeMs, millis());
+    if (rttReport) arqRttReported();
+    energyRadio(RADIO_TX, millis());
+    arqOnSent(message, millis());
+    // the radio stays in TX until onTxDone(), loop() then puts it back to rest
+    return true;
+}
+
+// queue an event for MailTon, it is aggregated with the other events and the telemetry in loop();
+// urgent events are sent at once in the contention slots, the others wait for the slot of this CtrlMailBox
+bool queueMessageLoRa(const char *data, bool urgent) {
+    return uplinkAddEvent(data, urgent, millis());
+}
 
-    count_sent++;
-    lora->receive();
+// room for the DATA and TLM fields in a frame of UPLINK_MAX_PAYLOAD bytes
+size_t uplinkCapacity() {
+    size_t fixed = LORA_HEADER_LENGTH + FRAME_AUTH_TRAILER_LENGTH + CTRLMAILBOX_NAME.length() + strlen("NAME=;;TXP=14;BASE=255;RXW=1;RTT=65535");
+    size_t capacity = fixed < UPLINK_MAX_PAYLOAD ? UPLINK_MAX_PAYLOAD - fixed : 0;
+    return min(capacity, (size_t)ARQ_DATA_LENGTH - 1);
+}
 
-    loraFlagReceived = false;
-    waitingForResponse = true; // set the waiting flag
-    lastSendTime = millis(); // record the sending time
+// telemetry sample every UPLINK_SAMPLE_PERIOD_MS and at every change of the state of the mailbox
+void sampleTelemetry() {
+    uint8_t flags = (mailbox_open ? TELEMETRY_MAILBOX_OPEN : 0) | (servo_open ? TELEMETRY_SERVO_OPEN : 0) |
+                    (mail_detected ? TELEMETRY_MAIL_DETECTED : 0);
+    if (telemetrySampled && flags == telemetryFlags && millis() - telemetrySampleTime < UPLINK_SAMPLE_PERIOD_MS) return;
+
+    TelemetrySample sample = {(uint32_t)millis(), (int16_t)distance, (int16_t)initial_distance, flags};
+    uplinkAddSample(sample);
+    telemetrySampleTime = millis();
+    telemetryFlags = flags;
+    telemetrySampled = true;
+}
 
-    digitalWrite(LED_GREEN, LOW);
-    lora_priority = false;
+// moves the content of the aggregator to the ARQ when a frame is due
+void flushUplink() {
+    size_t capacity = uplinkCapacity();
+    if (arqPending() >= ARQ_QUEUE_SIZE || !uplinkFlushDue(millis(), capacity)) return;
+    char fields[ARQ_DATA_LENGTH];
+    bool urgent;
+    uint32_t order;
+    if (uplinkBuild(fields, capacity, millis(), &urgent) > 0 && arqEnqueue(fields, millis(), urgent, &order)) {
+        // the events go in the frames in order: this frame carries the event of the state machine
+        if (fsmEventNumber != 0 && !fsmEventInArq && uplinkStats().events >= fsmEventNumber) {
+            fsmEventOrder = order;
+            fsmEventInArq = true;
+        }
+    }
+}
+
+// progress of the last event of the state machine in the uplink
+MailboxEventStatus fsmEventStatus() {
+    if (fsmEventRefused) {
+        // offered again only when the aggregator has room
+        const UplinkStats &stats = uplinkStats();
+        return stats.queued - stats.events < UPLINK_MAX_EVENTS ? MAILBOX_EVENT_REFUSED : MAILBOX_EVENT_QUEUED;
+    }
+    if (fsmEventNumber == 0) return MAILBOX_EVENT_DONE;
+    if (!fsmEventInArq) return MAILBOX_EVENT_QUEUED;
+    switch (arqStatus(fsmEventOrder)) {
+    case ARQ_QUEUED: return MAILBOX_EVENT_QUEUED;
+    case ARQ_IN_FLIGHT: return MAILBOX_EVENT_ON_AIR;
+    default: return MAILBOX_EVENT_DONE;
+    }
 }
 
 void onBtn1Released(uint8_t pinBtn){
-    lora_msg = "AAAAAAAA";
-    sendMessageLoRa();
+    if (btn1LongPress) {
+        btn1LongPress = false;
+        return;
+    }
+    queueMessageLoRa("AAAAAAAA", false);
 }
 
 void onBtn2Released(uint8_t pinBtn){
+    if (btn2LongPress) {
+        btn2LongPress = false;
+        return;
+    }
     mailbox_open = !mailbox_open;
 }
 
-int measuresDistance() {
-    digitalWrite(TRIG, LOW);
-    delayMicroseconds(2);
-    digitalWrite(TRIG, HIGH);
-    delayMicroseconds(10);
-    digitalWrite(TRIG, LOW);
-    
-    double signal_duration = pulseIn(ECHO, HIGH, 30000);
-    double cm = signal_duration / 58;
-    // for the range
-    if(cm > 1000) cm = 1;
-    return (cm > 0 && cm < 100) ? cm : 100;
+// a long press of button 2 shows the next page of the status screen
+void updateDisplayPage() {
+    bool pressed = digitalRead(BTN_2) == LOW;
+    if (pressed && !btn2Pressed) btn2PressTime = millis();
+    if (pressed && !btn2LongPress && millis() - btn2PressTime >= DISPLAY_PAGE_PRESS_MS) {
+        btn2LongPress = true;
+        displayPage = (displayPage + 1) % DISPLAY_PAGES;
+        displayRefreshTime = millis() - DISPLAY_REFRESH_MS; // redraw now
+    }
+    btn2Pressed = pressed;
 }
 
-int measuresAverageDistance() {
-    long sum = 0;
-    int readings = 25;
-    for (int i = 0; i < readings; i++) {
-        double distance = measuresDistance();
-        sum += distance;
-        delay(15);
+// status screen, 8 rows of text: only the page shown is drawn
+void drawStatusPage() {
+    display->clearDisplay();
+    display->setCursor(0,0);
+    if (displayPage == 0) {
+        display->printf("Distance: %.2f cm\n", distance);
+        display->println(mailbox_open ? "MAILBOX OPEN =^.^= " : "MAILBOX CLOSE");
+        if (portalActive) display->printf("Config portal: %s\n", ssidAP);
+        display->printf("CMB addr: %04X\n", localAddress);
+        display->println("CMB Name: " + CTRLMAILBOX_NAME);
+        display->println("CMB KEY: " + CTRLMAILBOX_KEY);
+        display->printf("MT addr:  %04X\n",  mtAddress);
+        display->println("MT KEY: " + MAILTON_KEY );
+    } else if (displayPage == 1) {
+        display->println("- Radio -");
+        display->printf("Duty left: %u ms\n", (unsigned)dutyCycleRemainingMs(LORA_FREQUENCY, millis()));
+        display->printf("TX %d dBm %u ms (%+d)\n", txPower, (unsigned)loraTx.stats.lastMs, (int)loraTx.stats.lastOverrunMs);
+        display->printf("ARQ q:%d lat:%u ms\n", arqPending(), (unsigned)arqStats().avgLatencyMs);
+        display->printf("Up %u fr %u ev %u tlm\n", (unsigned)uplinkStats().frames, (unsigned)uplinkStats().events,
+                        (unsigned)uplinkStats().samples);
+        display->printf("CAD %u busy %u\n", (unsigned)lbt.stats.cadRuns, (unsigned)lbt.stats.cadHits);
+        if (tdmaWindow(tdmaSync, millis()) != TDMA_UNSYNCED) {
+            display->printf("Slot %d/%u\n", tdmaSync.ownSlot, (unsigned)tdmaSync.slotCount);
+        } else {
+            display->println("Slot: no beacon");
+        }
+    } else {
+        display->println("- Mailbox & power -");
+        display->printf("%s det->up %u ms\n", mailboxStateName(mailboxFsm.state), (unsigned)mailboxFsm.lastLatencyMs);
+        display->printf("Ignored %u drift %u\n", (unsigned)mailboxFsm.transients, (unsigned)mailboxFsm.drifts);
+        const EnergyReport &energy = energyReport(millis());
+        display->printf("E %.2f mAh (on %.2f)\n", energy.radioMah + energy.mcuMah, energy.alwaysOnMah);
+        if (DEEP_SLEEP_ENABLED) {
+            display->printf("Wake %s %u ms\n", wakeSourceName(retained.power.lastWake), (unsigned)retained.power.lastResumeMs);
+            display->printf("Slept %u s\n", (unsigned)(retained.power.sleptMs / 1000));
+        }
+    }
+    display->display();
+}
+
+// reads the measures of the ultrasonic sensor without waiting, returns true when the filter is ready;
+// with `track` false the measures are discarded (mailbox open, servo moving)
+bool updateDistance(bool track) {
+    UltrasonicSample sample;
+    while (ultrasonicRead(sample)) {
+        if (!track) {
+            mailHistoryReset(mailHistory);
+            continue;
+        }
+        // a lost echo is a missing measure, not a distance
+        if (sample.echoUs == 0) continue;
+        distance = distanceFilterUpdate(distanceFilter, sample.cm, mail_detected || mailbox_open);
+        mailHistoryAdd(mailHistory, distance, sample.cm);
+    }
+    if (!distanceFilterReady(distanceFilter)) return false;
+    initial_distance = distanceFilter.baseline;
+    return true;
+}
+
+// system time: it keeps running on the RTC timer during the deep sleep, unlike millis()
+int64_t rtcTimeUs() {
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_usec;
+}
+
+void saveRetainedState() {
+    retained.magic = RETAINED_MAGIC;
+    strlcpy(retained.name, CTRLMAILBOX_NAME.c_str(), sizeof(retained.name));
+    strlcpy(retained.mailTonKey, MAILTON_KEY.c_str(), sizeof(retained.mailTonKey));
+    retained.mtAddress = mtAddress;
+    retained.uplinkCounter = uplinkCounter;
+    retained.savedUplinkCounter = savedUplinkCounter;
+    retained.downlinkCounter = downlinkCounter;
+    retained.downlinkCounterValid = downlinkCounterValid;
+    retained.txPower = txPower;
+    retained.adrCandidatePower = adrCandidatePower;
+    retained.adrConfirmations = adrConfirmations;
+    retained.distanceFilter = distanceFilter;
+    retained.mailHistory = mailHistory;
+    retained.mailboxFsm = mailboxFsm;
+    arqSave(retained.arq);
+    uplinkSave(retained.uplink);
+    dutyCycleSave(retained.dutyCycle);
+    retained.telemetrySampleTime = telemetrySampleTime;
+    retained.telemetryFlags = telemetryFlags;
+    retained.telemetrySampled = telemetrySampled;
+    retained.sleepAtMs = millis();
+    retained.sleepAtUs = rtcTimeUs();
+}
+
+// takes the state back after a deep sleep, false if the RTC memory does not hold it (power-on);
+// millis() started again from zero: the times of the state are moved onto the new clock
+bool restoreRetainedState(uint32_t *sleptMs) {
+    if (retained.magic != RETAINED_MAGIC) return false;
+    retained.magic = 0; // a reset during the wake-up starts from scratch
+    *sleptMs = (uint32_t)((rtcTimeUs() - retained.sleepAtUs) / 1000);
+    uint32_t shiftMs = millis() - (retained.sleepAtMs + *sleptMs);
+
+    CTRLMAILBOX_NAME = retained.name;
+    MAILTON_KEY = retained.mailTonKey;
+    mtAddress = retained.mtAddress;
+    frameAuthSetKey(frameKey, retained.frameKey);
+    frameAuthSetKey(beaconKey, retained.beaconKey);
+    uplinkCounter = retained.uplinkCounter;
+    savedUplinkCounter = retained.savedUplinkCounter;
+    downlinkCounter = retained.downlinkCounter;
+    downlinkCounterValid = retained.downlinkCounterValid;
+    txPower = retained.txPower;
+    adrCandidatePower = retained.adrCandidatePower;
+    adrConfirmations = retained.adrConfirmations;
+    distanceFilter = retained.distanceFilter;
+    distance = distanceFilter.estimate;
+    initial_distance = distanceFilter.baseline;
+    mailHistory = retained.mailHistory;
+    mailboxFsm = retained.mailboxFsm;
+    mailboxFsm.enteredAtMs += shiftMs;
+    mailboxFsm.openedAtMs += shiftMs;
+    mailboxFsm.eventStartMs += shiftMs;
+    arqRestore(retained.arq, shiftMs);
+    uplinkRestore(retained.uplink, shiftMs);
+    dutyCycleRestore(retained.dutyCycle, shiftMs);
+    telemetrySampleTime = retained.telemetrySampleTime + shiftMs;
+    telemetryFlags = retained.telemetryFlags;
+    telemetrySampled = retained.telemetrySampled;
+    return true;
+}
+
+WakeSource readWakeSource() {
+    switch (esp_sleep_get_wakeup_cause()) {
+    case ESP_SLEEP_WAKEUP_TIMER: return WAKE_TIMER;
+    case ESP_SLEEP_WAKEUP_EXT1: return WAKE_KNOB;
+    case ESP_SLEEP_WAKEUP_EXT0: return WAKE_BUTTON;
+    default: return WAKE_POWER_ON;
     }
-    return sum / readings;
+}
+
+void addPowerDeadline(PowerInputs &inputs, uint32_t dueMs) {
+    if (!inputs.hasDeadline || (long)(dueMs - inputs.deadlineMs) < 0) inputs.deadlineMs = dueMs;
+    inputs.hasDeadline = true;
+}
+
+// what keeps the node awake and the next timer of the firmware
+PowerInputs powerInputs() {
+    PowerInputs inputs = {};
+    inputs.busy = mailboxFsm.state != MAILBOX_IDLE || mailbox_open || wait_servo || wait_rotary ||
+                  cadPending || loraTxBusy(loraTx) || !packetQueueEmpty() || loraFlagReceived || rxWindows.state != CLASS_A_IDLE ||
+                  portalActive;
+    uint32_t dueMs;
+    if (arqNextDeadline(millis(), &dueMs)) addPowerDeadline(inputs, dueMs);
+    if (uplinkNextFlushMs(&dueMs)) addPowerDeadline(inputs, dueMs);
+    if (txDeferred) addPowerDeadline(inputs, txDeferredUntil);
+    if ((long)(millis() - lbtBackoffUntil) < 0) addPowerDeadline(inputs, lbtBackoffUntil);
+    addPowerDeadline(inputs, telemetrySampleTime + UPLINK_SAMPLE_PERIOD_MS);
+    return inputs;
+}
+
+// the state goes to the RTC memory and the node sleeps; it wakes up in setup()
+void enterDeepSleep(uint32_t sleepMs) {
+    saveRetainedState();
+    lora->sleep();
+    display->clearDisplay();
+    display->display();
+
+    esp_sleep_enable_timer_wakeup((uint64_t)sleepMs * 1000);
+    // the knob wakes the board when a channel leaves the level it rests at. The S3 has only ANY_LOW and
+    // ANY_HIGH: the channels resting high wake it when they go low; if both rest low, when one goes high.
+    // A channel resting low next to a high one is left out, the high one goes low within a step either way
+    gpio_num_t clk = (gpio_num_t)digitalPinToGPIONumber(ROTARY_CLK);
+    gpio_num_t dt = (gpio_num_t)digitalPinToGPIONumber(ROTARY_DT);
+    uint64_t restHigh = (digitalRead(ROTARY_CLK) == HIGH ? 1ULL << clk : 0) | (digitalRead(ROTARY_DT) == HIGH ? 1ULL << dt : 0);
+    esp_sleep_pd_config(ESP_PD_DOMAIN_RTC_PERIPH, ESP_PD_OPTION_ON);
+    for (gpio_num_t pin : {clk, dt}) {
+        rtc_gpio_pullup_en(pin);
+        rtc_gpio_pulldown_dis(pin);
+    }
+    if (restHigh != 0) {
+        esp_sleep_enable_ext1_wakeup(restHigh, ESP_EXT1_WAKEUP_ANY_LOW);
+    } else {
+        esp_sleep_enable_ext1_wakeup((1ULL << clk) | (1ULL << dt), ESP_EXT1_WAKEUP_ANY_HIGH);
+    }
+    if (WAKE_BUTTON_PIN >= 0) {
+        gpio_num_t button = (gpio_num_t)digitalPinToGPIONumber(WAKE_BUTTON_PIN);
+        rtc_gpio_pullup_en(button);
+        esp_sleep_enable_ext0_wakeup(button, 0);
+    }
+    Serial.flush();
+    esp_deep_sleep_start();
 }
 
 void setup() {
+    // after a deep sleep the state comes from the RTC memory (see power.h)
+    WakeSource wake = readWakeSource();
+    uint32_t sleptMs = 0;
+    resumed = DEEP_SLEEP_ENABLED && wake != WAKE_POWER_ON && restoreRetainedState(&sleptMs);
+
     IoTBoard::init_serial();
     IoTBoard::init_buttons();
     IoTBoard::init_leds();
@@ -395,36 +975,66 @@ void setup() {
     display->display();
 
     if (IoTBoard::init_lora()) {
+        // radio settings used by the time-on-air calculator
+        lora->setSpreadingFactor(LORA_SPREADING_FACTOR);
+        lora->setSignalBandwidth(LORA_BANDWIDTH);
+        lora->setCodingRate4(LORA_CODING_RATE);
+        lora->setPreambleLength(LORA_PREAMBLE_LENGTH);
+        lora->disableCrc();
+        lora->setTxPower(txPower);
         lora->onReceive(onLoRaReceive);
         lora->onTxDone(onLoRaSend);
-        lora->receive();
+        lora->onCadDone(onCadDone);
+        energyInit(millis());
+        loraTxInit(loraTx);
+        packetPoolInit();
+        radioIdle();
         display->println("LoRa enabled");
     } else {
         digitalWrite(LED_RED, HIGH);
         display->printf("LoRa Error");
     }
     display->display();
-    loadDeviceCredentials();
+    bool provisioned = resumed;
+    if (!resumed) {
+        provisioned = loadDeviceCredentials();
+        loadFrameCounter();
+        arqInit(esp_random());
+        uplinkInit();
+    }
+    // backoff slot of the LBT: the time on air of an uplink of average length
+    lbtInit(lbt, esp_random(), loraTimeOnAirMs(LORA_HEADER_LENGTH + 48));
 
-    configureWiFi();
+    // the WiFi stays off unless the device must be configured (or a long press of button 1 asks for it)
+    if (!provisioned) startConfigPortal();
 
     buttons->onBtn1Release(onBtn1Released);
     buttons->onBtn2Release(onBtn2Released);
 
-    pinMode(ROTARY_CLK, INPUT_PULLUP);
-    pinMode(ROTARY_DT, INPUT_PULLUP);
-    attachInterrupt(digitalPinToInterrupt(ROTARY_CLK), rotaryChanged, CHANGE);
-    pinMode(SERVO_PIN, OUTPUT);
+    encoderBegin(ROTARY_CLK, ROTARY_DT);
+    servoBegin(SERVO_PIN, SERVO_SLEW_DEG_PER_S);
 
-    pinMode(TRIG, OUTPUT);
-    pinMode(ECHO, INPUT);
-    initial_distance = measuresAverageDistance();
-    delay(500);
+    if (!ultrasonicBegin(TRIG, ECHO)) display->println("Ultrasonic sensor error");
+    if (resumed) {
+        // the node sleeps only with the mailbox closed and the servo settled
+        servoAssumePosition(SERVO_CLOSED_ANGLE);
+        powerOnWake(retained.power, wake, sleptMs, millis());
+    } else {
+        distanceFilterInit(distanceFilter, theshold);
+        // first baseline: wait for the warm-up of the filter
+        unsigned long rangingStart = millis();
+        while (!updateDistance(true) && millis() - rangingStart < 3 * DISTANCE_WARMUP_SAMPLES * ULTRASONIC_PERIOD_MS) delay(10);
+        mailboxFsmInit(mailboxFsm, millis());
+        powerInit(retained.power, millis());
+    }
+    retained.power.lastResumeMs = millis();
 }
 
 void loop() {
     buttons->update();
-    dnsServer.processNextRequest();
+    updateRotary();
+    updateConfigPortal();
+    updateDisplayPage();
     
     delay(1);
     
@@ -434,119 +1044,140 @@ void loop() {
     }
     
 
-    if (!lora_priority && !wait_rotary && !wait_servo && !mailbox_open) {
-        // update the initial distance periodically
-        distance = measuresAverageDistance();
-        readings_made++;       
-        if (readings_made >= distance_update) {
-            initial_distance = measuresAverageDistance();
-            readings_made = 0;
-        }
-    } 
-    
-    if (!lora_priority && !mailbox_open && !wait_servo && !wait_rotary && !mail_detected && abs(distance - initial_distance) > theshold){        
+    // the filter follows the distance and the baseline (initial distance) at every measure,
+    // the state machine turns the sensors into events without waiting
+    bool distanceReady = updateDistance(!wait_rotary && !wait_servo && !mailbox_open);
+    MailClass mailClass = MAIL_CLASS_TRANSIENT;
+    if (mailboxFsm.state == MAILBOX_SAMPLING) {
+        float features[MAIL_FEATURE_COUNT];
+        mailFeatures(mailHistory, distanceFilter.baseline, features);
+        mailClass = mailClassify(features);
+    }
+    MailboxInputs inputs = {distanceReady, abs(distance - initial_distance) > theshold, mailbox_open,
+                            servo_open && !wait_servo, mailClass, fsmEventStatus()};
+    MailboxActions actions = mailboxFsmStep(mailboxFsm, inputs, millis());
+    mail_detected = mailboxFsm.letterPresent;
+    if (actions.rebaseline) {
+        // the empty mailbox changed (temperature, sensor moved): no need to wait for the slow baseline
+        distanceFilter.baseline = distanceFilter.estimate;
+        initial_distance = distanceFilter.baseline;
+    }
+    if (actions.event != nullptr) {
+        fsmEventRefused = !queueMessageLoRa(actions.event, actions.urgent);
+        fsmEventNumber = fsmEventRefused ? 0 : uplinkStats().queued;
+        fsmEventInArq = false;
+    }
+    if (mailboxFsm.state == MAILBOX_DETECTED) {
         display->clearDisplay();
         display->setCursor(0,0);
         display->println("Letter detected");
         display->display();
-        lora_msg = "New Mail";
-        noInterrupts();
-        sendMessageLoRa();
-        interrupts();
-        mail_detected = true;
-        delay(1000);
-    } else if (mail_detected && abs(distance - initial_distance) <= theshold) {
-        mail_detected = false; // reset when the letter is removed
-    }  
-
-    static bool message_sent = false;
-    
-    if (!lora_priority && mailbox_open && servo_open && !wait_rotary && !wait_servo && !mail_detected && !message_sent) {
-        // send the message only if the mailbox is open and the mail is taken (or the distance is the initial one)
-        lora_msg = "Mailbox Opened";
-        noInterrupts();
-        sendMessageLoRa();
-        interrupts();
-        delay(100);
-        message_sent = true;
-    }else if (mail_detected && abs(distance - initial_distance) <= theshold) {
-        mail_detected = false; // reset when the letter is removed
-    }
-    if(!mailbox_open)
-        message_sent = false; // reset when the mailbox is closed
-
-
-    // if the waiting time (waitTime=15s) has expired, retransmitte message, 
-    if (waitingForResponse && (millis() - lastSendTime > waitTime)) {
-        sendMessageLoRa();
-    }
-
-    // timer to automatically close the mailbox if left open for too long
-    static unsigned long mailboxOpenTime = 0;
-    const unsigned long maxOpenDuration = 60000; // 60 seconds
-
-    if (mailbox_open) {
-        if (mailboxOpenTime == 0) {
-            mailboxOpenTime = millis(); // Start the timer when the mailbox is opened
-        } else if (millis() - mailboxOpenTime > maxOpenDuration) {
-            mailbox_open = false; // Close the mailbox
-            writeServo(90); // Move servo to close position
-            mailboxOpenTime = 0; // Reset the timer
-            display->println("Mailbox auto-closed due to timeout.");
-            display->display();
+    }
+    if (actions.close) {
+        mailbox_open = false; // Close the mailbox, the servo follows below
+        display->println("Mailbox auto-closed due to timeout.");
+        display->display();
+    }
+
+    sampleTelemetry();
+    flushUplink();
+
+    // ARQ: send the expired retransmissions and the new messages that fit in the window,
+    // with LBT the channel is sensed first and the message is sent when the CAD finds it clear
+    if (!cadPending && !loraTxBusy(loraTx) && (!txDeferred || (long)(millis() - txDeferredUntil) >= 0) && (long)(millis() - lbtBackoffUntil) >= 0) {
+        ArqMessage *message = nextScheduledMessage();
+        if (message != nullptr) {
+            if (LBT_ENABLED) {
+                cadDone = false;
+                cadPending = true;
+                cadStartTime = millis();
+                lbtOnCadStart(lbt);
+                lora->channelActivityDetection();
+                energyRadio(RADIO_CAD, millis());
+            } else {
+                sendMessageLoRa(message);
+            }
+        }
+    }
+
+    if (cadPending && (cadDone || millis() - cadStartTime > LBT_CAD_TIMEOUT_MS)) {
+        cadPending = false;
+        uint32_t backoff = 0;
+        if (cadDone && cadBusy) backoff = lbtOnBusy(lbt);
+        if (backoff > 0) {
+            lbtBackoffUntil = millis() + backoff;
+            radioIdle();
+        } else {
+            // channel clear (or busy too many times): the message is taken again, an ACK may have arrived
+            lbtOnClear(lbt);
+            ArqMessage *message = nextScheduledMessage();
+            if (message != nullptr) sendMessageLoRa(message);
+            else radioIdle();
+        }
+    }
+
+    // end of the uplink: back to receive, in class A the radio sleeps until the first receive window
+    uint32_t txDoneTime;
+    if (loraTxPoll(loraTx, millis(), &txDoneTime)) {
+        digitalWrite(LED_GREEN, LOW);
+        lora_priority = false;
+        if (CLASS_A_ENABLED) classAStart(rxWindows, txDoneTime);
+        radioIdle();
+    }
+    if (CLASS_A_ENABLED) {
+        ClassAAction action = classAUpdate(rxWindows, millis());
+        if (action == CLASS_A_OPEN || action == CLASS_A_CLOSE) radioIdle();
+    }
+
+    // a LoRa packet received by the callback, never parsed while a frame is on air
+    if (!loraTxBusy(loraTx)) {
+        PacketBuffer *packet = packetQueuePop();
+        if (packet != nullptr) {
+            handleLoRaPacket(*packet);
+            packetRelease(packet);
         }
-    } else {
-        mailboxOpenTime = 0; // Reset the timer if the mailbox is closed
     }
 
-    // if receives an answer, check if he is an ACK, otherwise postpone
+    // if receives an answer, acknowledge the messages of the ARQ, otherwise retry them after the backoff
     if(loraFlagReceived){
-        lora_msg = last_lora_msg;
-        
         if (isAckMessage(last_message_received)) {
-            waitingForResponse = false; // reset of the waiting flag
-        } else {
-            delay(10);
-            noInterrupts();
-            sendMessageLoRa();
-            interrupts();
-            delay(100);
+            if (ackSeq >= 0) arqOnAck(ackSeq, ackCumulative, millis());
+            handleAdrRecommendation(adrRecommendedPower);
+        } else if (ackSeq >= 0) {
+            arqOnNack(ackSeq, millis());
         }
         
         loraFlagReceived = false;       
+        if (CLASS_A_ENABLED) {
+            classAOnReply(rxWindows);
+            radioIdle();
+        }
         display->display();
-        delay(1000);
     }
     
-    /*if (rotationCount >= CLOSE_THRESHOLD-5) {
-        writeServo(90);
-        mailbox_open = false;
-    } 
-    else if (rotationCount <= OPEN_THRESHOLD+5) {
-        writeServo(-30);
-        mailbox_open = true;
-    }*/
-    
-    //delay(1000);
-    
-    if (!mailbox_open){
-        writeServo(90);
-        delay(10);
-    }else {
-        writeServo(-30); 
-        delay(10);
+    // the servo gets a new target only when the state changes, once settled its PWM is detached
+    writeServo(mailbox_open ? SERVO_OPEN_ANGLE : SERVO_CLOSED_ANGLE);
+    wait_servo = servoUpdate(millis());
+
+
+    // the status screen is redrawn a few times per second, not at every loop
+    if (millis() - displayRefreshTime >= DISPLAY_REFRESH_MS) {
+        displayRefreshTime = millis();
+        drawStatusPage();
     }
 
+    // deep sleep until the next ranging burst or timer of the firmware
+    uint32_t sleepMs;
+    if (DEEP_SLEEP_ENABLED && CLASS_A_ENABLED && powerSleepDue(retained.power, powerInputs(), millis(), &sleepMs)) {
+        enterDeepSleep(sleepMs);
+    }
 
-    display->clearDisplay();
-    display->setCursor(0,0);
-    display->printf("Distance: %.2f cm\n", distance);
-    display->println(mailbox_open ? "MAILBOX OPEN =^.^= " : "MAILBOX CLOSE");
-    display->printf("CMB addr: %04X\n", localAddress);
-    display->println("CMB Name: " + CTRLMAILBOX_NAME);
-    display->println("CMB KEY: " + CTRLMAILBOX_KEY);
-    display->printf("MT addr:  %04X\n",  mtAddress);
-    display->println("MT KEY: " + MAILTON_KEY );
-    display->display();
-    delay(1);
+    // class A: nothing to do until the next window or event, the MCU waits
+    if (CLASS_A_ENABLED && !classAWindowOpen(rxWindows) && !cadPending && !loraTxBusy(loraTx)) {
+        energyMcu(false, millis());
+        delay(CLASS_A_IDLE_MS);
+        energyMcu(true, millis());
+    } else {
+        delay(1);
+    }
 }
\ No newline at end of file
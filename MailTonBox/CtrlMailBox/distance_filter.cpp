@@ -0,0 +1,64 @@
+/**
+ * @file distance_filter.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Streaming filter of the ultrasonic measures (see distance_filter.h).
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <math.h>
+#include <string.h>
+#include "distance_filter.h"
+
+// median of the window: insertion sort of a copy, DISTANCE_MEDIAN_WINDOW is a small constant
+static int16_t windowMedian(const DistanceFilter &filter) {
+    int16_t sorted[DISTANCE_MEDIAN_WINDOW];
+    for (uint8_t i = 0; i < filter.count; i++) {
+        int16_t value = filter.window[i];
+        int8_t j = i - 1;
+        while (j >= 0 && sorted[j] > value) {
+            sorted[j + 1] = sorted[j];
+            j--;
+        }
+        sorted[j + 1] = value;
+    }
+    return sorted[filter.count / 2];
+}
+
+void distanceFilterInit(DistanceFilter &filter, float eventThreshold) {
+    memset(&filter, 0, sizeof(filter));
+    filter.eventThreshold = eventThreshold;
+}
+
+float distanceFilterUpdate(DistanceFilter &filter, int16_t cm, bool event) {
+    filter.window[filter.next] = cm;
+    filter.next = (filter.next + 1) % DISTANCE_MEDIAN_WINDOW;
+    if (filter.count < DISTANCE_MEDIAN_WINDOW) filter.count++;
+    float measure = windowMedian(filter);
+
+    if (filter.samples == 0) {
+        filter.estimate = measure;
+        filter.variance = DISTANCE_MEASURE_NOISE;
+    } else {
+        filter.variance += DISTANCE_PROCESS_NOISE;
+        float gain = filter.variance / (filter.variance + DISTANCE_MEASURE_NOISE);
+        filter.estimate += gain * (measure - filter.estimate);
+        filter.variance *= 1.0f - gain;
+    }
+    filter.samples++;
+
+    if (filter.samples == DISTANCE_WARMUP_SAMPLES) {
+        filter.baseline = filter.estimate;
+    } else if (filter.samples > DISTANCE_WARMUP_SAMPLES) {
+        filter.baselineFrozen = event || fabsf(filter.estimate - filter.baseline) > filter.eventThreshold;
+        if (!filter.baselineFrozen) filter.baseline += DISTANCE_BASELINE_ALPHA * (filter.estimate - filter.baseline);
+    }
+    return filter.estimate;
+}
+
+bool distanceFilterReady(const DistanceFilter &filter) {
+    return filter.samples >= DISTANCE_WARMUP_SAMPLES;
+}
@@ -0,0 +1,51 @@
+/**
+ * @file distance_filter.h
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Streaming filter of the ultrasonic measures and baseline of the empty mailbox.
+ *
+ * Every measure goes through a sliding median of DISTANCE_MEDIAN_WINDOW values,
+ * which rejects the isolated outliers (lost echoes, reflections), and then
+ * through a 1-D Kalman filter with a constant-position model. The baseline is
+ * the distance of the empty mailbox: it follows the estimate with a slow EWMA,
+ * to absorb the drift of the sensor (temperature), and it is frozen while the
+ * estimate is away from it by more than the event threshold or while the
+ * caller reports an event (mailbox open, letter detected), so a letter never
+ * becomes part of the baseline. Every step costs O(1) per measure.
+ * No Arduino dependency: the filter also builds on the host.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef DISTANCE_FILTER_H
+#define DISTANCE_FILTER_H
+
+#include <stdint.h>
+
+#define DISTANCE_MEDIAN_WINDOW 5
+#define DISTANCE_PROCESS_NOISE 0.05f        // cm^2 per measure, how fast the real distance can move
+#define DISTANCE_MEASURE_NOISE 1.0f         // cm^2, noise of the HC-SR04 after the median
+#define DISTANCE_BASELINE_ALPHA 0.0005f     // about 2000 measures (2 minutes at 60 ms) of time constant
+#define DISTANCE_WARMUP_SAMPLES 16          // measures before the first baseline
+
+struct DistanceFilter {
+    int16_t window[DISTANCE_MEDIAN_WINDOW];  // last measures, in arrival order
+    uint8_t next;
+    uint8_t count;
+    float estimate;       // cm
+    float variance;       // cm^2, of the estimate
+    float baseline;       // cm
+    float eventThreshold; // cm, deviation that freezes the baseline
+    uint32_t samples;
+    bool baselineFrozen;
+};
+
+void distanceFilterInit(DistanceFilter &filter, float eventThreshold);
+// adds a measure and returns the filtered distance; `event` freezes the baseline
+float distanceFilterUpdate(DistanceFilter &filter, int16_t cm, bool event);
+// true once the estimate and the baseline are valid
+bool distanceFilterReady(const DistanceFilter &filter);
+
+#endif
@@ -0,0 +1,70 @@
+/**
+ * @file encoder.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Quadrature decoder of the rotary encoder of CtrlMailBox (see encoder.h).
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <Arduino.h>
+#include "encoder.h"
+
+// index: previous state (CLK, DT) << 2 | current state (CLK, DT)
+static const int8_t TRANSITIONS[16] = {
+     0, -1,  1,  0,
+     1,  0,  0, -1,
+    -1,  0,  0,  1,
+     0,  1, -1,  0
+};
+// transitions where both channels changed: 00<->11 and 01<->10
+static const uint16_t INVALID_TRANSITIONS = (1 << 0x3) | (1 << 0x6) | (1 << 0x9) | (1 << 0xC);
+
+static uint8_t clk;
+static uint8_t dt;
+static volatile uint8_t state = 0;
+static volatile int32_t steps = 0;       // quadrature steps, written only by the ISR
+static volatile uint32_t lastMoveMs = 0;
+static EncoderStats stats = {};
+
+static void IRAM_ATTR onEncoderEdge() {
+    uint8_t current = (digitalRead(clk) << 1) | digitalRead(dt);
+    uint8_t index = (state << 2) | current;
+    state = current;
+    int8_t step = TRANSITIONS[index];
+    if (step != 0) {
+        steps = steps + step;
+        lastMoveMs = millis();
+        stats.transitions++;
+    } else if (INVALID_TRANSITIONS & (1 << index)) {
+        stats.invalid++;
+    }
+}
+
+bool encoderBegin(uint8_t clkPin, uint8_t dtPin) {
+    clk = clkPin;
+    dt = dtPin;
+    pinMode(clk, INPUT_PULLUP);
+    pinMode(dt, INPUT_PULLUP);
+    state = (digitalRead(clk) << 1) | digitalRead(dt);
+    attachInterrupt(digitalPinToInterrupt(clk), onEncoderEdge, CHANGE);
+    attachInterrupt(digitalPinToInterrupt(dt), onEncoderEdge, CHANGE);
+    return true;
+}
+
+int32_t encoderPosition() {
+    int32_t position = steps;  // aligned 32-bit read, atomic
+    // rounded down, a detent is the same size on both sides of zero
+    if (position < 0) position -= ENCODER_STEPS_PER_DETENT - 1;
+    return position / ENCODER_STEPS_PER_DETENT;
+}
+
+uint32_t encoderLastMoveMs() {
+    return lastMoveMs;
+}
+
+const EncoderStats &encoderStats() {
+    return stats;
+}
@@ -0,0 +1,39 @@
+/**
+ * @file encoder.h
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Quadrature decoder of the rotary encoder of CtrlMailBox.
+ *
+ * Both channels interrupt on every edge; the ISR reads the two pins and
+ * looks up the transition from the previous state in a 16-entry table:
+ * +1 or -1 for a valid step, 0 for no movement or for an invalid transition
+ * (both channels changed, i.e. a glitch or a missed edge), which is counted
+ * and ignored. A contact bounce gives +1 and -1 and cancels out. The ISR
+ * runs in constant time and is the only writer of the position, a 32-bit
+ * word that loop() reads atomically.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef ENCODER_H
+#define ENCODER_H
+
+#include <stdint.h>
+
+#define ENCODER_STEPS_PER_DETENT 4   // quadrature transitions between two clicks
+
+struct EncoderStats {
+    uint32_t transitions;   // valid steps
+    uint32_t invalid;       // transitions with both channels changed
+};
+
+bool encoderBegin(uint8_t clkPin, uint8_t dtPin);
+// position in detents from the start, it grows in the direction that opens the mailbox
+int32_t encoderPosition();
+// millis() of the last valid step
+uint32_t encoderLastMoveMs();
+const EncoderStats &encoderStats();
+
+#endif
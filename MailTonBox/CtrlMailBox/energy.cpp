@@ -0,0 +1,79 @@
+/**
+ * @file energy.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Energy accounting of CtrlMailBox (see energy.h).
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include "energy.h"
+
+static const float RADIO_MA[RADIO_STATE_COUNT] = {
+    ENERGY_RADIO_SLEEP_MA,
+    ENERGY_RADIO_STANDBY_MA,
+    ENERGY_RADIO_RX_MA,
+    ENERGY_RADIO_CAD_MA,
+    ENERGY_RADIO_TX_MA
+};
+
+static EnergyReport report = {};
+static RadioState radioState = RADIO_STANDBY;
+static bool mcuActive = true;
+static uint32_t radioSince = 0;
+static uint32_t mcuSince = 0;
+
+static float toMah(float mA, uint32_t ms) {
+    return mA * ms / 3600000.0f;
+}
+
+static void closeRadio(uint32_t nowMs) {
+    uint32_t elapsed = nowMs - radioSince;
+    report.radioMs[radioState] += elapsed;
+    report.radioMah += toMah(RADIO_MA[radioState], elapsed);
+    // always-on receive: only TX and CAD differ from RX
+    bool ownCurrent = radioState == RADIO_TX || radioState == RADIO_CAD;
+    report.alwaysOnMah += toMah(ownCurrent ? RADIO_MA[radioState] : ENERGY_RADIO_RX_MA, elapsed);
+    radioSince = nowMs;
+}
+
+static void closeMcu(uint32_t nowMs) {
+    uint32_t elapsed = nowMs - mcuSince;
+    if (mcuActive) {
+        report.mcuActiveMs += elapsed;
+        report.mcuMah += toMah(ENERGY_MCU_ACTIVE_MA, elapsed);
+    } else {
+        report.mcuIdleMs += elapsed;
+        report.mcuMah += toMah(ENERGY_MCU_IDLE_MA, elapsed);
+    }
+    report.alwaysOnMah += toMah(ENERGY_MCU_ACTIVE_MA, elapsed);
+    mcuSince = nowMs;
+}
+
+void energyInit(uint32_t nowMs) {
+    report = {};
+    radioState = RADIO_STANDBY;
+    mcuActive = true;
+    radioSince = nowMs;
+    mcuSince = nowMs;
+}
+
+void energyRadio(RadioState state, uint32_t nowMs) {
+    if (state == radioState) return;
+    closeRadio(nowMs);
+    radioState = state;
+}
+
+void energyMcu(bool active, uint32_t nowMs) {
+    if (active == mcuActive) return;
+    closeMcu(nowMs);
+    mcuActive = active;
+}
+
+const EnergyReport &energyReport(uint32_t nowMs) {
+    closeRadio(nowMs);
+    closeMcu(nowMs);
+    return report;
+}
@@ -0,0 +1,57 @@
+/**
+ * @file energy.h
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Energy accounting of CtrlMailBox, to size a battery.
+ *
+ * The firmware reports every change of state of the radio and of the MCU;
+ * the time spent in each state is multiplied by the typical current of the
+ * datasheets (SX1276, ESP32-S3). Alongside it keeps the consumption the same
+ * timeline would have had with the radio always in receive and the MCU always
+ * active, as before the class A mode, to compare the two.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef ENERGY_H
+#define ENERGY_H
+
+#include <stdint.h>
+
+enum RadioState : uint8_t {
+    RADIO_SLEEP = 0,
+    RADIO_STANDBY,
+    RADIO_RX,
+    RADIO_CAD,
+    RADIO_TX,
+    RADIO_STATE_COUNT
+};
+
+// typical currents in mA
+#define ENERGY_RADIO_SLEEP_MA 0.0002f
+#define ENERGY_RADIO_STANDBY_MA 1.6f
+#define ENERGY_RADIO_RX_MA 10.8f
+#define ENERGY_RADIO_CAD_MA 10.8f
+#define ENERGY_RADIO_TX_MA 44.0f        // +14 dBm on PA_BOOST, the TX power changes it little
+#define ENERGY_MCU_ACTIVE_MA 40.0f      // 240 MHz, radio modem of the ESP32 off
+#define ENERGY_MCU_IDLE_MA 20.0f        // waiting in delay(), clock gated
+
+struct EnergyReport {
+    uint32_t radioMs[RADIO_STATE_COUNT];
+    uint32_t mcuActiveMs;
+    uint32_t mcuIdleMs;
+    float radioMah;
+    float mcuMah;
+    float alwaysOnMah;      // radio always receiving (except TX and CAD) and MCU always active
+};
+
+void energyInit(uint32_t nowMs);
+void energyRadio(RadioState state, uint32_t nowMs);
+// the MCU waits (idle) or works (active) from nowMs on
+void energyMcu(bool active, uint32_t nowMs);
+// report up to nowMs
+const EnergyReport &energyReport(uint32_t nowMs);
+
+#endif
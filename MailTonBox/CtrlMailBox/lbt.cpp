@@ -0,0 +1,39 @@
+#include "lbt.h"
+
+// xorshift32, only used for the backoff
+static uint32_t nextRandom(Lbt &lbt) {
+    lbt.randomState ^= lbt.randomState << 13;
+    lbt.randomState ^= lbt.randomState >> 17;
+    lbt.randomState ^= lbt.randomState << 5;
+    return lbt.randomState;
+}
+
+void lbtInit(Lbt &lbt, uint32_t seed, uint32_t slotMs) {
+    lbt = {};
+    lbt.randomState = seed ? seed : 1;
+    lbt.slotMs = slotMs ? slotMs : 1;
+}
+
+void lbtOnCadStart(Lbt &lbt) {
+    lbt.stats.cadRuns++;
+}
+
+uint32_t lbtOnBusy(Lbt &lbt) {
+    lbt.stats.cadHits++;
+    if (++lbt.attempts >= LBT_MAX_ATTEMPTS) {
+        lbt.stats.forced++;
+        lbt.attempts = 0;
+        return 0;
+    }
+
+    // random number of slots in [1, 2^attempts]
+    uint8_t exponent = lbt.attempts < LBT_MAX_EXPONENT ? lbt.attempts : LBT_MAX_EXPONENT;
+    uint32_t backoff = (1 + nextRandom(lbt) % (1UL << exponent)) * lbt.slotMs;
+    lbt.stats.backoffMs += backoff;
+    if (backoff > lbt.stats.maxBackoffMs) lbt.stats.maxBackoffMs = backoff;
+    return backoff;
+}
+
+void lbtOnClear(Lbt &lbt) {
+    lbt.attempts = 0;
+}
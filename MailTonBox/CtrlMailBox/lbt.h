@@ -0,0 +1,53 @@
+/**
+ * @file lbt.h
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Listen-before-talk of CtrlMailBox based on the LoRa Channel Activity Detection.
+ *
+ * Before a frame the radio runs a CAD: if a preamble is detected the channel
+ * is busy and the frame waits a random number of slots (binary exponential
+ * backoff), so the mailboxes that detect the same event do not transmit at
+ * the same time. After LBT_MAX_ATTEMPTS busy channels the frame is sent anyway
+ * and the ARQ recovers it if it collides.
+ * The state is one Lbt per radio, so the host test (test/test_lbt.cpp) can
+ * put many mailboxes on a simulated channel.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef LBT_H
+#define LBT_H
+
+#include <stdint.h>
+
+#define LBT_MAX_ATTEMPTS 6      // busy channels before transmitting anyway
+#define LBT_MAX_EXPONENT 5      // the backoff window grows up to 32 slots
+#define LBT_CAD_TIMEOUT_MS 50   // a CAD lasts a couple of symbols, after this it is considered lost
+
+struct LbtStats {
+    uint32_t cadRuns;
+    uint32_t cadHits;       // channel found busy
+    uint32_t forced;        // frames sent after LBT_MAX_ATTEMPTS busy channels
+    uint32_t backoffMs;     // total time waited for the channel
+    uint32_t maxBackoffMs;
+};
+
+struct Lbt {
+    LbtStats stats;
+    uint32_t randomState;
+    uint32_t slotMs;
+    uint8_t attempts;       // busy channels seen by the current frame
+};
+
+// slotMs: backoff slot, about the time on air of a frame
+void lbtInit(Lbt &lbt, uint32_t seed, uint32_t slotMs);
+// to be called when a CAD starts
+void lbtOnCadStart(Lbt &lbt);
+// channel busy: returns the backoff before the next CAD, 0 if the frame must be sent anyway
+uint32_t lbtOnBusy(Lbt &lbt);
+// channel clear (or frame sent anyway): the next frame starts from the smallest window
+void lbtOnClear(Lbt &lbt);
+
+#endif
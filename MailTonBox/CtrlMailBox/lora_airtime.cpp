@@ -0,0 +1,163 @@
+/**
+ * @file lora_airtime.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief LoRa time-on-air calculator and EU868 duty-cycle scheduler (see lora_airtime.h).
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <string.h>
+#include "lora_airtime.h"
+
+const LoRaAirtimeConfig LORA_AIRTIME_CONFIG = {
+    LORA_SPREADING_FACTOR,
+    LORA_BANDWIDTH,
+    LORA_CODING_RATE,
+    LORA_PREAMBLE_LENGTH,
+    LORA_CRC,
+    false
+};
+
+uint32_t loraTimeOnAirUs(const LoRaAirtimeConfig &config, uint8_t payloadLength) {
+    const int sf = config.spreadingFactor;
+    // low data rate optimization, mandatory when a symbol lasts more than 16 ms
+    const int de = ((1UL << sf) * 1000UL / config.bandwidth) >= 16 ? 1 : 0;
+    const int ih = config.implicitHeader ? 1 : 0;
+    const int crc = config.crc ? 1 : 0;
+
+    // payload symbols: 8 + max(ceil((8PL - 4SF + 28 + 16CRC - 20IH) / 4(SF - 2DE)) * CR, 0)
+    int numerator = 8 * payloadLength - 4 * sf + 28 + 16 * crc - 20 * ih;
+    int denominator = 4 * (sf - 2 * de);
+    int blocks = numerator > 0 ? (numerator + denominator - 1) / denominator : 0;
+    uint32_t payloadSymbols = 8 + blocks * config.codingRate;
+
+    // the preamble lasts (Npreamble + 4.25) symbols, counted in quarters of symbol
+    uint32_t quarterSymbols = (config.preambleLength * 4 + 17) + payloadSymbols * 4;
+    uint64_t symbolTimeNs = (uint64_t)(1UL << sf) * 1000000000ULL / config.bandwidth; // ns per symbol
+    return (uint32_t)((quarterSymbols * symbolTimeNs / 4 + 999) / 1000);
+}
+
+uint32_t loraTimeOnAirMs(uint8_t payloadLength) {
+    return (loraTimeOnAirUs(LORA_AIRTIME_CONFIG, payloadLength) + 999) / 1000;
+}
+
+// ETSI EN 300 220 sub-bands used by EU868
+struct DutyCycleBand {
+    uint32_t minFrequency;
+    uint32_t maxFrequency;
+    uint16_t dutyPermyriad;             // 100 = 1%
+    uint32_t lastSlot;                  // last slot index (time / slot length) seen
+    uint16_t usedMs[DUTY_CYCLE_SLOTS];  // airtime spent in each slot of the window
+};
+
+static DutyCycleBand bands[DUTY_CYCLE_BANDS] = {
+    {863000000UL, 865000000UL, 10, 0, {}},    // 0.1%
+    {865000000UL, 868000000UL, 100, 0, {}},   // 1%
+    {868000000UL, 868600000UL, 100, 0, {}},   // g1, 1%
+    {868700000UL, 869200000UL, 10, 0, {}},    // g2, 0.1%
+    {869400000UL, 869650000UL, 1000, 0, {}},  // g3, 10%
+    {869700000UL, 870000000UL, 100, 0, {}}    // g4, 1%
+};
+
+static DutyCycleStats stats = {};
+static uint32_t clockOffsetMs = 0;  // keeps the time of the slots going across a deep sleep
+
+static DutyCycleBand *findBand(uint32_t frequency) {
+    for (DutyCycleBand &band : bands) {
+        if (frequency >= band.minFrequency && frequency < band.maxFrequency) return &band;
+    }
+    return nullptr;
+}
+
+static uint32_t budgetMs(const DutyCycleBand &band) {
+    return DUTY_CYCLE_WINDOW_MS / 10000 * band.dutyPermyriad;
+}
+
+// clears the slots that left the window since the last call
+static void advance(DutyCycleBand &band, uint32_t nowMs) {
+    uint32_t slot = (nowMs + clockOffsetMs) / DUTY_CYCLE_SLOT_MS;
+    uint32_t elapsed = slot - band.lastSlot;
+    if (elapsed >= DUTY_CYCLE_SLOTS) elapsed = DUTY_CYCLE_SLOTS; // also covers the millis() overflow
+    for (uint32_t i = 1; i <= elapsed; i++) {
+        band.usedMs[(band.lastSlot + i) % DUTY_CYCLE_SLOTS] = 0;
+    }
+    band.lastSlot = slot;
+}
+
+static uint32_t usedMs(const DutyCycleBand &band) {
+    uint32_t used = 0;
+    for (int i = 0; i < DUTY_CYCLE_SLOTS; i++) used += band.usedMs[i];
+    return used;
+}
+
+bool dutyCycleTryTransmit(uint32_t frequency, uint32_t airtimeMs, uint32_t nowMs, uint32_t *waitMs) {
+    DutyCycleBand *band = findBand(frequency);
+    *waitMs = 0;
+    if (band == nullptr) return true; // no duty cycle outside the EU868 sub-bands
+
+    advance(*band, nowMs);
+    uint32_t used = usedMs(*band);
+    uint32_t budget = budgetMs(*band);
+
+    if (used + airtimeMs > budget) {
+        // wait for the oldest slots to leave the window until the packet fits
+        uint32_t needed = used + airtimeMs - budget;
+        uint32_t freed = 0;
+        uint32_t wait = DUTY_CYCLE_WINDOW_MS;
+        for (uint32_t i = 1; i <= DUTY_CYCLE_SLOTS; i++) {
+            uint32_t slot = band->lastSlot + i; // oldest slot first
+            freed += band->usedMs[slot % DUTY_CYCLE_SLOTS];
+            if (freed >= needed) {
+                wait = slot * DUTY_CYCLE_SLOT_MS - (nowMs + clockOffsetMs);
+                break;
+            }
+        }
+        *waitMs = wait;
+        stats.deferrals++;
+        stats.deferredMs += wait;
+        if (wait > stats.maxDeferralMs) stats.maxDeferralMs = wait;
+        return false;
+    }
+
+    uint16_t &slotUsed = band->usedMs[band->lastSlot % DUTY_CYCLE_SLOTS];
+    slotUsed = (slotUsed + airtimeMs > 0xFFFF) ? 0xFFFF : slotUsed + airtimeMs;
+    stats.transmissions++;
+    stats.airtimeMs += airtimeMs;
+    return true;
+}
+
+uint32_t dutyCycleRemainingMs(uint32_t frequency, uint32_t nowMs) {
+    DutyCycleBand *band = findBand(frequency);
+    if (band == nullptr) return DUTY_CYCLE_WINDOW_MS;
+
+    advance(*band, nowMs);
+    uint32_t used = usedMs(*band);
+    uint32_t budget = budgetMs(*band);
+    return used < budget ? budget - used : 0;
+}
+
+const DutyCycleStats &dutyCycleStats() {
+    return stats;
+}
+
+void dutyCycleSave(DutyCycleSnapshot &snapshot) {
+    for (int i = 0; i < DUTY_CYCLE_BANDS; i++) {
+        snapshot.lastSlot[i] = bands[i].lastSlot;
+        memcpy(snapshot.usedMs[i], bands[i].usedMs, sizeof(bands[i].usedMs));
+    }
+    snapshot.clockOffsetMs = clockOffsetMs;
+    snapshot.stats = stats;
+}
+
+void dutyCycleRestore(const DutyCycleSnapshot &snapshot, uint32_t shiftMs) {
+    // the slots keep their numbers, the new clock gets an offset
+    clockOffsetMs = snapshot.clockOffsetMs - shiftMs;
+    for (int i = 0; i < DUTY_CYCLE_BANDS; i++) {
+        bands[i].lastSlot = snapshot.lastSlot[i];
+        memcpy(bands[i].usedMs, snapshot.usedMs[i], sizeof(bands[i].usedMs));
+    }
+    stats = snapshot.stats;
+}
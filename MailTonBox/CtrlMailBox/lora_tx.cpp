@@ -0,0 +1,59 @@
+/**
+ * @file lora_tx.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Non-blocking LoRa transmission, completed by the TxDone interrupt (see lora_tx.h).
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include "lora_tx.h"
+
+void loraTxInit(LoraTx &tx) {
+    tx.state = LORA_TX_IDLE;
+    tx.doneAt = 0;
+    tx.startedAt = 0;
+    tx.airtimeMs = 0;
+    tx.stats = {};
+}
+
+void loraTxStart(LoraTx &tx, uint32_t airtimeMs, uint32_t nowMs) {
+    tx.startedAt = nowMs;
+    tx.airtimeMs = airtimeMs;
+    tx.state = LORA_TX_ON_AIR;
+}
+
+void loraTxOnDone(LoraTx &tx, uint32_t nowMs) {
+    if (tx.state != LORA_TX_ON_AIR) return;
+    tx.doneAt = nowMs;
+    tx.state = LORA_TX_DONE;
+}
+
+bool loraTxPoll(LoraTx &tx, uint32_t nowMs, uint32_t *doneMs) {
+    if (tx.state == LORA_TX_IDLE) return false;
+    if (tx.state == LORA_TX_ON_AIR) {
+        if (nowMs - tx.startedAt <= tx.airtimeMs + LORA_TX_TIMEOUT_MARGIN_MS) return false;
+        // the interrupt was lost: the radio is surely done by now
+        tx.stats.timeouts++;
+        *doneMs = nowMs;
+        tx.state = LORA_TX_IDLE;
+        return true;
+    }
+
+    *doneMs = tx.doneAt;
+    tx.state = LORA_TX_IDLE;
+    uint32_t latency = tx.doneAt - tx.startedAt;
+    LoraTxStats &stats = tx.stats;
+    stats.frames++;
+    stats.lastMs = latency;
+    stats.avgMs = stats.frames == 1 ? latency : (stats.avgMs * 7 + latency) / 8;
+    if (latency > stats.maxMs) stats.maxMs = latency;
+    stats.lastOverrunMs = (int32_t)(latency - tx.airtimeMs);
+    return true;
+}
+
+bool loraTxBusy(const LoraTx &tx) {
+    return tx.state != LORA_TX_IDLE;
+}
@@ -0,0 +1,91 @@
+/**
+ * @file mail_classifier.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Classifier of the deviations of the distance (see mail_classifier.h).
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <math.h>
+#include <string.h>
+#include "mail_classifier.h"
+#include "mail_model.h"
+
+// i-th measure of the history, 0 = oldest
+static int slot(const MailHistory &history, int i) {
+    int oldest = history.count < MAIL_HISTORY ? 0 : history.next;
+    return (oldest + i) % MAIL_HISTORY;
+}
+
+void mailHistoryReset(MailHistory &history) {
+    memset(&history, 0, sizeof(history));
+}
+
+void mailHistoryAdd(MailHistory &history, float estimate, int16_t measure) {
+    history.estimate[history.next] = estimate;
+    history.measure[history.next] = measure;
+    history.next = (history.next + 1) % MAIL_HISTORY;
+    if (history.count < MAIL_HISTORY) history.count++;
+}
+
+bool mailHistoryFull(const MailHistory &history) {
+    return history.count == MAIL_HISTORY;
+}
+
+void mailFeatures(const MailHistory &history, float baseline, float features[MAIL_FEATURE_COUNT]) {
+    int count = history.count;
+    if (count == 0) {
+        for (int i = 0; i < MAIL_FEATURE_COUNT; i++) features[i] = 0;
+        return;
+    }
+    int edge = count < MAIL_EDGE_SAMPLES ? count : MAIL_EDGE_SAMPLES;
+    float first = 0, last = 0;
+    for (int i = 0; i < edge; i++) {
+        first += history.estimate[slot(history, i)];
+        last += history.estimate[slot(history, count - 1 - i)];
+    }
+    first /= edge;
+    last /= edge;
+
+    float newest = history.estimate[slot(history, count - 1)];
+    int settled = 0;
+    while (settled < count && fabsf(history.estimate[slot(history, count - 1 - settled)] - newest) <= MAIL_SETTLE_BAND) {
+        settled++;
+    }
+
+    // Welford over the second half of the history
+    float mean = 0, m2 = 0;
+    int n = 0;
+    for (int i = count / 2; i < count; i++) {
+        float value = history.measure[slot(history, i)];
+        n++;
+        float delta = value - mean;
+        mean += delta / n;
+        m2 += delta * (value - mean);
+    }
+
+    features[0] = last - first;
+    features[1] = settled;
+    features[2] = n > 1 ? m2 / (n - 1) : 0;
+    features[3] = newest - baseline;
+}
+
+MailClass mailClassify(const float features[MAIL_FEATURE_COUNT]) {
+    int node = 0;
+    while (MAIL_TREE_FEATURE[node] >= 0) {
+        node = features[MAIL_TREE_FEATURE[node]] <= MAIL_TREE_THRESHOLD[node] ? MAIL_TREE_LEFT[node] : MAIL_TREE_RIGHT[node];
+    }
+    return (MailClass)MAIL_TREE_CLASS[node];
+}
+
+const char *mailClassName(MailClass mailClass) {
+    switch (mailClass) {
+    case MAIL_CLASS_TRANSIENT: return "transient";
+    case MAIL_CLASS_LETTER: return "letter";
+    case MAIL_CLASS_DRIFT: return "drift";
+    }
+    return "?";
+}
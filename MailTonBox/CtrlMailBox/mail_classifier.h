@@ -0,0 +1,55 @@
+/**
+ * @file mail_classifier.h
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Classifier of the deviations of the distance, before a "New Mail" goes on air.
+ *
+ * The filtered distance leaves the baseline for a letter, but also for a hand
+ * in the mailbox, an insect on the sensor or a drift of the speed of sound.
+ * CtrlMailBox keeps the last MAIL_HISTORY measures (estimate of the filter and
+ * raw value) and, when a deviation lasted MAILBOX_CONFIRM_MS, computes a few
+ * features over them and runs the decision tree of mail_model.h:
+ *   0 step       change of the estimate across the history (cm)
+ *   1 settled    newest measures within MAIL_SETTLE_BAND of the last estimate
+ *   2 variance   of the raw measures in the second half of the history (cm^2)
+ *   3 deviation  last estimate minus baseline (cm)
+ * The tree is trained by mail_model.py on labeled traces (synthetic or
+ * recorded) that go through the same filter; it runs in a few microseconds.
+ * No Arduino dependency: the classifier also builds on the host.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef MAIL_CLASSIFIER_H
+#define MAIL_CLASSIFIER_H
+
+#include <stdint.h>
+
+#define MAIL_HISTORY 32           // measures, about 2 s at 60 ms
+#define MAIL_EDGE_SAMPLES 4       // measures averaged at each end of the history for the step
+#define MAIL_SETTLE_BAND 0.5f     // cm
+#define MAIL_FEATURE_COUNT 4
+
+enum MailClass : uint8_t {
+    MAIL_CLASS_TRANSIENT = 0,   // hand, insect, reflection: ignored
+    MAIL_CLASS_LETTER = 1,      // "New Mail"
+    MAIL_CLASS_DRIFT = 2        // slow change of the empty mailbox: the baseline is learned again
+};
+
+struct MailHistory {
+    float estimate[MAIL_HISTORY];   // ring buffer, oldest at `next` once full
+    int16_t measure[MAIL_HISTORY];
+    uint8_t next;
+    uint8_t count;
+};
+
+void mailHistoryReset(MailHistory &history);
+void mailHistoryAdd(MailHistory &history, float estimate, int16_t measure);
+bool mailHistoryFull(const MailHistory &history);
+void mailFeatures(const MailHistory &history, float baseline, float features[MAIL_FEATURE_COUNT]);
+MailClass mailClassify(const float features[MAIL_FEATURE_COUNT]);
+const char *mailClassName(MailClass mailClass);
+
+#endif
@@ -0,0 +1,31 @@
+/**
+ * @file mail_model.h
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Decision tree of the mail classifier, generated by mail_model.py (do not edit).
+ *
+ * Node i tests features[MAIL_TREE_FEATURE[i]] <= MAIL_TREE_THRESHOLD[i] and goes to
+ * MAIL_TREE_LEFT[i] or MAIL_TREE_RIGHT[i]; a node with feature -1 is a leaf of class MAIL_TREE_CLASS[i].
+ * trained on 6870 deviations of 1120 traces (seed 1), 29 nodes, depth <= 4
+ * held-out traces: 128/131 letters notified, 9/349 false "New Mail" (322 without the tree)
+ * features: 0 step, 1 settled, 2 variance, 3 deviation
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef MAIL_MODEL_H
+#define MAIL_MODEL_H
+
+#include <stdint.h>
+
+#define MAIL_TREE_NODES 29
+
+const int8_t MAIL_TREE_FEATURE[29] = {2, 3, 3, 2, -1, -1, 2, -1, -1, 3, 0, -1, -1, -1, 2, 3, 3, -1, -1, 3, -1, -1, 1, 2, -1, -1, 0, -1, -1};
+const float MAIL_TREE_THRESHOLD[29] = {2.6562f, -2.7815f, -10.4231f, 1.7292f, 0.0000f, 0.0000f, 2.0229f, 0.0000f, 0.0000f, 3.4816f, -1.9049f, 0.0000f, 0.0000f, 0.0000f, 28.9146f, -9.0603f, -10.2269f, 0.0000f, 0.0000f, -2.7404f, 0.0000f, 0.0000f, 9.5000f, 51.2812f, 0.0000f, 0.0000f, -2.9532f, 0.0000f, 0.0000f};
+const int8_t MAIL_TREE_LEFT[29] = {1, 2, 3, 4, -1, -1, 7, -1, -1, 10, 11, -1, -1, -1, 15, 16, 17, -1, -1, 20, -1, -1, 23, 24, -1, -1, 27, -1, -1};
+const int8_t MAIL_TREE_RIGHT[29] = {14, 9, 6, 5, -1, -1, 8, -1, -1, 13, 12, -1, -1, -1, 22, 19, 18, -1, -1, 21, -1, -1, 26, 25, -1, -1, 28, -1, -1};
+const uint8_t MAIL_TREE_CLASS[29] = {0, 2, 1, 0, 1, 0, 1, 1, 1, 2, 2, 1, 2, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0, 0, 0, 0, 2, 0, 2};
+
+#endif
@@ -0,0 +1,144 @@
+/**
+ * @file mailbox_fsm.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief State machine of the events of CtrlMailBox (see mailbox_fsm.h).
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include "mailbox_fsm.h"
+
+static void enter(MailboxFsm &fsm, MailboxState state, uint32_t nowMs) {
+    fsm.state = state;
+    fsm.enteredAtMs = nowMs;
+}
+
+static void emit(MailboxFsm &fsm, MailboxActions &actions, const char *event, bool urgent, uint32_t nowMs) {
+    fsm.event = event;
+    fsm.eventUrgent = urgent;
+    actions.event = event;
+    actions.urgent = urgent;
+    fsm.events++;
+    fsm.resumeState = fsm.state == MAILBOX_OPEN ? MAILBOX_OPEN : MAILBOX_IDLE;
+    enter(fsm, MAILBOX_TRANSMITTING, nowMs);
+}
+
+static void recordLatency(MailboxFsm &fsm, uint32_t nowMs) {
+    uint32_t latency = nowMs - fsm.eventStartMs;
+    fsm.lastLatencyMs = latency;
+    fsm.avgLatencyMs = fsm.avgLatencyMs == 0 ? latency : (fsm.avgLatencyMs * 7 + latency) / 8;
+    if (latency > fsm.maxLatencyMs) fsm.maxLatencyMs = latency;
+}
+
+void mailboxFsmInit(MailboxFsm &fsm, uint32_t nowMs) {
+    fsm = {};
+    enter(fsm, MAILBOX_IDLE, nowMs);
+}
+
+MailboxActions mailboxFsmStep(MailboxFsm &fsm, const MailboxInputs &inputs, uint32_t nowMs) {
+    MailboxActions actions = {nullptr, false, false, false};
+
+    // the auto-close does not wait for the ACK of "Mailbox Opened"
+    bool waiting = fsm.state == MAILBOX_TRANSMITTING || fsm.state == MAILBOX_AWAITING_ACK;
+    if (waiting && fsm.resumeState == MAILBOX_OPEN && inputs.open && nowMs - fsm.openedAtMs >= MAILBOX_MAX_OPEN_MS) {
+        actions.close = true;
+    }
+
+    switch (fsm.state) {
+    case MAILBOX_IDLE:
+    case MAILBOX_SAMPLING:
+        if (inputs.open) {
+            fsm.openedAtMs = nowMs;
+            fsm.eventStartMs = nowMs;
+            fsm.openedSent = false;
+            enter(fsm, MAILBOX_OPEN, nowMs);
+            break;
+        }
+        if (!inputs.distanceReady) break;
+        if (fsm.state == MAILBOX_IDLE) {
+            if (fsm.letterPresent) {
+                if (!inputs.deviation) fsm.letterPresent = false; // the letter was removed
+            } else if (inputs.deviation) {
+                fsm.eventStartMs = nowMs;
+                enter(fsm, MAILBOX_SAMPLING, nowMs);
+            }
+        } else if (!inputs.deviation) {
+            enter(fsm, MAILBOX_IDLE, nowMs);
+        } else if (nowMs - fsm.enteredAtMs >= MAILBOX_CONFIRM_MS) {
+            switch (inputs.mailClass) {
+            case MAIL_CLASS_LETTER:
+                fsm.letterPresent = true;
+                enter(fsm, MAILBOX_DETECTED, nowMs);
+                break;
+            case MAIL_CLASS_DRIFT:
+                fsm.drifts++;
+                actions.rebaseline = true;
+                enter(fsm, MAILBOX_IDLE, nowMs);
+                break;
+            default:
+                // classified again after MAILBOX_CONFIRM_MS if the deviation lasts
+                fsm.transients++;
+                enter(fsm, MAILBOX_IDLE, nowMs);
+                break;
+            }
+        }
+        break;
+
+    case MAILBOX_DETECTED:
+        emit(fsm, actions, "New Mail", true, nowMs);
+        break;
+
+    case MAILBOX_TRANSMITTING:
+        if (inputs.eventStatus == MAILBOX_EVENT_REFUSED) {
+            // not in the uplink yet: no latency until it is queued
+            actions.event = fsm.event;
+            actions.urgent = fsm.eventUrgent;
+            break;
+        }
+        if (inputs.eventStatus == MAILBOX_EVENT_QUEUED) break;
+        recordLatency(fsm, nowMs);
+        enter(fsm, MAILBOX_AWAITING_ACK, nowMs);
+        break;
+
+    case MAILBOX_AWAITING_ACK:
+        if (inputs.eventStatus != MAILBOX_EVENT_DONE) break;
+        if (fsm.resumeState == MAILBOX_OPEN && inputs.open) enter(fsm, MAILBOX_OPEN, nowMs);
+        else enter(fsm, MAILBOX_IDLE, nowMs);
+        break;
+
+    case MAILBOX_OPEN:
+        if (!inputs.open) {
+            enter(fsm, MAILBOX_IDLE, nowMs);
+        } else if (nowMs - fsm.openedAtMs >= MAILBOX_MAX_OPEN_MS) {
+            actions.close = true;
+            enter(fsm, MAILBOX_AUTO_CLOSE, nowMs);
+        } else if (!fsm.openedSent && inputs.servoSettled && !fsm.letterPresent) {
+            // the mailbox is open and the mail is taken (or the distance is the initial one)
+            fsm.openedSent = true;
+            emit(fsm, actions, "Mailbox Opened", false, nowMs);
+        }
+        break;
+
+    case MAILBOX_AUTO_CLOSE:
+        if (inputs.open) actions.close = true;
+        else enter(fsm, MAILBOX_IDLE, nowMs);
+        break;
+    }
+    return actions;
+}
+
+const char *mailboxStateName(MailboxState state) {
+    switch (state) {
+    case MAILBOX_IDLE: return "IDLE";
+    case MAILBOX_SAMPLING: return "SAMPLING";
+    case MAILBOX_DETECTED: return "DETECTED";
+    case MAILBOX_TRANSMITTING: return "TX";
+    case MAILBOX_AWAITING_ACK: return "WAIT ACK";
+    case MAILBOX_OPEN: return "OPEN";
+    case MAILBOX_AUTO_CLOSE: return "AUTO CLOSE";
+    }
+    return "?";
+}
@@ -0,0 +1,100 @@
+/**
+ * @file mailbox_fsm.h
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief State machine of the events of CtrlMailBox, from the sensors to the ACK of MailTon.
+ *
+ * loop() collects the inputs (filtered distance and class of its deviation,
+ * knob, servo, progress of the last event in the uplink) and calls mailboxFsmStep() once per pass; the step
+ * never waits and returns the actions to perform (event to queue, auto-close,
+ * new baseline).
+ *
+ *   IDLE -> SAMPLING       the distance left the baseline
+ *   SAMPLING -> DETECTED   the deviation lasted MAILBOX_CONFIRM_MS and the classifier
+ *                          says letter ("New Mail")
+ *   SAMPLING -> IDLE       it was a glitch, a transient (hand, insect) or a drift
+ *                          (the baseline is learned again)
+ *   DETECTED -> TRANSMITTING -> AWAITING_ACK -> IDLE (or OPEN)
+ *                          the event is queued, goes on air, is acknowledged
+ *                          (or given up by the ARQ); an event refused by a full
+ *                          aggregator is offered again from TRANSMITTING
+ *   IDLE/SAMPLING -> OPEN  knob or button; "Mailbox Opened" once the servo settled
+ *   OPEN -> AUTO_CLOSE     open for MAILBOX_MAX_OPEN_MS, the mailbox is closed
+ *   OPEN/AUTO_CLOSE -> IDLE  the mailbox is closed
+ *
+ * The time from the first deviation (or from the opening) to the frame on air
+ * is the detection-to-uplink latency. "New Mail" is urgent and goes in the
+ * contention slots, "Mailbox Opened" waits for the TDMA slot of the CtrlMailBox.
+ * No Arduino dependency: the state machine also builds on the host (test/).
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef MAILBOX_FSM_H
+#define MAILBOX_FSM_H
+
+#include <stdint.h>
+#include "mail_classifier.h"
+
+#define MAILBOX_CONFIRM_MS 600          // a deviation is classified after 600 ms (10 measures of the ultrasonic sensor)
+#define MAILBOX_MAX_OPEN_MS 60000UL     // auto-close
+
+enum MailboxState : uint8_t {
+    MAILBOX_IDLE = 0,
+    MAILBOX_SAMPLING,
+    MAILBOX_DETECTED,
+    MAILBOX_TRANSMITTING,
+    MAILBOX_AWAITING_ACK,
+    MAILBOX_OPEN,
+    MAILBOX_AUTO_CLOSE
+};
+
+// progress of the last event in the uplink (aggregator, then ARQ)
+enum MailboxEventStatus : uint8_t {
+    MAILBOX_EVENT_QUEUED = 0,   // waiting in the aggregator or in the ARQ queue
+    MAILBOX_EVENT_ON_AIR,       // sent, waiting for the ACK
+    MAILBOX_EVENT_DONE,         // acknowledged, given up or dropped
+    MAILBOX_EVENT_REFUSED       // the aggregator had no room, the event must be queued again
+};
+
+struct MailboxInputs {
+    bool distanceReady;     // the distance filter is warmed up
+    bool deviation;         // the distance is away from the baseline by more than the threshold
+    bool open;              // the mailbox is open (knob, button)
+    bool servoSettled;      // the servo reached its target
+    MailClass mailClass;    // class of the deviation, read in SAMPLING
+    MailboxEventStatus eventStatus;
+};
+
+struct MailboxActions {
+    const char *event;      // event to queue for MailTon, nullptr if none
+    bool urgent;
+    bool close;             // close the mailbox (auto-close)
+    bool rebaseline;        // the deviation is a drift: the current distance becomes the baseline
+};
+
+struct MailboxFsm {
+    MailboxState state;
+    MailboxState resumeState;   // where AWAITING_ACK goes back
+    uint32_t enteredAtMs;       // entry in the current state
+    uint32_t openedAtMs;
+    uint32_t eventStartMs;      // first deviation or opening of the last event
+    const char *event;          // last event, offered again while it is refused
+    bool eventUrgent;
+    bool letterPresent;
+    bool openedSent;            // "Mailbox Opened" already sent for this opening
+    uint32_t events;
+    uint32_t transients;        // deviations rejected by the classifier
+    uint32_t drifts;
+    uint32_t lastLatencyMs;     // detection to uplink of the last event
+    uint32_t avgLatencyMs;      // moving average
+    uint32_t maxLatencyMs;
+};
+
+void mailboxFsmInit(MailboxFsm &fsm, uint32_t nowMs);
+MailboxActions mailboxFsmStep(MailboxFsm &fsm, const MailboxInputs &inputs, uint32_t nowMs);
+const char *mailboxStateName(MailboxState state);
+
+#endif
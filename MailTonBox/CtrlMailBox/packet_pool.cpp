@@ -0,0 +1,81 @@
+/**
+ * @file packet_pool.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Preallocated buffers for the LoRa packets received (see packet_pool.h).
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include "packet_pool.h"
+
+static PacketBuffer pool[PACKET_POOL_SIZE];
+static PacketPoolStats stats = {};
+
+// ring of the packets waiting for loop(): head is written by the callback, tail by loop()
+static PacketBuffer *queue[PACKET_POOL_SIZE];
+static uint8_t queueHead = 0;
+static uint8_t queueTail = 0;
+
+void packetPoolInit() {
+    for (int i = 0; i < PACKET_POOL_SIZE; i++) __atomic_store_n(&pool[i].refs, 0, __ATOMIC_RELAXED);
+    queueHead = 0;
+    queueTail = 0;
+    stats = {};
+}
+
+PacketBuffer *packetAcquire() {
+    for (int i = 0; i < PACKET_POOL_SIZE; i++) {
+        uint8_t free = 0;
+        if (__atomic_compare_exchange_n(&pool[i].refs, &free, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            uint8_t inUse = __atomic_add_fetch(&stats.inUse, 1, __ATOMIC_RELAXED);
+            if (inUse > stats.peakInUse) stats.peakInUse = inUse; // best effort, races only lose a peak
+            pool[i].length = 0;
+            return &pool[i];
+        }
+    }
+    __atomic_fetch_add(&stats.dropped, 1, __ATOMIC_RELAXED);
+    return nullptr;
+}
+
+void packetRetain(PacketBuffer *packet) {
+    __atomic_fetch_add(&packet->refs, 1, __ATOMIC_RELAXED);
+}
+
+void packetRelease(PacketBuffer *packet) {
+    if (__atomic_sub_fetch(&packet->refs, 1, __ATOMIC_RELEASE) == 0) {
+        __atomic_fetch_sub(&stats.inUse, 1, __ATOMIC_RELAXED);
+    }
+}
+
+bool packetQueuePush(PacketBuffer *packet) {
+    uint8_t head = __atomic_load_n(&queueHead, __ATOMIC_RELAXED);
+    uint8_t tail = __atomic_load_n(&queueTail, __ATOMIC_ACQUIRE);
+    if ((uint8_t)(head - tail) >= PACKET_POOL_SIZE) {
+        __atomic_fetch_add(&stats.dropped, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    packetRetain(packet);
+    queue[head % PACKET_POOL_SIZE] = packet;
+    __atomic_store_n(&queueHead, (uint8_t)(head + 1), __ATOMIC_RELEASE);
+    __atomic_fetch_add(&stats.received, 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+PacketBuffer *packetQueuePop() {
+    uint8_t tail = __atomic_load_n(&queueTail, __ATOMIC_RELAXED);
+    if (tail == __atomic_load_n(&queueHead, __ATOMIC_ACQUIRE)) return nullptr;
+    PacketBuffer *packet = queue[tail % PACKET_POOL_SIZE];
+    __atomic_store_n(&queueTail, (uint8_t)(tail + 1), __ATOMIC_RELEASE);
+    return packet;
+}
+
+bool packetQueueEmpty() {
+    return __atomic_load_n(&queueTail, __ATOMIC_RELAXED) == __atomic_load_n(&queueHead, __ATOMIC_ACQUIRE);
+}
+
+PacketPoolStats packetPoolStats() {
+    return stats;
+}
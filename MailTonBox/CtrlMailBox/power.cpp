@@ -0,0 +1,60 @@
+/**
+ * @file power.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Deep sleep of CtrlMailBox between the ranging bursts (see power.h).
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include "power.h"
+
+static bool before(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+}
+
+void powerInit(PowerManager &power, uint32_t nowMs) {
+    power = {};
+    power.lastWake = WAKE_POWER_ON;
+    power.wakes[WAKE_POWER_ON] = 1;
+    power.awakeUntilMs = nowMs + POWER_BOOT_AWAKE_MS;
+}
+
+void powerOnWake(PowerManager &power, WakeSource source, uint32_t sleptMs, uint32_t nowMs) {
+    if (source == WAKE_POWER_ON) {
+        powerInit(power, nowMs);
+        return;
+    }
+    power.lastWake = source;
+    power.wakes[source]++;
+    power.sleptMs += sleptMs;
+    power.awakeUntilMs = nowMs + (source == WAKE_TIMER ? POWER_BURST_MS : POWER_INPUT_AWAKE_MS);
+}
+
+bool powerSleepDue(PowerManager &power, const PowerInputs &inputs, uint32_t nowMs, uint32_t *sleepMs) {
+    if (inputs.busy || before(nowMs, power.awakeUntilMs)) return false;
+
+    uint32_t duration = POWER_RANGING_PERIOD_MS;
+    if (inputs.hasDeadline) {
+        if (!before(nowMs, inputs.deadlineMs)) return false;
+        if (inputs.deadlineMs - nowMs < duration) duration = inputs.deadlineMs - nowMs;
+    }
+    if (duration < POWER_MIN_SLEEP_MS) return false;
+
+    power.sleeps++;
+    *sleepMs = duration;
+    return true;
+}
+
+const char *wakeSourceName(WakeSource source) {
+    switch (source) {
+    case WAKE_POWER_ON: return "power-on";
+    case WAKE_TIMER: return "timer";
+    case WAKE_KNOB: return "knob";
+    case WAKE_BUTTON: return "button";
+    default: break;
+    }
+    return "?";
+}
@@ -0,0 +1,66 @@
+/**
+ * @file power.h
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Deep sleep of CtrlMailBox between the ranging bursts.
+ *
+ * On battery CtrlMailBox sleeps instead of running flat out: the timer wakes
+ * it every POWER_RANGING_PERIOD_MS for a short burst of measures, the knob and
+ * the button wake it at once. After a wake-up the node stays awake for a
+ * minimum time that depends on the source, then as long as the firmware is
+ * busy (event in progress, mailbox open, radio or receive windows active,
+ * configuration portal open). The sleep never goes past the next timer of
+ * the firmware (retransmission, flush of the uplink, telemetry sample). The
+ * state lives in the RTC memory with the rest of the retained state, so the
+ * decisions only depend on the clock and on the wake sources given by the
+ * caller.
+ * No Arduino dependency: the state machine also builds on the host.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdint.h>
+
+#define POWER_RANGING_PERIOD_MS 5000UL  // timer wake-up: worst-case delay of a "New Mail"
+#define POWER_BURST_MS 600UL            // awake after a timer wake-up, 10 measures of the ultrasonic sensor
+#define POWER_INPUT_AWAKE_MS 15000UL    // awake after the knob or the button
+#define POWER_BOOT_AWAKE_MS 300000UL    // awake 5 minutes after a power-on
+#define POWER_MIN_SLEEP_MS 250UL        // shorter pauses do not pay back the wake-up
+
+enum WakeSource : uint8_t {
+    WAKE_POWER_ON = 0,  // reset or first boot: cold start
+    WAKE_TIMER,
+    WAKE_KNOB,
+    WAKE_BUTTON,
+    WAKE_SOURCE_COUNT
+};
+
+struct PowerInputs {
+    bool busy;              // something is in progress, the node must stay awake
+    bool hasDeadline;       // a timer of the firmware fires at deadlineMs
+    uint32_t deadlineMs;
+};
+
+struct PowerManager {
+    WakeSource lastWake;
+    uint32_t awakeUntilMs;              // minimum awake time after the last wake-up
+    uint32_t wakes[WAKE_SOURCE_COUNT];
+    uint32_t sleeps;
+    uint32_t sleptMs;                   // total time in deep sleep
+    uint32_t lastResumeMs;              // from the wake-up to loop(), set by the firmware
+};
+
+// cold start
+void powerInit(PowerManager &power, uint32_t nowMs);
+// wake-up from a deep sleep that lasted sleptMs
+void powerOnWake(PowerManager &power, WakeSource source, uint32_t sleptMs, uint32_t nowMs);
+// true when the node can sleep now, for `*sleepMs`
+bool powerSleepDue(PowerManager &power, const PowerInputs &inputs, uint32_t nowMs, uint32_t *sleepMs);
+const char *wakeSourceName(WakeSource source);
+
+#endif
@@ -0,0 +1,111 @@
+/**
+ * @file servo.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Servo driver of CtrlMailBox on the LEDC peripheral (see servo.h).
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <Arduino.h>
+#include "servo.h"
+
+static uint8_t servoPin;
+static uint16_t slewRate = 0;          // degrees per second, 0 = no profile
+static bool attached = false;
+static bool positionKnown = false;     // the position at boot is unknown, the first target is reached at once
+static int target = 0;
+static int32_t positionMilli = 0;      // angle of the pulse, thousandths of degree
+static uint32_t lastStepMs = 0;
+static uint32_t reachedAtMs = 0;
+
+static void writePulse() {
+    int32_t pulseUs = SERVO_MIN_PULSE_US + (int64_t)positionMilli * (SERVO_MAX_PULSE_US - SERVO_MIN_PULSE_US) / 180000;
+    uint32_t duty = (uint32_t)((uint64_t)pulseUs * ((1 << SERVO_RESOLUTION) - 1) * SERVO_FREQUENCY / 1000000);
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+    ledcWrite(servoPin, duty);
+#else
+    ledcWrite(SERVO_LEDC_CHANNEL, duty);
+#endif
+}
+
+static void attachPwm() {
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+    ledcAttach(servoPin, SERVO_FREQUENCY, SERVO_RESOLUTION);
+#else
+    ledcSetup(SERVO_LEDC_CHANNEL, SERVO_FREQUENCY, SERVO_RESOLUTION);
+    ledcAttachPin(servoPin, SERVO_LEDC_CHANNEL);
+#endif
+    attached = true;
+}
+
+// the pin goes back to a low GPIO: no pulses, the servo holds by friction
+static void detachPwm() {
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+    ledcDetach(servoPin);
+#else
+    ledcDetachPin(servoPin);
+#endif
+    pinMode(servoPin, OUTPUT);
+    digitalWrite(servoPin, LOW);
+    attached = false;
+}
+
+void servoBegin(uint8_t pin, uint16_t slewDegPerSecond) {
+    servoPin = pin;
+    slewRate = slewDegPerSecond;
+    pinMode(servoPin, OUTPUT);
+    digitalWrite(servoPin, LOW);
+}
+
+void servoAssumePosition(int angle) {
+    target = angle;
+    positionMilli = (int32_t)angle * 1000;
+    positionKnown = true;
+}
+
+void servoSetTarget(int angle, uint32_t nowMs) {
+    if (positionKnown && angle == target) return;
+    target = angle;
+    if (!positionKnown || slewRate == 0) positionMilli = (int32_t)target * 1000;
+    positionKnown = true;
+    if (!attached) attachPwm();
+    writePulse();
+    lastStepMs = nowMs;
+    reachedAtMs = nowMs;
+}
+
+bool servoUpdate(uint32_t nowMs) {
+    if (!attached) return false;
+
+    int32_t targetMilli = (int32_t)target * 1000;
+    if (positionMilli != targetMilli) {
+        uint32_t elapsed = nowMs - lastStepMs;
+        if (elapsed < SERVO_STEP_MS) return true;
+        int32_t step = (int32_t)((uint32_t)slewRate * elapsed);  // thousandths of degree
+        if (abs(targetMilli - positionMilli) <= step) positionMilli = targetMilli;
+        else positionMilli += targetMilli > positionMilli ? step : -step;
+        writePulse();
+        lastStepMs = nowMs;
+        reachedAtMs = nowMs;
+        return true;
+    }
+
+    if (nowMs - reachedAtMs < SERVO_SETTLE_MS) return true;
+    detachPwm();
+    return false;
+}
+
+bool servoMoving() {
+    return attached;
+}
+
+int servoTarget() {
+    return target;
+}
+
+int servoAngle() {
+    return positionMilli / 1000;
+}
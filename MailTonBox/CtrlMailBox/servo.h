@@ -0,0 +1,45 @@
+/**
+ * @file servo.h
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Servo driver of CtrlMailBox on the LEDC peripheral of the ESP32.
+ *
+ * The 50 Hz pulses are generated by the hardware: the firmware only sets a
+ * target angle. servoUpdate() moves the pulse towards the target with the
+ * slew rate chosen in servoBegin() (0 jumps to the target), then, when the
+ * servo had SERVO_SETTLE_MS to get there, it detaches the PWM: the gear
+ * holds the position, the servo does not buzz and the loop has nothing left
+ * to do until the next target.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef SERVO_H
+#define SERVO_H
+
+#include <stdint.h>
+
+#define SERVO_FREQUENCY 50          // Hz, 20 ms period
+#define SERVO_RESOLUTION 14         // bits of the duty cycle
+#define SERVO_LEDC_CHANNEL 4        // used by the cores that still need a channel (2.x)
+#define SERVO_MIN_PULSE_US 1000     // 0 degrees, the angles are mapped as the old writeServo()
+#define SERVO_MAX_PULSE_US 2000     // 180 degrees
+#define SERVO_STEP_MS 20            // one step of the motion profile per PWM period
+#define SERVO_SETTLE_MS 500         // time to reach the last pulse before detaching
+
+void servoBegin(uint8_t pin, uint16_t slewDegPerSecond);
+// the servo is known to be at `angle` (before a deep sleep): no pulses until the target changes
+void servoAssumePosition(int angle);
+// new target angle, ignored if it is already the target
+void servoSetTarget(int angle, uint32_t nowMs);
+// advances the motion profile and detaches the PWM once settled, returns true while the servo is moving
+bool servoUpdate(uint32_t nowMs);
+// the PWM is attached: the servo is moving or settling
+bool servoMoving();
+int servoTarget();
+// angle of the pulse generated now (or the last one before the detach)
+int servoAngle();
+
+#endif
@@ -0,0 +1,131 @@
+/**
+ * @file tdma.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Slotted access to the channel, scheduled by the beacons of MailTon (see tdma.h).
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include "tdma.h"
+
+uint16_t tdmaSlotMs() {
+    uint32_t slotMs = 2 * TDMA_GUARD_MS + TDMA_TX_WINDOW_MS + TDMA_TURNAROUND_MS +
+                      loraTimeOnAirMs(TDMA_MAX_UPLINK_LENGTH) + loraTimeOnAirMs(TDMA_MAX_REPLY_LENGTH);
+    return (slotMs + TDMA_SLOT_ROUND_MS - 1) / TDMA_SLOT_ROUND_MS * TDMA_SLOT_ROUND_MS;
+}
+
+uint16_t tdmaDeviceSlot(uint16_t device, uint8_t contentionPeriod) {
+    // slot 0 of every period is the contention slot
+    return device + device / (contentionPeriod - 1) + 1;
+}
+
+uint16_t tdmaSlotCount(uint16_t devices, uint8_t contentionPeriod) {
+    return devices == 0 ? 1 : tdmaDeviceSlot(devices - 1, contentionPeriod) + 1;
+}
+
+uint32_t tdmaBeaconPeriodMs(uint16_t devices) {
+    uint32_t cycleMs = (uint32_t)tdmaSlotCount(devices, TDMA_CONTENTION_PERIOD) * tdmaSlotMs();
+    uint32_t cycles = (TDMA_BEACON_INTERVAL_MS + cycleMs - 1) / cycleMs;
+    return cycles * cycleMs;
+}
+
+size_t tdmaBuildBeacon(uint8_t *buffer, size_t size, const uint8_t *addresses, uint8_t count) {
+    if (count > TDMA_MAX_DEVICES || size < (size_t)TDMA_BEACON_FIXED_LENGTH + count) return 0;
+
+    uint16_t intervalS = (tdmaBeaconPeriodMs(count) + 999) / 1000;
+    uint16_t slotMs = tdmaSlotMs();
+    buffer[0] = TDMA_BEACON_VERSION;
+    buffer[1] = intervalS & 0xFF;
+    buffer[2] = intervalS >> 8;
+    buffer[3] = slotMs & 0xFF;
+    buffer[4] = slotMs >> 8;
+    buffer[5] = TDMA_CONTENTION_PERIOD;
+    buffer[6] = count;
+    for (uint8_t i = 0; i < count; i++) buffer[TDMA_BEACON_FIXED_LENGTH + i] = addresses[i];
+    return TDMA_BEACON_FIXED_LENGTH + count;
+}
+
+bool tdmaParseBeacon(TdmaSync &sync, const uint8_t *payload, size_t length, uint8_t localAddress, uint32_t nowMs) {
+    if (length < TDMA_BEACON_FIXED_LENGTH || payload[0] != TDMA_BEACON_VERSION) return false;
+    uint8_t count = payload[6];
+    uint16_t slotMs = payload[3] | payload[4] << 8;
+    uint8_t contentionPeriod = payload[5];
+    if (length < (size_t)TDMA_BEACON_FIXED_LENGTH + count || slotMs == 0 || contentionPeriod < 2) return false;
+
+    sync.intervalMs = (uint32_t)(payload[1] | payload[2] << 8) * 1000;
+    sync.slotMs = slotMs;
+    sync.contentionPeriod = contentionPeriod;
+    sync.slotCount = tdmaSlotCount(count, contentionPeriod);
+    sync.ownSlot = -1;
+    for (uint8_t i = 0; i < count; i++) {
+        if (payload[TDMA_BEACON_FIXED_LENGTH + i] == localAddress) {
+            sync.ownSlot = tdmaDeviceSlot(i, contentionPeriod);
+            break;
+        }
+    }
+    sync.beaconAtMs = nowMs;
+    sync.valid = true;
+    sync.beacons++;
+    return true;
+}
+
+// slot in the cycle and ms elapsed in it, false if the schedule is not valid
+static bool currentSlot(const TdmaSync &sync, uint32_t nowMs, uint16_t *slot, uint32_t *offsetMs) {
+    if (!sync.valid) return false;
+    uint32_t elapsed = nowMs - sync.beaconAtMs;
+    if (elapsed > sync.intervalMs * TDMA_BEACON_LOST_LIMIT) return false;
+    uint32_t cycleMs = (uint32_t)sync.slotCount * sync.slotMs;
+    uint32_t position = elapsed % cycleMs;
+    *slot = position / sync.slotMs;
+    *offsetMs = position % sync.slotMs;
+    return true;
+}
+
+TdmaWindow tdmaWindow(const TdmaSync &sync, uint32_t nowMs) {
+    uint16_t slot;
+    uint32_t offset;
+    if (!currentSlot(sync, nowMs, &slot, &offset)) return TDMA_UNSYNCED;
+    // transmit only at the start of the slot, the rest is for the frame and the reply
+    if (offset < TDMA_GUARD_MS || offset > TDMA_GUARD_MS + TDMA_TX_WINDOW_MS) return TDMA_OTHER_SLOT;
+    if (slot % sync.contentionPeriod == 0) return TDMA_CONTENTION;
+    if (slot == sync.ownSlot) return TDMA_OWN_SLOT;
+    return TDMA_OTHER_SLOT;
+}
+
+bool tdmaSlotEnd(const TdmaSync &sync, uint32_t atMs, uint32_t *endMs) {
+    uint16_t slot;
+    uint32_t offset;
+    if (!currentSlot(sync, atMs, &slot, &offset)) return false;
+    *endMs = atMs - offset + sync.slotMs;
+    return true;
+}
+
+bool tdmaContentionOnly(const TdmaSync &sync, uint32_t fromMs, uint32_t toMs) {
+    uint32_t atMs = fromMs;
+    while (true) {
+        uint16_t slot;
+        uint32_t offset;
+        if (!currentSlot(sync, atMs, &slot, &offset)) return true;
+        if (slot % sync.contentionPeriod != 0) return false;
+        uint32_t endMs = atMs - offset + sync.slotMs;
+        if ((int32_t)(toMs - endMs) < 0) return true;
+        atMs = endMs;
+    }
+}
+
+bool tdmaUplinkFree(const TdmaSync &sync, uint32_t fromMs, uint32_t toMs) {
+    const uint32_t uplinkEndMs = 2 * TDMA_GUARD_MS + TDMA_TX_WINDOW_MS + loraTimeOnAirMs(TDMA_MAX_UPLINK_LENGTH);
+    uint32_t atMs = fromMs;
+    while (true) {
+        uint16_t slot;
+        uint32_t offset;
+        if (!currentSlot(sync, atMs, &slot, &offset)) return true;
+        if (slot % sync.contentionPeriod != 0 && offset < uplinkEndMs) return false;
+        uint32_t endMs = atMs - offset + sync.slotMs;
+        if ((int32_t)(toMs - endMs) < 0) return true;
+        atMs = endMs;
+    }
+}
@@ -0,0 +1,50 @@
+/**
+ * @file telemetry.h
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Delta encoding of the telemetry samples of CtrlMailBox.
+ *
+ * Shared by MailTon and CtrlMailBox (keep the two copies identical).
+ * A sample holds the distance measured by the ultrasonic sensor, its
+ * baseline (the distance of the empty mailbox) and the state of the mailbox
+ * and of the servo. The samples travel in the TLM field of an uplink, oldest
+ * first, separated by '/': the first one is absolute, with its age in seconds
+ * when the frame is built, the next ones carry the seconds elapsed and the
+ * differences from the previous sample (flags as XOR). Trailing zero fields
+ * are omitted, so a sample equal to the previous one costs a few characters.
+ * Example: "TLM=840,23,25,0/60/60,-9,0,5"
+ * The ages are computed when the frame is built: a retransmission makes them
+ * older by the ARQ delay.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TELEMETRY_MAX_SAMPLES 16
+
+enum TelemetryFlag : uint8_t {
+    TELEMETRY_MAILBOX_OPEN = 1,
+    TELEMETRY_SERVO_OPEN = 2,
+    TELEMETRY_MAIL_DETECTED = 4
+};
+
+struct TelemetrySample {
+    uint32_t atMs;      // millis() of the device that owns the sample
+    int16_t distance;   // cm
+    int16_t baseline;   // cm
+    uint8_t flags;      // TelemetryFlag
+};
+
+// writes the samples in `out` (null terminated), returns how many of them fit in `size` bytes
+int telemetryEncode(const TelemetrySample *samples, int count, uint32_t nowMs, char *out, size_t size);
+// parses a TLM field received at `nowMs`, returns the number of samples or -1 if malformed
+int telemetryDecode(const char *text, uint32_t nowMs, TelemetrySample *samples, int maxSamples);
+
+#endif
@@ -0,0 +1,41 @@
+/**
+ * @file check.h
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Minimal assertions of the host tests: a failed check is printed and
+ * the test returns a non-zero status at the end.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+
+static int checkFailures = 0;
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        checkFailures++; \
+    } \
+} while (0)
+
+#define CHECK_EQ(actual, expected) do { \
+    long long checkActual = (long long)(actual), checkExpected = (long long)(expected); \
+    if (checkActual != checkExpected) { \
+        printf("%s:%d: check failed: %s == %lld, expected %lld\n", __FILE__, __LINE__, #actual, checkActual, checkExpected); \
+        checkFailures++; \
+    } \
+} while (0)
+
+// to be returned by main()
+static int checkResult(const char *test) {
+    printf("%s: %s\n", test, checkFailures == 0 ? "ok" : "FAILED");
+    return checkFailures == 0 ? 0 : 1;
+}
+
+#endif
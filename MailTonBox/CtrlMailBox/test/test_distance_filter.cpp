@@ -0,0 +1,229 @@
+/**
+ * @file test_distance_filter.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Host test of the distance filter (distance_filter.h) on the traces of
+ * traces/distance_traces.csv (see traces/make_traces.py for the format).
+ *
+ * The measures are replayed as updateDistance() does on CtrlMailBox: lost
+ * echoes are skipped, the baseline is frozen while a deviation larger than
+ * the threshold has lasted MAILBOX_CONFIRM_MS (letter detected). Against the
+ * ground truth of each trace the test checks the error of the estimate, the
+ * outliers that get through the median, false and late detections, and the
+ * baseline of the empty mailbox. A measure further than OUTLIER_CM from the
+ * truth is an outlier: with up to two of them in its window the median keeps
+ * the estimate within the threshold of the truth, three or more (a cluster)
+ * are counted and the estimate is not checked until it had
+ * CLUSTER_RECOVERY_MS to recover. The same Kalman filter without the median
+ * is replayed as a reference: the outliers must get through it.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "distance_filter.h"
+#include "check.h"
+
+#define PERIOD_MS 60                // ULTRASONIC_PERIOD_MS
+#define THRESHOLD_CM 2.0f           // `theshold` of ctrlMailBox.cpp
+#define CONFIRM_MS 600              // MAILBOX_CONFIRM_MS
+#define SETTLE_MS 1500              // after a step the estimate is not compared with the truth
+#define BASELINE_SETTLED_MS 120000  // the baseline is compared with the empty mailbox after 2 minutes
+#define OUTLIER_CM 4.0f
+#define CLUSTER_RECOVERY_MS 1500
+
+struct Trace {
+    char name[32];
+    float emptyCm;
+    float driftCm;      // over the whole trace
+    float stepCm;       // letter, 0 if none
+    uint32_t fromMs;
+    uint32_t toMs;
+    std::vector<int> cm;    // -1: lost echo
+};
+
+static bool loadTraces(const char *path, std::vector<Trace> &traces) {
+    FILE *file = fopen(path, "r");
+    if (file == nullptr) return false;
+    std::string line;
+    Trace trace = {};
+    int c;
+    while (true) {
+        line.clear();
+        while ((c = fgetc(file)) != EOF && c != '\n') line += (char)c;
+        if (line.empty() && c == EOF) break;
+        if (line[0] == '#') {
+            trace = Trace();
+            sscanf(line.c_str(), "# name=%31s empty=%f drift=%f step=%f from=%u to=%u", trace.name, &trace.emptyCm,
+                   &trace.driftCm, &trace.stepCm, &trace.fromMs, &trace.toMs);
+            continue;
+        }
+        // label,cm,cm,... with an empty field for a lost echo
+        const char *field = strchr(line.c_str(), ',');
+        while (field != nullptr) {
+            field++;
+            trace.cm.push_back(*field == ',' || *field == '\0' ? -1 : atoi(field));
+            field = strchr(field, ',');
+        }
+        traces.push_back(trace);
+    }
+    fclose(file);
+    return true;
+}
+
+struct TraceResult {
+    float maxErrorCm;           // estimate vs truth, steps excluded
+    uint32_t outliersThrough;   // measures moved by isolated outliers as far as the threshold from the truth
+    uint32_t referenceThrough;  // the same, Kalman filter without the median
+    uint32_t clusters;          // windows of the median with more than two outliers
+    uint32_t falseDetections;   // deviations confirmed without a letter
+    int32_t detectionMs;        // from the arrival of the letter, -1 if never
+    int32_t clearedMs;          // from the removal to the end of the deviation, -1 if never
+    float maxBaselineErrorCm;   // baseline vs empty mailbox, after BASELINE_SETTLED_MS and outside the letter
+    float baselineMoveCm;       // change of the baseline while the letter was detected
+};
+
+static TraceResult replay(const Trace &trace) {
+    TraceResult result = {0, 0, 0, 0, 0, -1, -1, 0, 0};
+    DistanceFilter filter;
+    distanceFilterInit(filter, THRESHOLD_CM);
+    bool detected = false;
+    uint32_t deviationSinceMs = 0;
+    bool deviating = false;
+    float baselineAtDetection = 0;
+    bool outlier[DISTANCE_MEDIAN_WINDOW] = {};  // last valid measures, as the window of the median
+    uint8_t next = 0;
+    uint32_t clusterAtMs = 0;
+    bool cluster = false;
+    float reference = 0, referenceVariance = DISTANCE_MEASURE_NOISE;
+    bool referenceStarted = false;
+    uint32_t samples = trace.cm.size();
+
+    for (uint32_t i = 0; i < samples; i++) {
+        uint32_t t = i * PERIOD_MS;
+        if (trace.cm[i] < 0) continue;
+        bool letter = trace.stepCm != 0 && t >= trace.fromMs && t < trace.toMs;
+        float empty = trace.emptyCm + trace.driftCm * i / samples;
+        float truth = empty + (letter ? trace.stepCm : 0);
+
+        float estimate = distanceFilterUpdate(filter, trace.cm[i], detected);
+        if (!referenceStarted) {
+            reference = trace.cm[i];
+            referenceStarted = true;
+        } else {
+            referenceVariance += DISTANCE_PROCESS_NOISE;
+            float gain = referenceVariance / (referenceVariance + DISTANCE_MEASURE_NOISE);
+            reference += gain * (trace.cm[i] - reference);
+            referenceVariance *= 1.0f - gain;
+        }
+        outlier[next] = fabsf(trace.cm[i] - truth) > OUTLIER_CM;
+        next = (next + 1) % DISTANCE_MEDIAN_WINDOW;
+        int outliers = 0;
+        for (bool o : outlier) outliers += o;
+        if (outliers > DISTANCE_MEDIAN_WINDOW / 2) {
+            if (!cluster || t - clusterAtMs > PERIOD_MS) result.clusters += !cluster;
+            cluster = true;
+            clusterAtMs = t;
+        } else if (cluster && t - clusterAtMs >= CLUSTER_RECOVERY_MS) {
+            cluster = false;
+        }
+        if (!distanceFilterReady(filter)) continue;
+
+        bool nearStep = trace.stepCm != 0 && ((t >= trace.fromMs && t < trace.fromMs + SETTLE_MS) ||
+                                              (t >= trace.toMs && t < trace.toMs + SETTLE_MS));
+        if (!nearStep && !cluster) {
+            float error = fabsf(estimate - truth);
+            if (error > result.maxErrorCm) result.maxErrorCm = error;
+            if (error >= THRESHOLD_CM && outliers > 0) result.outliersThrough++;
+        }
+        if (!nearStep && !cluster && fabsf(reference - truth) >= THRESHOLD_CM && outliers > 0) result.referenceThrough++;
+
+        // detection as on CtrlMailBox: deviation from the baseline confirmed after CONFIRM_MS
+        bool deviation = fabsf(estimate - filter.baseline) > THRESHOLD_CM;
+        if (deviation && !deviating) deviationSinceMs = t;
+        deviating = deviation;
+        if (deviation && !detected && t - deviationSinceMs >= CONFIRM_MS) {
+            detected = true;
+            baselineAtDetection = filter.baseline;
+            if (letter || nearStep) {
+                if (result.detectionMs < 0) result.detectionMs = t - trace.fromMs;
+            } else {
+                result.falseDetections++;
+            }
+        }
+        if (!deviation && detected) {
+            detected = false;
+            if (trace.stepCm != 0 && t >= trace.toMs && result.clearedMs < 0) result.clearedMs = t - trace.toMs;
+        }
+        if (detected) {
+            float move = fabsf(filter.baseline - baselineAtDetection);
+            if (move > result.baselineMoveCm) result.baselineMoveCm = move;
+        } else if (t >= BASELINE_SETTLED_MS && !letter && !nearStep) {
+            float error = fabsf(filter.baseline - empty);
+            if (error > result.maxBaselineErrorCm) result.maxBaselineErrorCm = error;
+        }
+    }
+    return result;
+}
+
+static void testOutlierWindow() {
+    // two outliers in a row never reach the estimate through the median of 5
+    DistanceFilter filter;
+    distanceFilterInit(filter, THRESHOLD_CM);
+    for (int i = 0; i < 40; i++) distanceFilterUpdate(filter, 30, false);
+    CHECK(distanceFilterReady(filter));
+    CHECK(fabsf(filter.baseline - 30) < 0.01f);
+    const int16_t bursts[][2] = {{5, 5}, {99, 99}, {5, 99}};
+    for (const auto &burst : bursts) {
+        CHECK(fabsf(distanceFilterUpdate(filter, burst[0], false) - 30) < 0.01f);
+        CHECK(fabsf(distanceFilterUpdate(filter, burst[1], false) - 30) < 0.01f);
+        for (int i = 0; i < 3; i++) CHECK(fabsf(distanceFilterUpdate(filter, 30, false) - 30) < 0.01f);
+    }
+
+    // a lasting change goes through after the median delay, the event freezes the baseline
+    float estimate = 0;
+    for (int i = 0; i < 20; i++) estimate = distanceFilterUpdate(filter, 24, true);
+    CHECK(estimate < 25);
+    CHECK(fabsf(filter.baseline - 30) < 0.01f);
+    CHECK(filter.baselineFrozen);
+}
+
+static void testTraces(const char *path) {
+    std::vector<Trace> traces;
+    CHECK(loadTraces(path, traces));
+    CHECK(traces.size() >= 4);
+
+    for (const Trace &trace : traces) {
+        TraceResult r = replay(trace);
+        printf("  %-16s %5u measures: error %.2f cm, %u (%u without median) outliers through, %u clusters, %u false, detected %d ms, "
+               "cleared %d ms, baseline error %.2f cm, moved %.2f cm\n", trace.name, (unsigned)trace.cm.size(), r.maxErrorCm,
+               (unsigned)r.outliersThrough, (unsigned)r.referenceThrough, (unsigned)r.clusters, (unsigned)r.falseDetections, (int)r.detectionMs, (int)r.clearedMs,
+               r.maxBaselineErrorCm, r.baselineMoveCm);
+
+        CHECK(r.maxErrorCm < THRESHOLD_CM);
+        CHECK_EQ(r.outliersThrough, 0);
+        CHECK(r.referenceThrough > 0);
+        CHECK_EQ(r.falseDetections, 0);
+        CHECK(r.maxBaselineErrorCm < 0.8f);
+        if (trace.stepCm != 0) {
+            // confirmed within a second of the arrival, released within a second of the removal
+            CHECK(r.detectionMs >= CONFIRM_MS && r.detectionMs < 1000);
+            CHECK(r.clearedMs >= 0 && r.clearedMs < 1000);
+            CHECK(r.baselineMoveCm < 0.01f);
+        } else {
+            CHECK_EQ(r.detectionMs, -1);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    testOutlierWindow();
+    testTraces(argc > 1 ? argv[1] : "traces/distance_traces.csv");
+    return checkResult("distance_filter");
+}
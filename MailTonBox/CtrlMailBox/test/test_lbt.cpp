@@ -0,0 +1,208 @@
+/**
+ * @file test_lbt.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Host test of the listen-before-talk of CtrlMailBox (lbt.h).
+ *
+ * Besides the backoff rules, N mailboxes share a simulated channel: each one
+ * sends a frame for an event that falls at a random time of a burst (the
+ * postman, a storm of "Mailbox Opened"), runs a CAD before each transmission
+ * and retries with the timeouts of the ARQ when its frame collides. Two
+ * overlapping frames are both lost (no capture effect) and every node hears
+ * every other one. The same bursts are replayed without CAD (pure ALOHA) and
+ * the collided frames must drop.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <queue>
+#include <vector>
+#include "lbt.h"
+#include "arq.h"
+#include "lora_airtime.h"
+#include "check.h"
+
+#define CAD_MS 2            // two symbols at SF7/125 kHz
+#define TURNAROUND_MS 5     // from the end of the CAD to the first symbol on air
+#define FRAME_PAYLOAD (LORA_HEADER_LENGTH + 48)
+
+static uint32_t randomState = 1;
+
+static uint32_t nextRandom() {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+static void testBackoff() {
+    Lbt lbt;
+    lbtInit(lbt, 7, 100);
+
+    // the window doubles at every busy channel, up to 2^LBT_MAX_EXPONENT slots
+    for (int attempt = 1; attempt < LBT_MAX_ATTEMPTS; attempt++) {
+        int exponent = attempt < LBT_MAX_EXPONENT ? attempt : LBT_MAX_EXPONENT;
+        lbtOnCadStart(lbt);
+        uint32_t backoff = lbtOnBusy(lbt);
+        CHECK(backoff >= 100 && backoff <= (1u << exponent) * 100);
+        CHECK_EQ(backoff % 100, 0);
+    }
+    // sent anyway after LBT_MAX_ATTEMPTS busy channels
+    CHECK_EQ(lbtOnBusy(lbt), 0);
+    CHECK_EQ(lbt.stats.forced, 1);
+    CHECK_EQ(lbt.stats.cadHits, LBT_MAX_ATTEMPTS);
+
+    // a clear channel starts the next frame from the smallest window
+    lbtOnBusy(lbt);
+    lbtOnClear(lbt);
+    for (int i = 0; i < 100; i++) {
+        uint32_t backoff = lbtOnBusy(lbt);
+        CHECK(backoff == 100 || backoff == 200);
+        lbtOnClear(lbt);
+    }
+}
+
+enum SimEventType : uint8_t { SIM_READY, SIM_CAD_DONE, SIM_TX_START, SIM_TX_END };
+
+struct SimEvent {
+    uint32_t timeMs;
+    SimEventType type;
+    int node;
+    bool operator>(const SimEvent &other) const { return timeMs > other.timeMs; }
+};
+
+struct SimNode {
+    Lbt lbt;
+    uint32_t eventMs;
+    uint32_t cadStartMs;
+    int transmissions;
+    int frame;          // index of the frame on air
+    bool delivered;
+};
+
+struct SimFrame {
+    uint32_t startMs;
+    uint32_t endMs;
+    bool collided;
+};
+
+struct SimResult {
+    uint32_t frames;
+    uint32_t collided;
+    uint32_t delivered;
+    uint32_t events;
+    uint64_t latencyMs;     // event to end of the delivered frame
+};
+
+// one burst of `nodes` events within `burstMs`
+static void simulateBurst(int nodes, uint32_t burstMs, bool cad, uint32_t seed, SimResult &result) {
+    uint32_t airtimeMs = loraTimeOnAirMs(FRAME_PAYLOAD);
+    std::vector<SimNode> node(nodes);
+    std::vector<SimFrame> frames;
+    std::priority_queue<SimEvent, std::vector<SimEvent>, std::greater<SimEvent>> queue;
+
+    randomState = seed;
+    for (int i = 0; i < nodes; i++) {
+        lbtInit(node[i].lbt, nextRandom(), airtimeMs);
+        node[i].eventMs = nextRandom() % burstMs;
+        queue.push({node[i].eventMs, SIM_READY, i});
+    }
+
+    while (!queue.empty()) {
+        SimEvent event = queue.top();
+        queue.pop();
+        SimNode &n = node[event.node];
+        switch (event.type) {
+        case SIM_READY:
+            if (!cad) {
+                queue.push({event.timeMs, SIM_TX_START, event.node});
+                break;
+            }
+            lbtOnCadStart(n.lbt);
+            n.cadStartMs = event.timeMs;
+            queue.push({event.timeMs + CAD_MS, SIM_CAD_DONE, event.node});
+            break;
+
+        case SIM_CAD_DONE: {
+            // busy if a frame was on air during the CAD
+            bool busy = false;
+            for (const SimFrame &frame : frames) {
+                if (frame.startMs <= event.timeMs && frame.endMs > n.cadStartMs) busy = true;
+            }
+            uint32_t backoff = busy ? lbtOnBusy(n.lbt) : 0;
+            if (backoff > 0) {
+                queue.push({event.timeMs + backoff, SIM_READY, event.node});
+            } else {
+                lbtOnClear(n.lbt);
+                queue.push({event.timeMs + TURNAROUND_MS, SIM_TX_START, event.node});
+            }
+            break;
+        }
+
+        case SIM_TX_START: {
+            SimFrame frame = {event.timeMs, event.timeMs + airtimeMs, false};
+            for (SimFrame &other : frames) {
+                if (other.endMs > frame.startMs) other.collided = frame.collided = true;
+            }
+            n.frame = (int)frames.size();
+            n.transmissions++;
+            frames.push_back(frame);
+            queue.push({frame.endMs, SIM_TX_END, event.node});
+            break;
+        }
+
+        case SIM_TX_END:
+            if (!frames[n.frame].collided) {
+                n.delivered = true;
+                result.latencyMs += event.timeMs - n.eventMs;
+            } else if (n.transmissions < ARQ_MAX_RETRIES) {
+                // retransmission timeout of the ARQ, doubled at every attempt with up to 50% of jitter
+                uint32_t timeout = ARQ_BASE_TIMEOUT_MS << (n.transmissions - 1);
+                if (timeout > ARQ_MAX_TIMEOUT_MS) timeout = ARQ_MAX_TIMEOUT_MS;
+                timeout += nextRandom() % (timeout / 2 + 1);
+                queue.push({event.timeMs + timeout, SIM_READY, event.node});
+            }
+            break;
+        }
+    }
+
+    result.events += nodes;
+    result.frames += frames.size();
+    for (const SimFrame &frame : frames) result.collided += frame.collided;
+    for (const SimNode &n : node) result.delivered += n.delivered;
+}
+
+static SimResult simulate(int nodes, uint32_t burstMs, bool cad) {
+    SimResult result = {};
+    for (uint32_t trial = 1; trial <= 200; trial++) simulateBurst(nodes, burstMs, cad, trial * 2654435761u, result);
+    return result;
+}
+
+static void report(const char *name, int nodes, uint32_t burstMs, const SimResult &result) {
+    printf("  %-5s %3d nodes in %5u ms: %5.1f%% frames collided, %5.1f%% delivered, %6.0f ms mean latency, %.2f frames per event\n",
+           name, nodes, (unsigned)burstMs, 100.0 * result.collided / result.frames, 100.0 * result.delivered / result.events,
+           result.delivered ? (double)result.latencyMs / result.delivered : 0.0, (double)result.frames / result.events);
+}
+
+static void testSharedChannel() {
+    const struct { int nodes; uint32_t burstMs; } cases[] = {{5, 2000}, {20, 2000}, {50, 30000}};
+    for (const auto &c : cases) {
+        SimResult aloha = simulate(c.nodes, c.burstMs, false);
+        SimResult lbt = simulate(c.nodes, c.burstMs, true);
+        report("ALOHA", c.nodes, c.burstMs, aloha);
+        report("LBT", c.nodes, c.burstMs, lbt);
+
+        // the CAD at least halves the collided frames and delivers no less
+        CHECK(lbt.collided * 2 < aloha.collided);
+        CHECK(lbt.delivered >= aloha.delivered);
+        CHECK(lbt.latencyMs / lbt.delivered < aloha.latencyMs / aloha.delivered);
+    }
+}
+
+int main() {
+    testBackoff();
+    testSharedChannel();
+    return checkResult("lbt");
+}
@@ -0,0 +1,226 @@
+/**
+ * @file test_mailbox_fsm.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Host test of the state machine of CtrlMailBox (mailbox_fsm.h): arrival,
+ * removal, glitches, opening and auto-close, driven every 10 ms like loop()
+ * with a model of the uplink, checking the events emitted.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <string.h>
+#include "mailbox_fsm.h"
+#include "check.h"
+
+#define STEP_MS 10
+
+// the sensors and the uplink seen by the state machine
+struct Bench {
+    MailboxFsm fsm;
+    MailboxInputs inputs;
+    uint32_t nowMs;
+    int emitted;
+    const char *lastEvent;
+    bool lastUrgent;
+    bool closed;        // an auto-close was requested
+    bool rebaselined;
+};
+
+static void benchInit(Bench &bench) {
+    memset(&bench, 0, sizeof(bench));
+    bench.nowMs = 1000;
+    mailboxFsmInit(bench.fsm, bench.nowMs);
+    bench.inputs.distanceReady = true;
+    bench.inputs.mailClass = MAIL_CLASS_TRANSIENT;
+    bench.inputs.eventStatus = MAILBOX_EVENT_DONE;
+}
+
+static void run(Bench &bench, uint32_t durationMs) {
+    for (uint32_t elapsed = 0; elapsed < durationMs; elapsed += STEP_MS) {
+        MailboxActions actions = mailboxFsmStep(bench.fsm, bench.inputs, bench.nowMs);
+        if (actions.event != nullptr) {
+            bench.emitted++;
+            bench.lastEvent = actions.event;
+            bench.lastUrgent = actions.urgent;
+            bench.inputs.eventStatus = MAILBOX_EVENT_QUEUED;
+        }
+        bench.closed = bench.closed || actions.close;
+        bench.rebaselined = bench.rebaselined || actions.rebaseline;
+        bench.nowMs += STEP_MS;
+    }
+}
+
+// the queued event goes on air after onAirMs and is acknowledged
+static void deliver(Bench &bench, uint32_t onAirMs) {
+    run(bench, onAirMs);
+    bench.inputs.eventStatus = MAILBOX_EVENT_ON_AIR;
+    run(bench, 200);
+    bench.inputs.eventStatus = MAILBOX_EVENT_DONE;
+    run(bench, STEP_MS);
+}
+
+static void testArrivalAndRemoval() {
+    Bench bench;
+    benchInit(bench);
+    run(bench, 500);
+    CHECK_EQ(bench.emitted, 0);
+
+    // a letter: the deviation lasts and is classified after MAILBOX_CONFIRM_MS
+    bench.inputs.deviation = true;
+    bench.inputs.mailClass = MAIL_CLASS_LETTER;
+    run(bench, MAILBOX_CONFIRM_MS - 100);
+    CHECK_EQ(bench.emitted, 0);
+    CHECK_EQ(bench.fsm.state, MAILBOX_SAMPLING);
+    run(bench, 200);
+    CHECK_EQ(bench.emitted, 1);
+    CHECK(strcmp(bench.lastEvent, "New Mail") == 0);
+    CHECK(bench.lastUrgent);
+    CHECK(bench.fsm.letterPresent);
+    CHECK_EQ(bench.fsm.state, MAILBOX_TRANSMITTING);
+
+    // latency from the first deviation to the frame on air
+    uint32_t startMs = bench.fsm.eventStartMs;
+    run(bench, 300);
+    bench.inputs.eventStatus = MAILBOX_EVENT_ON_AIR;
+    run(bench, STEP_MS);
+    CHECK_EQ(bench.fsm.state, MAILBOX_AWAITING_ACK);
+    CHECK_EQ(bench.fsm.lastLatencyMs, bench.nowMs - STEP_MS - startMs);
+    bench.inputs.eventStatus = MAILBOX_EVENT_DONE;
+    run(bench, STEP_MS);
+    CHECK_EQ(bench.fsm.state, MAILBOX_IDLE);
+
+    // the letter stays: no second event
+    run(bench, 5000);
+    CHECK_EQ(bench.emitted, 1);
+
+    // removed: the next letter is a new event
+    bench.inputs.deviation = false;
+    run(bench, 100);
+    CHECK(!bench.fsm.letterPresent);
+    CHECK_EQ(bench.emitted, 1);
+    bench.inputs.deviation = true;
+    run(bench, MAILBOX_CONFIRM_MS + 100);
+    CHECK_EQ(bench.emitted, 2);
+    CHECK_EQ(bench.fsm.events, 2);
+}
+
+static void testRejectedDeviations() {
+    Bench bench;
+    benchInit(bench);
+
+    // shorter than MAILBOX_CONFIRM_MS
+    bench.inputs.deviation = true;
+    bench.inputs.mailClass = MAIL_CLASS_LETTER;
+    run(bench, MAILBOX_CONFIRM_MS / 2);
+    bench.inputs.deviation = false;
+    run(bench, 1000);
+    CHECK_EQ(bench.emitted, 0);
+    CHECK_EQ(bench.fsm.state, MAILBOX_IDLE);
+
+    // a hand in the mailbox
+    bench.inputs.deviation = true;
+    bench.inputs.mailClass = MAIL_CLASS_TRANSIENT;
+    run(bench, MAILBOX_CONFIRM_MS + 100);
+    bench.inputs.deviation = false;
+    run(bench, 100);
+    CHECK_EQ(bench.emitted, 0);
+    CHECK_EQ(bench.fsm.transients, 1);
+
+    // a drift moves the baseline
+    bench.inputs.deviation = true;
+    bench.inputs.mailClass = MAIL_CLASS_DRIFT;
+    run(bench, MAILBOX_CONFIRM_MS + 100);
+    CHECK_EQ(bench.emitted, 0);
+    CHECK_EQ(bench.fsm.drifts, 1);
+    CHECK(bench.rebaselined);
+
+    // no distance yet: nothing is sampled
+    benchInit(bench);
+    bench.inputs.distanceReady = false;
+    bench.inputs.deviation = true;
+    bench.inputs.mailClass = MAIL_CLASS_LETTER;
+    run(bench, 2000);
+    CHECK_EQ(bench.emitted, 0);
+}
+
+static void testOpeningAndTimeout() {
+    Bench bench;
+    benchInit(bench);
+
+    // "Mailbox Opened" waits for the servo and is not urgent
+    bench.inputs.open = true;
+    run(bench, 500);
+    CHECK_EQ(bench.fsm.state, MAILBOX_OPEN);
+    CHECK_EQ(bench.emitted, 0);
+    bench.inputs.servoSettled = true;
+    run(bench, STEP_MS);
+    CHECK_EQ(bench.emitted, 1);
+    CHECK(strcmp(bench.lastEvent, "Mailbox Opened") == 0);
+    CHECK(!bench.lastUrgent);
+    deliver(bench, 1000);
+    CHECK_EQ(bench.fsm.state, MAILBOX_OPEN);
+
+    // once per opening
+    run(bench, 10000);
+    CHECK_EQ(bench.emitted, 1);
+
+    // left open: auto-close after MAILBOX_MAX_OPEN_MS from the opening
+    CHECK(!bench.closed);
+    run(bench, MAILBOX_MAX_OPEN_MS);
+    CHECK(bench.closed);
+    CHECK_EQ(bench.fsm.state, MAILBOX_AUTO_CLOSE);
+    bench.inputs.open = false;
+    bench.inputs.servoSettled = false;
+    run(bench, STEP_MS);
+    CHECK_EQ(bench.fsm.state, MAILBOX_IDLE);
+    CHECK_EQ(bench.emitted, 1);
+
+    // the auto-close does not wait for the ACK of "Mailbox Opened"
+    benchInit(bench);
+    bench.inputs.open = true;
+    bench.inputs.servoSettled = true;
+    run(bench, 2 * STEP_MS);
+    CHECK_EQ(bench.emitted, 1);
+    run(bench, MAILBOX_MAX_OPEN_MS + 100);
+    CHECK_EQ(bench.fsm.state, MAILBOX_TRANSMITTING);
+    CHECK(bench.closed);
+}
+
+static void testRefusedEvent() {
+    Bench bench;
+    benchInit(bench);
+    bench.inputs.deviation = true;
+    bench.inputs.mailClass = MAIL_CLASS_LETTER;
+    run(bench, MAILBOX_CONFIRM_MS + 100);
+    CHECK_EQ(bench.emitted, 1);
+    uint32_t startMs = bench.fsm.eventStartMs;
+
+    // the aggregator is full: the event stays pending and no latency is recorded
+    bench.inputs.eventStatus = MAILBOX_EVENT_REFUSED;
+    MailboxActions actions = mailboxFsmStep(bench.fsm, bench.inputs, bench.nowMs);
+    CHECK(actions.event != nullptr && strcmp(actions.event, "New Mail") == 0);
+    CHECK(actions.urgent);
+    CHECK_EQ(bench.fsm.state, MAILBOX_TRANSMITTING);
+    CHECK_EQ(bench.fsm.lastLatencyMs, 0);
+    CHECK_EQ(bench.fsm.events, 1);
+
+    // queued at the next attempt, the latency counts from the first deviation
+    bench.inputs.eventStatus = MAILBOX_EVENT_QUEUED;
+    run(bench, 2000);
+    CHECK_EQ(bench.fsm.state, MAILBOX_TRANSMITTING);
+    bench.inputs.eventStatus = MAILBOX_EVENT_ON_AIR;
+    run(bench, STEP_MS);
+    CHECK_EQ(bench.fsm.lastLatencyMs, bench.nowMs - STEP_MS - startMs);
+    CHECK_EQ(bench.fsm.events, 1);
+}
+
+int main() {
+    testArrivalAndRemoval();
+    testRejectedDeviations();
+    testOpeningAndTimeout();
+    testRefusedEvent();
+    return checkResult("mailbox_fsm");
+}
@@ -0,0 +1,213 @@
+/**
+ * @file test_power.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Host test of the deep sleep of CtrlMailBox (power.h) against a
+ * simulated clock and simulated wake sources.
+ *
+ * The simulated node runs loop() every LOOP_MS while awake and asks
+ * powerSleepDue() whether to sleep. As on the ESP32, millis() starts again
+ * from zero at every wake-up while the RTC clock keeps counting; the node
+ * wakes up at the end of the timer or earlier when the knob or the button
+ * is used.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <vector>
+#include "power.h"
+#include "check.h"
+
+#define LOOP_MS 10
+#define RESUME_MS 40    // from the wake-up to loop(): boot and restore of the retained state
+
+struct ExternalWake {
+    uint64_t atMs;      // RTC time
+    WakeSource source;
+};
+
+struct SimNode {
+    PowerManager power;
+    uint64_t rtcMs;         // never restarts
+    uint32_t millisMs;      // restarts at every wake-up
+    uint64_t awakeMs;
+    uint64_t asleepMs;
+    uint32_t sleeps;
+    uint64_t maxTimerGapMs; // longest time without a ranging burst
+    uint64_t lastBurstMs;
+    uint32_t sleptPastDeadline;
+};
+
+// busy and deadline of the firmware, as a function of the RTC time
+typedef PowerInputs (*Firmware)(const SimNode &node);
+
+static PowerInputs idleFirmware(const SimNode &) {
+    return {false, false, 0};
+}
+
+static void simInit(SimNode &node, uint32_t millisAtBoot) {
+    node = {};
+    node.millisMs = millisAtBoot;
+    powerInit(node.power, node.millisMs);
+}
+
+// runs the node until the RTC time endMs, with the external wake-ups in order
+static void simulate(SimNode &node, uint64_t endMs, const std::vector<ExternalWake> &wakes, Firmware firmware) {
+    size_t nextWake = 0;
+    while (node.rtcMs < endMs) {
+        PowerInputs inputs = firmware(node);
+        uint32_t sleepMs;
+        if (!powerSleepDue(node.power, inputs, node.millisMs, &sleepMs)) {
+            node.rtcMs += LOOP_MS;
+            node.millisMs += LOOP_MS;
+            node.awakeMs += LOOP_MS;
+            continue;
+        }
+
+        CHECK(sleepMs >= POWER_MIN_SLEEP_MS && sleepMs <= POWER_RANGING_PERIOD_MS);
+        if (inputs.hasDeadline && (int32_t)(node.millisMs + sleepMs - inputs.deadlineMs) > 0) node.sleptPastDeadline++;
+        node.sleeps++;
+
+        // the timer, or the knob/button if it comes first
+        uint64_t wakeAtMs = node.rtcMs + sleepMs;
+        WakeSource source = WAKE_TIMER;
+        while (nextWake < wakes.size() && wakes[nextWake].atMs <= node.rtcMs) nextWake++;
+        if (nextWake < wakes.size() && wakes[nextWake].atMs < wakeAtMs) {
+            wakeAtMs = wakes[nextWake].atMs;
+            source = wakes[nextWake].source;
+            nextWake++;
+        }
+        uint32_t sleptMs = (uint32_t)(wakeAtMs - node.rtcMs);
+        node.asleepMs += sleptMs;
+        node.rtcMs = wakeAtMs + RESUME_MS;
+        node.awakeMs += RESUME_MS;
+        node.millisMs = RESUME_MS;
+        powerOnWake(node.power, source, sleptMs, node.millisMs);
+
+        if (source == WAKE_TIMER) {
+            if (node.lastBurstMs != 0 && node.rtcMs - node.lastBurstMs > node.maxTimerGapMs) {
+                node.maxTimerGapMs = node.rtcMs - node.lastBurstMs;
+            }
+            node.lastBurstMs = node.rtcMs;
+        }
+    }
+}
+
+static void testIdleHour() {
+    SimNode node;
+    simInit(node, 500);
+    std::vector<ExternalWake> none;
+    simulate(node, POWER_BOOT_AWAKE_MS - 1000, none, idleFirmware);
+    // awake for the whole boot time
+    CHECK_EQ(node.sleeps, 0);
+
+    simulate(node, POWER_BOOT_AWAKE_MS + 3600000ULL, none, idleFirmware);
+    double awake = (double)node.awakeMs / (node.awakeMs + node.asleepMs);
+    double idleAwake = (double)node.awakeMs - POWER_BOOT_AWAKE_MS;
+    double idleShare = idleAwake / (idleAwake + node.asleepMs);
+    printf("  idle hour: %u sleeps, %.1f%% awake (%.1f%% after the boot time), longest gap between bursts %u ms\n",
+           (unsigned)node.sleeps, awake * 100, idleShare * 100, (unsigned)node.maxTimerGapMs);
+
+    // one burst of POWER_BURST_MS every POWER_RANGING_PERIOD_MS of sleep
+    double expected = (double)(POWER_BURST_MS + RESUME_MS) / (POWER_BURST_MS + RESUME_MS + POWER_RANGING_PERIOD_MS);
+    CHECK(idleShare < expected + 0.01 && idleShare > expected - 0.01);
+    CHECK(node.maxTimerGapMs <= POWER_RANGING_PERIOD_MS + POWER_BURST_MS + RESUME_MS + LOOP_MS);
+    CHECK_EQ(node.power.wakes[WAKE_TIMER], node.sleeps);
+    CHECK_EQ(node.power.sleptMs, node.asleepMs);
+    CHECK_EQ(node.power.sleeps, node.sleeps);
+}
+
+static void testInputWakes() {
+    SimNode node;
+    simInit(node, 500);
+    uint64_t start = POWER_BOOT_AWAKE_MS + 10000;
+    std::vector<ExternalWake> wakes = {
+        {start + 2000, WAKE_KNOB},
+        {start + 60000, WAKE_BUTTON},
+        {start + 60000 + POWER_INPUT_AWAKE_MS + 7000, WAKE_KNOB},
+    };
+    simulate(node, start, wakes, idleFirmware);
+    uint32_t sleepsBefore = node.sleeps;
+
+    // the knob wakes the node at once and keeps it awake for POWER_INPUT_AWAKE_MS
+    simulate(node, start + 2000 + POWER_INPUT_AWAKE_MS - 100, wakes, idleFirmware);
+    CHECK_EQ(node.power.wakes[WAKE_KNOB], 1);
+    CHECK_EQ(node.power.lastWake, WAKE_KNOB);
+    CHECK_EQ(node.sleeps, sleepsBefore + 1);
+
+    simulate(node, start + 200000, wakes, idleFirmware);
+    CHECK_EQ(node.power.wakes[WAKE_KNOB], 2);
+    CHECK_EQ(node.power.wakes[WAKE_BUTTON], 1);
+    CHECK(wakeSourceName(WAKE_BUTTON)[0] == 'b');
+
+    // a reset is a cold start: the counters start again and the boot time applies
+    powerOnWake(node.power, WAKE_POWER_ON, 0, 100);
+    CHECK_EQ(node.power.wakes[WAKE_KNOB], 0);
+    CHECK_EQ(node.power.wakes[WAKE_POWER_ON], 1);
+    uint32_t sleepMs;
+    PowerInputs idle = {false, false, 0};
+    CHECK(!powerSleepDue(node.power, idle, 100 + POWER_BOOT_AWAKE_MS - 1, &sleepMs));
+    CHECK(powerSleepDue(node.power, idle, 100 + POWER_BOOT_AWAKE_MS, &sleepMs));
+}
+
+// an event keeps the node busy for 3 s every 2 minutes, a retransmission is due 1.2 s after it
+static PowerInputs busyFirmware(const SimNode &node) {
+    uint64_t phase = node.rtcMs % 120000;
+    PowerInputs inputs = {phase < 3000, false, 0};
+    if (phase >= 3000 && phase < 4200) {
+        inputs.hasDeadline = true;
+        inputs.deadlineMs = node.millisMs + (uint32_t)(4200 - phase);
+    }
+    return inputs;
+}
+
+static void testBusyAndDeadlines() {
+    SimNode node;
+    simInit(node, 500);
+    std::vector<ExternalWake> none;
+    simulate(node, POWER_BOOT_AWAKE_MS + 3600000ULL, none, busyFirmware);
+    CHECK_EQ(node.sleptPastDeadline, 0);
+    CHECK(node.sleeps > 0);
+
+    // never asleep while busy, and not for a pause shorter than POWER_MIN_SLEEP_MS
+    PowerManager power;
+    powerInit(power, 0);
+    uint32_t sleepMs;
+    uint32_t now = POWER_BOOT_AWAKE_MS;
+    PowerInputs busy = {true, false, 0};
+    CHECK(!powerSleepDue(power, busy, now, &sleepMs));
+    PowerInputs soon = {false, true, (uint32_t)(now + POWER_MIN_SLEEP_MS - 1)};
+    CHECK(!powerSleepDue(power, soon, now, &sleepMs));
+    PowerInputs late = {false, true, now - 10};
+    CHECK(!powerSleepDue(power, late, now, &sleepMs));
+    PowerInputs deadline = {false, true, now + 1234};
+    CHECK(powerSleepDue(power, deadline, now, &sleepMs));
+    CHECK_EQ(sleepMs, 1234);
+    PowerInputs far = {false, true, now + (uint32_t)(10 * POWER_RANGING_PERIOD_MS)};
+    CHECK(powerSleepDue(power, far, now, &sleepMs));
+    CHECK_EQ(sleepMs, POWER_RANGING_PERIOD_MS);
+}
+
+static void testClockWrap() {
+    // millis() close to the wrap-around: the comparisons are modular
+    PowerManager power;
+    uint32_t now = 0xFFFFFFFFu - 100;
+    powerOnWake(power, WAKE_TIMER, 5000, now);
+    uint32_t sleepMs;
+    PowerInputs idle = {false, false, 0};
+    CHECK(!powerSleepDue(power, idle, now + 200, &sleepMs));
+    CHECK(powerSleepDue(power, idle, now + POWER_BURST_MS, &sleepMs));
+    PowerInputs deadline = {false, true, (uint32_t)(now + POWER_BURST_MS + 1000)};
+    CHECK(powerSleepDue(power, deadline, now + POWER_BURST_MS, &sleepMs));
+    CHECK_EQ(sleepMs, 1000);
+}
+
+int main() {
+    testIdleHour();
+    testInputWakes();
+    testBusyAndDeadlines();
+    testClockWrap();
+    return checkResult("power");
+}
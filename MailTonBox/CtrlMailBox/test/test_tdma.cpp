@@ -0,0 +1,359 @@
+/**
+ * @file test_tdma.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Host test of the TDMA schedule (tdma.h): slot arithmetic, beacon,
+ * windows, and the capacity of the channel compared with random access.
+ *
+ * Capacity model: Poisson traffic with a mean interval of 60 s per node over
+ * 2 h, 103 ms frames (53 B) and 108 ms ACKs (58 B). With TDMA every node
+ * sends one frame per cycle in its own slot from a queue of ARQ_QUEUE_SIZE.
+ * With ALOHA a node sends at once and waits for the ACK; a frame or an ACK
+ * that overlaps another transmission is lost and the ARQ retries with its
+ * doubling timeouts and 50% jitter, up to ARQ_MAX_RETRIES transmissions.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <math.h>
+#include <queue>
+#include <vector>
+#include "tdma.h"
+#include "arq.h"
+#include "check.h"
+
+#define TYPICAL_UPLINK_LENGTH 53
+#define TYPICAL_REPLY_LENGTH 58
+#define MEAN_INTERVAL_MS 60000.0
+#define SIMULATION_MS 7200000.0
+#define REPLY_TURNAROUND_MS 20.0
+
+static void testSlotArithmetic() {
+    // the slot holds the longest frame and the longest reply, with guards and turnaround
+    uint32_t exchangeMs = 2 * TDMA_GUARD_MS + TDMA_TX_WINDOW_MS + TDMA_TURNAROUND_MS +
+                          loraTimeOnAirMs(TDMA_MAX_UPLINK_LENGTH) + loraTimeOnAirMs(TDMA_MAX_REPLY_LENGTH);
+    CHECK_EQ(TDMA_MAX_REPLY_LENGTH, 70);
+    CHECK_EQ(loraTimeOnAirMs(TDMA_MAX_UPLINK_LENGTH), 165);
+    CHECK_EQ(loraTimeOnAirMs(TDMA_MAX_REPLY_LENGTH), 124);
+    CHECK(tdmaSlotMs() >= exchangeMs);
+    CHECK(tdmaSlotMs() < exchangeMs + TDMA_SLOT_ROUND_MS);
+    CHECK_EQ(tdmaSlotMs() % TDMA_SLOT_ROUND_MS, 0);
+    CHECK_EQ(tdmaSlotMs(), 450);
+
+    // device slots skip slot 0 of every period, in order and without gaps
+    const uint8_t periods[] = {2, 3, TDMA_CONTENTION_PERIOD};
+    for (uint8_t period : periods) {
+        uint16_t expected = 1;
+        for (uint16_t device = 0; device < TDMA_MAX_DEVICES; device++) {
+            if (expected % period == 0) expected++;
+            CHECK_EQ(tdmaDeviceSlot(device, period), expected);
+            expected++;
+        }
+    }
+    CHECK_EQ(tdmaDeviceSlot(0, 8), 1);
+    CHECK_EQ(tdmaDeviceSlot(6, 8), 7);
+    CHECK_EQ(tdmaDeviceSlot(7, 8), 9);
+    CHECK_EQ(tdmaDeviceSlot(13, 8), 15);
+    CHECK_EQ(tdmaDeviceSlot(14, 8), 17);
+
+    // a cycle ends with the last device slot and has one contention slot per period started
+    CHECK_EQ(tdmaSlotCount(0, 8), 1);
+    CHECK_EQ(tdmaSlotCount(1, 8), 2);
+    CHECK_EQ(tdmaSlotCount(7, 8), 8);
+    CHECK_EQ(tdmaSlotCount(8, 8), 10);
+    CHECK_EQ(tdmaSlotCount(14, 8), 16);
+    CHECK_EQ(tdmaSlotCount(15, 8), 18);
+    for (uint16_t devices = 1; devices <= TDMA_MAX_DEVICES; devices++) {
+        uint16_t count = tdmaSlotCount(devices, TDMA_CONTENTION_PERIOD);
+        uint16_t contention = (count + TDMA_CONTENTION_PERIOD - 1) / TDMA_CONTENTION_PERIOD;
+        CHECK_EQ(count, devices + contention);
+
+        uint32_t periodMs = tdmaBeaconPeriodMs(devices);
+        uint32_t cycleMs = (uint32_t)count * tdmaSlotMs();
+        CHECK_EQ(periodMs % cycleMs, 0);
+        CHECK(periodMs >= TDMA_BEACON_INTERVAL_MS);
+        CHECK(periodMs < TDMA_BEACON_INTERVAL_MS + cycleMs);
+    }
+}
+
+static void testBeaconAndWindows() {
+    uint8_t addresses[10] = {11, 12, 13, 14, 15, 16, 17, 18, 19, 20};
+    uint8_t beacon[TDMA_BEACON_FIXED_LENGTH + 10];
+    CHECK_EQ(tdmaBuildBeacon(beacon, sizeof(beacon), addresses, 10), sizeof(beacon));
+    CHECK_EQ(tdmaBuildBeacon(beacon, sizeof(beacon) - 1, addresses, 10), 0);
+
+    const uint32_t beaconAt = 5000;
+    const uint32_t slotMs = tdmaSlotMs();
+    TdmaSync sync = {};
+    CHECK(tdmaParseBeacon(sync, beacon, sizeof(beacon), 19, beaconAt));
+    CHECK_EQ(sync.slotMs, slotMs);
+    CHECK_EQ(sync.slotCount, 12);
+    CHECK_EQ(sync.ownSlot, 10);  // the 9th device comes after the contention slot 8
+    CHECK_EQ(sync.intervalMs, (tdmaBeaconPeriodMs(10) + 999) / 1000 * 1000);
+
+    // a frame starts only within TDMA_TX_WINDOW_MS after the guard
+    uint32_t ownStart = beaconAt + 10 * slotMs;
+    CHECK_EQ(tdmaWindow(sync, ownStart + TDMA_GUARD_MS - 1), TDMA_OTHER_SLOT);
+    CHECK_EQ(tdmaWindow(sync, ownStart + TDMA_GUARD_MS), TDMA_OWN_SLOT);
+    CHECK_EQ(tdmaWindow(sync, ownStart + TDMA_GUARD_MS + TDMA_TX_WINDOW_MS), TDMA_OWN_SLOT);
+    CHECK_EQ(tdmaWindow(sync, ownStart + TDMA_GUARD_MS + TDMA_TX_WINDOW_MS + 1), TDMA_OTHER_SLOT);
+    CHECK_EQ(tdmaWindow(sync, beaconAt + TDMA_GUARD_MS), TDMA_CONTENTION);
+    CHECK_EQ(tdmaWindow(sync, beaconAt + 8 * slotMs + TDMA_GUARD_MS), TDMA_CONTENTION);
+    CHECK_EQ(tdmaWindow(sync, beaconAt + 3 * slotMs + TDMA_GUARD_MS), TDMA_OTHER_SLOT);
+    // the cycle repeats until the next beacon
+    uint32_t cycleMs = 12 * slotMs;
+    CHECK_EQ(tdmaWindow(sync, ownStart + 3 * cycleMs + TDMA_GUARD_MS), TDMA_OWN_SLOT);
+    // back to random access after TDMA_BEACON_LOST_LIMIT lost beacons
+    CHECK_EQ(tdmaWindow(sync, beaconAt + sync.intervalMs * TDMA_BEACON_LOST_LIMIT + cycleMs), TDMA_UNSYNCED);
+
+    // not in the beacon: contention slots only
+    TdmaSync other = {};
+    CHECK(tdmaParseBeacon(other, beacon, sizeof(beacon), 99, beaconAt));
+    CHECK_EQ(other.ownSlot, -1);
+    CHECK_EQ(tdmaWindow(other, ownStart + TDMA_GUARD_MS), TDMA_OTHER_SLOT);
+
+    // end of the slot of an uplink, and contention-only intervals
+    uint32_t endMs;
+    CHECK(tdmaSlotEnd(sync, ownStart + 200, &endMs));
+    CHECK_EQ(endMs, ownStart + slotMs);
+    CHECK(tdmaContentionOnly(sync, beaconAt + 10, beaconAt + slotMs - 10));
+    CHECK(!tdmaContentionOnly(sync, beaconAt + 10, beaconAt + slotMs + 10));
+    CHECK(!tdmaContentionOnly(sync, beaconAt + 7 * slotMs + 10, beaconAt + 8 * slotMs + 10));
+    CHECK(tdmaContentionOnly(sync, beaconAt + cycleMs + 10, beaconAt + cycleMs + 100));
+
+    // the rest of an owned slot, after the uplink its CtrlMailBox may send
+    uint32_t uplinkEnd = 2 * TDMA_GUARD_MS + TDMA_TX_WINDOW_MS + loraTimeOnAirMs(TDMA_MAX_UPLINK_LENGTH);
+    CHECK(!tdmaUplinkFree(sync, ownStart + TDMA_GUARD_MS, ownStart + TDMA_GUARD_MS + 100));
+    CHECK(!tdmaUplinkFree(sync, ownStart + uplinkEnd - 1, ownStart + uplinkEnd + 100));
+    CHECK(tdmaUplinkFree(sync, ownStart + uplinkEnd, ownStart + slotMs - 1));
+    CHECK(!tdmaUplinkFree(sync, ownStart + uplinkEnd, ownStart + slotMs + 10));
+    // through the contention slot 8, up to the uplink of slot 9
+    CHECK(tdmaUplinkFree(sync, beaconAt + 7 * slotMs + uplinkEnd, beaconAt + 9 * slotMs - 10));
+    CHECK(!tdmaUplinkFree(sync, beaconAt + 7 * slotMs + uplinkEnd, beaconAt + 9 * slotMs + 10));
+
+    // no schedule: no slot to respect
+    TdmaSync none = {};
+    CHECK(!tdmaSlotEnd(none, 100, &endMs));
+    CHECK(tdmaContentionOnly(none, 100, 10000));
+    CHECK(tdmaUplinkFree(none, 100, 10000));
+    CHECK_EQ(tdmaWindow(none, 100), TDMA_UNSYNCED);
+}
+
+static uint32_t randomState = 1;
+
+static double uniform() {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return (randomState + 0.5) / 4294967296.0;
+}
+
+static double exponential(double mean) {
+    return -mean * log(uniform());
+}
+
+struct CapacityResult {
+    double delivered;       // fraction of the events
+    double throughput;      // frames per second
+};
+
+static CapacityResult simulateTdma(int nodes) {
+    // the schedule each node learns from the beacon
+    std::vector<uint8_t> addresses(nodes);
+    for (int i = 0; i < nodes; i++) addresses[i] = i + 1;
+    uint8_t beacon[TDMA_BEACON_FIXED_LENGTH + TDMA_MAX_DEVICES];
+    size_t length = tdmaBuildBeacon(beacon, sizeof(beacon), addresses.data(), nodes);
+
+    uint32_t generated = 0, delivered = 0;
+    randomState = 1;
+    for (int node = 0; node < nodes; node++) {
+        TdmaSync sync = {};
+        tdmaParseBeacon(sync, beacon, length, addresses[node], 0);
+        uint32_t cycleMs = (uint32_t)sync.slotCount * sync.slotMs;
+        uint32_t beaconPeriodMs = tdmaBeaconPeriodMs(nodes);
+
+        std::vector<double> arrivals;
+        for (double t = exponential(MEAN_INTERVAL_MS); t < SIMULATION_MS; t += exponential(MEAN_INTERVAL_MS)) arrivals.push_back(t);
+        generated += arrivals.size();
+
+        // one frame at the start of every own slot
+        size_t next = 0;
+        std::vector<double> queue;
+        for (uint32_t startMs = sync.ownSlot * sync.slotMs + TDMA_GUARD_MS; startMs < SIMULATION_MS; startMs += cycleMs) {
+            // a new beacon at the end of every beacon period keeps the same schedule
+            sync.beaconAtMs = startMs / beaconPeriodMs * beaconPeriodMs;
+            CHECK_EQ(tdmaWindow(sync, startMs), TDMA_OWN_SLOT);
+            while (next < arrivals.size() && arrivals[next] <= startMs) {
+                if (queue.size() < ARQ_QUEUE_SIZE) queue.push_back(arrivals[next]);
+                next++;
+            }
+            if (!queue.empty()) {
+                queue.erase(queue.begin());
+                delivered++;
+            }
+        }
+    }
+    return {(double)delivered / generated, delivered / (SIMULATION_MS / 1000)};
+}
+
+enum AlohaEventType : uint8_t { ALOHA_GENERATE, ALOHA_TX, ALOHA_UPLINK_END, ALOHA_ACK_END, ALOHA_TIMEOUT, ALOHA_RESUME };
+
+struct AlohaEvent {
+    double timeMs;
+    AlohaEventType type;
+    int node;
+    bool operator>(const AlohaEvent &other) const { return timeMs > other.timeMs; }
+};
+
+struct AlohaTransmission {
+    double startMs;
+    double endMs;
+    int node;           // -1 for MailTon
+};
+
+struct AlohaNode {
+    std::vector<double> queue;  // time of the events waiting
+    bool inFlight;
+    int tries;
+    double idleFromMs;          // ARQ_TX_GAP_MS after the last ACK
+};
+
+static CapacityResult simulateAloha(int nodes) {
+    const double uplinkMs = loraTimeOnAirMs(TYPICAL_UPLINK_LENGTH);
+    const double ackMs = loraTimeOnAirMs(TYPICAL_REPLY_LENGTH);
+    std::vector<AlohaNode> node(nodes, AlohaNode{{}, false, 0, 0});
+    std::vector<AlohaTransmission> air;
+    std::priority_queue<AlohaEvent, std::vector<AlohaEvent>, std::greater<AlohaEvent>> events;
+    uint32_t generated = 0, delivered = 0;
+
+    randomState = 1;
+    for (int i = 0; i < nodes; i++) events.push({exponential(MEAN_INTERVAL_MS), ALOHA_GENERATE, i});
+
+    auto overlaps = [&](double startMs, double endMs, int self) {
+        for (const AlohaTransmission &t : air) {
+            if (t.node != self && t.startMs < endMs && startMs < t.endMs) return true;
+        }
+        return false;
+    };
+    auto trySend = [&](int i, double nowMs) {
+        AlohaNode &n = node[i];
+        if (!n.inFlight && !n.queue.empty() && nowMs >= n.idleFromMs) {
+            n.inFlight = true;
+            n.tries = 0;
+            events.push({nowMs, ALOHA_TX, i});
+        }
+    };
+    auto retry = [&](int i, double nowMs) {
+        double timeoutMs = ARQ_BASE_TIMEOUT_MS * pow(2, node[i].tries - 1);
+        if (timeoutMs > ARQ_MAX_TIMEOUT_MS) timeoutMs = ARQ_MAX_TIMEOUT_MS;
+        events.push({nowMs + timeoutMs * (1 + 0.5 * uniform()), ALOHA_TIMEOUT, i});
+    };
+
+    while (!events.empty()) {
+        AlohaEvent event = events.top();
+        events.pop();
+        if (event.timeMs > SIMULATION_MS) break;
+        AlohaNode &n = node[event.node];
+        // only the recent transmissions can overlap
+        size_t kept = 0;
+        for (const AlohaTransmission &t : air) {
+            if (t.endMs > event.timeMs - 2000) air[kept++] = t;
+        }
+        air.resize(kept);
+
+        switch (event.type) {
+        case ALOHA_GENERATE:
+            generated++;
+            if (n.queue.size() < ARQ_QUEUE_SIZE) n.queue.push_back(event.timeMs);
+            events.push({event.timeMs + exponential(MEAN_INTERVAL_MS), ALOHA_GENERATE, event.node});
+            trySend(event.node, event.timeMs);
+            break;
+
+        case ALOHA_TX:
+            n.tries++;
+            air.push_back({event.timeMs, event.timeMs + uplinkMs, event.node});
+            events.push({event.timeMs + uplinkMs, ALOHA_UPLINK_END, event.node});
+            break;
+
+        case ALOHA_UPLINK_END: {
+            double ackStart = event.timeMs + REPLY_TURNAROUND_MS, ackEnd = ackStart + ackMs;
+            bool ok = !overlaps(event.timeMs - uplinkMs, event.timeMs, event.node);
+            // MailTon answers one frame at a time
+            for (const AlohaTransmission &t : air) {
+                if (t.node == -1 && t.startMs < ackEnd && ackStart < t.endMs) ok = false;
+            }
+            if (ok) {
+                air.push_back({ackStart, ackEnd, -1});
+                events.push({ackEnd, ALOHA_ACK_END, event.node});
+            } else {
+                retry(event.node, event.timeMs);
+            }
+            break;
+        }
+
+        case ALOHA_ACK_END:
+            if (overlaps(event.timeMs - ackMs, event.timeMs, -1)) {
+                retry(event.node, event.timeMs);
+                break;
+            }
+            n.queue.erase(n.queue.begin());
+            n.inFlight = false;
+            delivered++;
+            n.idleFromMs = event.timeMs + ARQ_TX_GAP_MS;
+            events.push({n.idleFromMs, ALOHA_RESUME, event.node});
+            break;
+
+        case ALOHA_TIMEOUT:
+            if (n.tries < ARQ_MAX_RETRIES) {
+                events.push({event.timeMs, ALOHA_TX, event.node});
+                break;
+            }
+            n.queue.erase(n.queue.begin());
+            n.inFlight = false;
+            trySend(event.node, event.timeMs);
+            break;
+
+        case ALOHA_RESUME:
+            trySend(event.node, event.timeMs);
+            break;
+        }
+    }
+    return {(double)delivered / generated, delivered / (SIMULATION_MS / 1000)};
+}
+
+static void testCapacity() {
+    // every slot but the contention ones carries a frame
+    double capacity = (1 - 1.0 / TDMA_CONTENTION_PERIOD) * 1000 / tdmaSlotMs();
+    printf("  TDMA capacity %.2f frames/s\n", capacity);
+    printf("  nodes  ALOHA delivered  TDMA delivered  TDMA throughput  cycle\n");
+
+    const int nodeCounts[] = {10, 50, 100, 150};
+    CapacityResult tdma[4], aloha[4];
+    for (int i = 0; i < 4; i++) {
+        tdma[i] = simulateTdma(nodeCounts[i]);
+        aloha[i] = simulateAloha(nodeCounts[i]);
+        printf("  %5d  %14.0f%%  %13.0f%%  %9.2f frames/s  %4.1f s\n", nodeCounts[i], aloha[i].delivered * 100,
+               tdma[i].delivered * 100, tdma[i].throughput,
+               tdmaSlotCount(nodeCounts[i], TDMA_CONTENTION_PERIOD) * tdmaSlotMs() / 1000.0);
+        CHECK(tdma[i].throughput < capacity);
+    }
+
+    // below saturation TDMA delivers everything, ALOHA collapses past ~100 nodes
+    CHECK(tdma[0].delivered > 0.99 && tdma[1].delivered > 0.99);
+    CHECK(aloha[0].delivered > 0.99 && aloha[1].delivered > 0.95);
+    CHECK(tdma[2].delivered > 0.95);
+    CHECK(aloha[2].delivered < 0.75 && aloha[3].delivered < 0.5);
+    CHECK(tdma[2].delivered > aloha[2].delivered + 0.3);
+    CHECK(tdma[3].delivered > aloha[3].delivered + 0.3);
+    // past saturation the throughput is close to the capacity
+    CHECK(tdma[3].throughput > 0.95 * capacity);
+}
+
+int main() {
+    testSlotArithmetic();
+    testBeaconAndWindows();
+    testCapacity();
+    return checkResult("tdma");
+}
@@ -0,0 +1,70 @@
+"""
+@file make_traces.py
+@author Alessandro Ferrante (github@alessandroferrante.net)
+@brief Writes distance_traces.csv, the ultrasonic traces replayed by test_distance_filter.cpp.
+
+One measure every 60 ms (ULTRASONIC_PERIOD_MS), in the --traces format of
+mail_model.py: label,cm,cm,... with an empty field for a lost echo. Each
+trace is preceded by a comment with its ground truth, read by the test:
+  # name=... empty=<cm at the start> drift=<cm over the trace> step=<cm> from=<ms> to=<ms> lost=<p> reflections=<p>
+The empty mailbox drifts linearly, a letter moves the distance by `step`
+between `from` and `to` (step 0: no letter). Lost echoes and spurious
+reflections (a closer echo, sometimes two in a row) are the outliers the
+median must reject. Recorded captures can be appended in the same format.
+
+usage: python3 make_traces.py [--output distance_traces.csv]
+@version 0.1
+@date 2026-10-19
+@copyright Copyright (c) 2026
+"""
+
+import argparse
+import random
+
+PERIOD_MS = 60
+MAX_DISTANCE = 100
+
+TRACES = [
+    # name, label, seconds, empty cm, drift cm, step cm, from ms, to ms, lost, reflections, sigma, seed
+    ("letter_removal", "letter", 180, 31.0, 0.5, -4.0, 40000, 140000, 0.03, 0.01, 1.0, 1),
+    ("thick_letter", "letter", 120, 22.0, 0.0, -9.0, 30000, 90000, 0.03, 0.01, 0.8, 2),
+    ("slow_drift", "drift", 900, 28.0, 3.0, 0.0, 0, 0, 0.03, 0.01, 1.0, 3),
+    ("outliers", "transient", 180, 25.0, 0.0, 0.0, 0, 0, 0.10, 0.02, 1.2, 4),
+]
+
+
+def trace(seconds, empty, drift, step, start, end, lost, reflections, sigma, seed):
+    rng = random.Random(seed)
+    samples = seconds * 1000 // PERIOD_MS
+    values = []
+    echo = 0    # measures left in a burst of reflections
+    for i in range(samples):
+        t = i * PERIOD_MS
+        truth = empty + drift * i / samples + (step if start <= t < end else 0.0)
+        if rng.random() < lost:
+            values.append("")
+            continue
+        if echo == 0 and rng.random() < reflections:
+            echo = 2 if rng.random() < 0.25 else 1
+        if echo > 0:
+            echo -= 1
+            values.append(str(int(round(rng.uniform(5, truth - 5)))))
+            continue
+        cm = int(round(truth + rng.gauss(0, sigma)))
+        values.append(str(cm if 0 < cm < MAX_DISTANCE else MAX_DISTANCE))
+    return values
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[3])
+    parser.add_argument("--output", default="distance_traces.csv")
+    args = parser.parse_args()
+    with open(args.output, "w") as out:
+        for name, label, seconds, empty, drift, step, start, end, lost, reflections, sigma, seed in TRACES:
+            out.write("# name=%s empty=%.1f drift=%.1f step=%.1f from=%d to=%d lost=%.2f reflections=%.2f\n"
+                      % (name, empty, drift, step, start, end, lost, reflections))
+            out.write(label + "," + ",".join(trace(seconds, empty, drift, step, start, end, lost, reflections, sigma, seed)) + "\n")
+
+
+if __name__ == "__main__":
+    main()
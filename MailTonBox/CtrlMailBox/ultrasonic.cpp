@@ -0,0 +1,105 @@
+/**
+ * @file ultrasonic.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Non-blocking ranging with the ultrasonic sensor of CtrlMailBox (see ultrasonic.h).
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <Arduino.h>
+#include "esp_timer.h"
+#include "ultrasonic.h"
+
+static uint8_t trig;
+static uint8_t echo;
+static esp_timer_handle_t triggerTimer = nullptr;
+
+// written by the echo interrupt
+static volatile uint32_t echoStartUs = 0;
+static volatile uint32_t echoEndUs = 0;
+static volatile bool echoStarted = false;
+static volatile bool echoDone = false;
+
+static bool measuring = false;
+static uint32_t triggerMs = 0;
+
+static UltrasonicSample buffer[ULTRASONIC_BUFFER_SIZE];
+// single producer, single consumer: each index is written by one side and published with release,
+// the other side reads it with acquire before touching the slot (as the queue of packet_pool.cpp)
+static uint32_t head = 0;   // next slot written by the timer task
+static uint32_t tail = 0;   // next slot read by loop()
+static UltrasonicStats stats = {};
+
+// same conversion of the old pulseIn() code: 58 us per cm, no echo or too far is out of range
+static int16_t echoToCm(uint32_t echoUs) {
+    uint32_t cm = echoUs / 58;
+    return (cm > 0 && cm < ULTRASONIC_MAX_DISTANCE) ? cm : ULTRASONIC_MAX_DISTANCE;
+}
+
+static void IRAM_ATTR onEcho() {
+    uint32_t now = micros();
+    if (digitalRead(echo) == HIGH) {
+        echoStartUs = now;
+        echoStarted = true;
+    } else if (echoStarted) {
+        echoEndUs = now;
+        echoDone = true;
+    }
+}
+
+// timer task: stores the measure of the previous trigger, then triggers the next one
+static void onTrigger(void *) {
+    if (measuring) {
+        uint32_t echoUs = echoDone ? echoEndUs - echoStartUs : 0;
+        if (echoUs > 0xFFFF) echoUs = 0;
+        if (echoUs == 0) stats.timeouts++;
+
+        uint32_t writeAt = __atomic_load_n(&head, __ATOMIC_RELAXED);
+        if (writeAt - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) >= ULTRASONIC_BUFFER_SIZE) {
+            stats.overruns++;
+        } else {
+            buffer[writeAt % ULTRASONIC_BUFFER_SIZE] = {triggerMs, (uint16_t)echoUs, echoToCm(echoUs)};
+            __atomic_store_n(&head, writeAt + 1, __ATOMIC_RELEASE);
+            stats.samples++;
+        }
+    }
+
+    echoStarted = false;
+    echoDone = false;
+    measuring = true;
+    triggerMs = millis();
+    digitalWrite(trig, HIGH);
+    delayMicroseconds(10);
+    digitalWrite(trig, LOW);
+}
+
+bool ultrasonicBegin(uint8_t trigPin, uint8_t echoPin) {
+    trig = trigPin;
+    echo = echoPin;
+    pinMode(trig, OUTPUT);
+    digitalWrite(trig, LOW);
+    pinMode(echo, INPUT);
+    attachInterrupt(digitalPinToInterrupt(echo), onEcho, CHANGE);
+
+    esp_timer_create_args_t timerArgs = {};
+    timerArgs.callback = onTrigger;
+    timerArgs.dispatch_method = ESP_TIMER_TASK;
+    timerArgs.name = "ultrasonic";
+    if (esp_timer_create(&timerArgs, &triggerTimer) != ESP_OK) return false;
+    return esp_timer_start_periodic(triggerTimer, ULTRASONIC_PERIOD_MS * 1000ULL) == ESP_OK;
+}
+
+bool ultrasonicRead(UltrasonicSample &sample) {
+    uint32_t readAt = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+    if (readAt == __atomic_load_n(&head, __ATOMIC_ACQUIRE)) return false;
+    sample = buffer[readAt % ULTRASONIC_BUFFER_SIZE];
+    __atomic_store_n(&tail, readAt + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+const UltrasonicStats &ultrasonicStats() {
+    return stats;
+}
@@ -0,0 +1,46 @@
+/**
+ * @file ultrasonic.h
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Non-blocking ranging with the ultrasonic sensor (HC-SR04) of CtrlMailBox.
+ *
+ * A periodic esp_timer sends the trigger pulse, an interrupt on both edges
+ * of the echo pin takes the time of the echo, and at the next period the
+ * timer stores the measure of the previous trigger (or a timeout) in a ring
+ * buffer. loop() only reads the buffer, it never waits for the sensor.
+ * The ring buffer has a single producer (the timer task) and a single
+ * consumer (loop()), so it needs no lock.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef ULTRASONIC_H
+#define ULTRASONIC_H
+
+#include <stdint.h>
+
+#define ULTRASONIC_PERIOD_MS 60        // trigger period, the echo of the previous pulse must have faded
+#define ULTRASONIC_BUFFER_SIZE 32      // power of two
+#define ULTRASONIC_MAX_DISTANCE 100    // cm, value of the measures out of range (as the old pulseIn() code)
+
+struct UltrasonicSample {
+    uint32_t atMs;      // trigger time
+    uint16_t echoUs;    // width of the echo pulse, 0 if it did not come
+    int16_t cm;         // distance, ULTRASONIC_MAX_DISTANCE if out of range
+};
+
+struct UltrasonicStats {
+    uint32_t samples;   // measures stored in the buffer
+    uint32_t timeouts;  // triggers without a complete echo
+    uint32_t overruns;  // measures lost because loop() did not read the buffer in time
+};
+
+// configures the pins and starts the periodic trigger
+bool ultrasonicBegin(uint8_t trigPin, uint8_t echoPin);
+// oldest measure not yet read, false if the buffer is empty
+bool ultrasonicRead(UltrasonicSample &sample);
+const UltrasonicStats &ultrasonicStats();
+
+#endif
@@ -0,0 +1,171 @@
+/**
+ * @file uplink.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Aggregation of the events and of the telemetry of CtrlMailBox (see uplink.h).
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <string.h>
+#include "uplink.h"
+
+static UplinkEvent events[UPLINK_MAX_EVENTS];
+static int eventCount = 0;
+static TelemetrySample samples[TELEMETRY_MAX_SAMPLES]; // ring buffer, oldest sample at sampleHead
+static int sampleHead = 0;
+static int sampleCount = 0;
+static bool overflowChecked = false;  // the content changed since the last check of its size
+static bool overflow = false;
+static UplinkStats stats = {};
+
+// writes the fields with the oldest content that fits, returns their length
+static size_t writeFields(char *out, size_t capacity, uint32_t nowMs, int *eventsTaken, int *samplesTaken, bool *urgent) {
+    size_t length = 0;
+    *eventsTaken = 0;
+    *samplesTaken = 0;
+    *urgent = false;
+    out[0] = '\0';
+
+    for (int i = 0; i < eventCount; i++) {
+        size_t eventLength = strlen(events[i].text);
+        size_t needed = (i == 0 ? strlen("DATA=") : 1) + eventLength;
+        if (length + needed > capacity) break;
+        memcpy(out + length, i == 0 ? "DATA=" : ",", needed - eventLength);
+        length += needed - eventLength;
+        memcpy(out + length, events[i].text, eventLength);
+        length += eventLength;
+        out[length] = '\0';
+        *urgent = *urgent || events[i].urgent;
+        (*eventsTaken)++;
+    }
+
+    const char *prefix = length > 0 ? ";TLM=" : "TLM=";
+    size_t prefixLength = strlen(prefix);
+    if (sampleCount == 0 || length + prefixLength >= capacity) return length;
+
+    TelemetrySample ordered[TELEMETRY_MAX_SAMPLES];
+    for (int i = 0; i < sampleCount; i++) ordered[i] = samples[(sampleHead + i) % TELEMETRY_MAX_SAMPLES];
+    memcpy(out + length, prefix, prefixLength + 1);
+    *samplesTaken = telemetryEncode(ordered, sampleCount, nowMs, out + length + prefixLength,
+                                    capacity - length - prefixLength + 1);
+    if (*samplesTaken == 0) {
+        out[length] = '\0';
+        return length;
+    }
+    return length + strlen(out + length);
+}
+
+void uplinkInit() {
+    eventCount = 0;
+    sampleHead = 0;
+    sampleCount = 0;
+    overflowChecked = false;
+    stats = {};
+}
+
+bool uplinkAddEvent(const char *event, bool urgent, uint32_t nowMs) {
+    if (eventCount >= UPLINK_MAX_EVENTS) {
+        stats.droppedEvents++;
+        return false;
+    }
+    UplinkEvent &pending = events[eventCount++];
+    strncpy(pending.text, event, UPLINK_EVENT_LENGTH - 1);
+    pending.text[UPLINK_EVENT_LENGTH - 1] = '\0';
+    pending.urgent = urgent;
+    pending.queuedAt = nowMs;
+    overflowChecked = false;
+    stats.queued++;
+    return true;
+}
+
+void uplinkAddSample(const TelemetrySample &sample) {
+    if (sampleCount == TELEMETRY_MAX_SAMPLES) {
+        sampleHead = (sampleHead + 1) % TELEMETRY_MAX_SAMPLES;
+        sampleCount--;
+        stats.droppedSamples++;
+    }
+    samples[(sampleHead + sampleCount) % TELEMETRY_MAX_SAMPLES] = sample;
+    sampleCount++;
+    overflowChecked = false;
+}
+
+bool uplinkFlushDue(uint32_t nowMs, size_t capacity) {
+    if (eventCount == 0 && sampleCount == 0) return false;
+
+    for (int i = 0; i < eventCount; i++) {
+        if (events[i].urgent || nowMs - events[i].queuedAt >= UPLINK_EVENT_HOLD_MS) return true;
+    }
+    if (sampleCount > 0 && nowMs - samples[sampleHead].atMs >= UPLINK_TELEMETRY_HOLD_MS) return true;
+
+    // a full frame is sent at once, the new content would not fit in it
+    if (!overflowChecked) {
+        char fields[UPLINK_MAX_PAYLOAD + 1];
+        int eventsTaken, samplesTaken;
+        bool urgent;
+        if (capacity > UPLINK_MAX_PAYLOAD) capacity = UPLINK_MAX_PAYLOAD;
+        writeFields(fields, capacity, nowMs, &eventsTaken, &samplesTaken, &urgent);
+        overflow = eventsTaken < eventCount || samplesTaken < sampleCount;
+        overflowChecked = true;
+    }
+    return overflow;
+}
+
+bool uplinkNextFlushMs(uint32_t *dueMs) {
+    bool found = false;
+    for (int i = 0; i < eventCount; i++) {
+        uint32_t due = events[i].urgent ? events[i].queuedAt : events[i].queuedAt + UPLINK_EVENT_HOLD_MS;
+        if (!found || (int32_t)(due - *dueMs) < 0) *dueMs = due;
+        found = true;
+    }
+    if (sampleCount > 0) {
+        uint32_t due = samples[sampleHead].atMs + UPLINK_TELEMETRY_HOLD_MS;
+        if (!found || (int32_t)(due - *dueMs) < 0) *dueMs = due;
+        found = true;
+    }
+    return found;
+}
+
+size_t uplinkBuild(char *out, size_t capacity, uint32_t nowMs, bool *urgent) {
+    int eventsTaken, samplesTaken;
+    size_t length = writeFields(out, capacity, nowMs, &eventsTaken, &samplesTaken, urgent);
+    if (length == 0) return 0;
+
+    memmove(events, events + eventsTaken, (eventCount - eventsTaken) * sizeof(UplinkEvent));
+    eventCount -= eventsTaken;
+    sampleHead = (sampleHead + samplesTaken) % TELEMETRY_MAX_SAMPLES;
+    sampleCount -= samplesTaken;
+    overflowChecked = false;
+
+    stats.frames++;
+    stats.events += eventsTaken;
+    stats.samples += samplesTaken;
+    return length;
+}
+
+const UplinkStats &uplinkStats() {
+    return stats;
+}
+
+void uplinkSave(UplinkSnapshot &snapshot) {
+    memcpy(snapshot.events, events, sizeof(events));
+    snapshot.eventCount = eventCount;
+    memcpy(snapshot.samples, samples, sizeof(samples));
+    snapshot.sampleHead = sampleHead;
+    snapshot.sampleCount = sampleCount;
+    snapshot.stats = stats;
+}
+
+void uplinkRestore(const UplinkSnapshot &snapshot, uint32_t shiftMs) {
+    memcpy(events, snapshot.events, sizeof(events));
+    eventCount = snapshot.eventCount;
+    memcpy(samples, snapshot.samples, sizeof(samples));
+    sampleHead = snapshot.sampleHead;
+    sampleCount = snapshot.sampleCount;
+    for (UplinkEvent &event : events) event.queuedAt += shiftMs;
+    for (TelemetrySample &sample : samples) sample.atMs += shiftMs;
+    stats = snapshot.stats;
+    overflowChecked = false;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file uplink.h
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Aggregation of the events and of the telemetry of CtrlMailBox in few uplinks.
+ *
+ * The events and the telemetry samples are held here instead of going to the
+ * ARQ one by one: a frame is built when an urgent event arrives, when the
+ * content would no longer fit in a frame of UPLINK_MAX_PAYLOAD bytes or when
+ * the oldest content waited too long. The frame carries the events in its DATA
+ * field, separated by ',', and the delta-encoded samples in its TLM field
+ * (see telemetry.h); what does not fit stays for the next frame.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef UPLINK_H
+#define UPLINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "telemetry.h"
+
+#define UPLINK_MAX_PAYLOAD 96               // LoRa payload of a frame, header and trailer included
+#define UPLINK_MAX_EVENTS 4
+#define UPLINK_EVENT_LENGTH 16
+#define UPLINK_SAMPLE_PERIOD_MS 60000UL     // one telemetry sample per minute, plus one at every change of state
+#define UPLINK_EVENT_HOLD_MS 30000UL        // a non-urgent event waits at most 30 s for company
+#define UPLINK_TELEMETRY_HOLD_MS 900000UL   // the telemetry is sent at least every 15 minutes
+
+struct UplinkEvent {
+    char text[UPLINK_EVENT_LENGTH];
+    bool urgent;
+    uint32_t queuedAt;
+};
+
+struct UplinkStats {
+    uint32_t queued;          // events accepted, numbered from 1 in the order they go in the frames
+    uint32_t frames;          // frames built
+    uint32_t events;          // events sent in the frames
+    uint32_t samples;         // telemetry samples sent in the frames
+    uint32_t droppedEvents;   // events rejected because UPLINK_MAX_EVENTS were waiting
+    uint32_t droppedSamples;  // oldest samples overwritten before being sent
+};
+
+// content of the aggregator kept in the RTC memory during a deep sleep (see power.h)
+struct UplinkSnapshot {
+    UplinkEvent events[UPLINK_MAX_EVENTS];
+    uint8_t eventCount;
+    TelemetrySample samples[TELEMETRY_MAX_SAMPLES];
+    uint8_t sampleHead;
+    uint8_t sampleCount;
+    UplinkStats stats;
+};
+
+void uplinkInit();
+// holds an event for the next frame, returns false if too many events are waiting
+bool uplinkAddEvent(const char *event, bool urgent, uint32_t nowMs);
+// holds a telemetry sample, the oldest one is overwritten when the buffer is full
+void uplinkAddSample(const TelemetrySample &sample);
+// true when a frame with `capacity` characters of fields must be built now
+bool uplinkFlushDue(uint32_t nowMs, size_t capacity);
+// time when the oldest content must be sent, false if the aggregator is empty
+bool uplinkNextFlushMs(uint32_t *dueMs);
+/**
+ * @brief writes the DATA and TLM fields of the next frame in `out` (at most `capacity` characters)
+ * and removes their content from the aggregator. Returns the length of the fields (0 if there is
+ * nothing to send); `*urgent` tells if the frame carries an urgent event.
+ */
+size_t uplinkBuild(char *out, size_t capacity, uint32_t nowMs, bool *urgent);
+const UplinkStats &uplinkStats();
+void uplinkSave(UplinkSnapshot &snapshot);
+// the times of the snapshot are moved by shiftMs (the clock restarted after the deep sleep)
+void uplinkRestore(const UplinkSnapshot &snapshot, uint32_t shiftMs);
+
+#endif
@@ -0,0 +1,128 @@
+/**
+ * @file anomaly.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Streaming anomaly detector that drives the AI alerts of MailTon (see anomaly.h).
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <math.h>
+#include "anomaly.h"
+
+// hard limits of the channels, the dangerous class indicator has none
+static const bool HAS_LIMIT[ANOMALY_CHANNELS] = {true, false};
+static const float LIMIT[ANOMALY_CHANNELS] = {ANOMALY_PPM_LIMIT, 0};
+static const float EXIT_LIMIT[ANOMALY_CHANNELS] = {ANOMALY_PPM_EXIT, 0};
+static const float MIN_STD[ANOMALY_CHANNELS] = {ANOMALY_PPM_MIN_STD, ANOMALY_CLASS_MIN_STD};
+
+void anomalyInit(AnomalyDetector &detector) {
+    detector = {};
+}
+
+// z-score and CUSUM of the sample against the baseline
+static void scoreChannel(AnomalyChannel &channel, float value, float minStd) {
+    if (channel.samples++ == 0) {
+        channel.mean = value;
+        channel.variance = 0;
+        channel.z = 0;
+        channel.cusum = 0;
+        return;
+    }
+    float std = sqrtf(channel.variance);
+    if (std < minStd) std = minStd;
+    channel.z = (value - channel.mean) / std;
+    channel.cusum += channel.z - ANOMALY_CUSUM_K;
+    if (channel.cusum < 0) channel.cusum = 0;
+    if (channel.cusum > 2 * ANOMALY_CUSUM_H) channel.cusum = 2 * ANOMALY_CUSUM_H;
+}
+
+// EWMA of mean and variance, the deviation is clipped so that a spike does not inflate the variance
+static void updateBaseline(AnomalyChannel &channel, float value, float minStd, float alpha) {
+    float std = sqrtf(channel.variance);
+    if (std < minStd) std = minStd;
+    float diff = value - channel.mean;
+    if (diff > ANOMALY_CLIP * std) diff = ANOMALY_CLIP * std;
+    if (diff < -ANOMALY_CLIP * std) diff = -ANOMALY_CLIP * std;
+    float increment = alpha * diff;
+    channel.mean += increment;
+    channel.variance = (1 - alpha) * (channel.variance + diff * increment);
+}
+
+static bool anomalous(const AnomalyChannel &channel, int id, float value, bool holdoff) {
+    if (HAS_LIMIT[id] && value > LIMIT[id]) return true;
+    if (channel.samples <= ANOMALY_WARMUP_SAMPLES || holdoff) return false;
+    return channel.z > ANOMALY_Z_ENTER || channel.cusum > ANOMALY_CUSUM_H;
+}
+
+static bool normal(const AnomalyChannel &channel, int id, float value) {
+    if (HAS_LIMIT[id] && value > EXIT_LIMIT[id]) return false;
+    return channel.z < ANOMALY_Z_EXIT;
+}
+
+bool anomalyUpdate(AnomalyDetector &detector, float ppm, float dangerProbability, uint32_t nowMs) {
+    if (isnan(ppm) || isnan(dangerProbability)) return false;
+    float danger = dangerProbability < 0 ? 0 : dangerProbability > 1 ? 1 : dangerProbability;
+    float values[ANOMALY_CHANNELS] = {ppm, danger};
+    detector.stats.samples++;
+
+    // after an alert the baseline gets ANOMALY_WARMUP_SAMPLES samples to settle, only the hard limit is used
+    bool holdoff = detector.holdoff > 0;
+    if (holdoff) detector.holdoff--;
+
+    uint8_t causes = 0;
+    bool allNormal = true;
+    for (int i = 0; i < ANOMALY_CHANNELS; i++) {
+        AnomalyChannel &channel = detector.channels[i];
+        scoreChannel(channel, values[i], MIN_STD[i]);
+        if (holdoff) channel.cusum = 0;
+        if (anomalous(channel, i, values[i], holdoff)) causes |= 1 << i;
+        if (!normal(channel, i, values[i])) allNormal = false;
+    }
+    detector.causes = causes;
+
+    // the anomalous samples must not become the new normal at once
+    float alpha = detector.alerting || causes ? ANOMALY_ALERT_ALPHA : ANOMALY_ALPHA;
+    for (int i = 0; i < ANOMALY_CHANNELS; i++) {
+        if (detector.channels[i].samples > 1) updateBaseline(detector.channels[i], values[i], MIN_STD[i], alpha);
+    }
+
+    if (!detector.alerting) {
+        if (!causes) return false;
+        detector.alerting = true;
+        detector.clearSamples = 0;
+        detector.notified = false;
+        detector.notifiedCauses = 0;
+        detector.stats.alerts++;
+        // the CUSUM starts again, it must not keep the alert open by itself
+        for (AnomalyChannel &channel : detector.channels) channel.cusum = 0;
+    } else if (allNormal) {
+        if (++detector.clearSamples >= ANOMALY_CLEAR_SAMPLES) {
+            detector.alerting = false;
+            detector.holdoff = ANOMALY_WARMUP_SAMPLES;
+            for (AnomalyChannel &channel : detector.channels) channel.cusum = 0;
+        }
+        return false;
+    } else {
+        detector.clearSamples = 0;
+    }
+
+    bool due = !detector.notified || (causes & ~detector.notifiedCauses) ||
+               ((causes & (1 << ANOMALY_PPM)) && ppm > detector.notifiedPpm * ANOMALY_ESCALATION) ||
+               nowMs - detector.lastNotifyMs >= ANOMALY_REMINDER_MS;
+    if (!due) return false;
+    if (detector.notifiedOnce && nowMs - detector.lastNotifyMs < ANOMALY_MIN_NOTIFY_INTERVAL_MS) {
+        detector.stats.rateLimited++;
+        return false;
+    }
+
+    detector.notified = true;
+    detector.notifiedOnce = true;
+    detector.notifiedCauses |= causes;
+    detector.notifiedPpm = ppm;
+    detector.lastNotifyMs = nowMs;
+    detector.stats.notifications++;
+    return true;
+}
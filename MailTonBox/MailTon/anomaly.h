@@ -0,0 +1,92 @@
+/**
+ * @file anomaly.h
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Streaming anomaly detector that drives the AI alerts of MailTon.
+ *
+ * Every prediction of the model is a sample of two channels: the CO ppm
+ * predicted and the probability, from the softmax heads of the model, that
+ * the ppm class or the temperature/humidity class is in the dangerous
+ * range. Each channel keeps an EWMA of mean and variance, the z-score of
+ * the new sample and an upward CUSUM of the
+ * z-scores, all in O(1) time and memory. A channel is anomalous when the
+ * ppm is over the hard limit, when the z-score jumps over ANOMALY_Z_ENTER
+ * or when the CUSUM finds a smaller lasting rise. An alert opens at the
+ * first anomalous sample and closes only after ANOMALY_CLEAR_SAMPLES
+ * samples back under the lower exit thresholds (hysteresis). During an
+ * alert the baseline follows the values only slowly, after it the baseline
+ * gets ANOMALY_WARMUP_SAMPLES samples to settle before the statistical
+ * tests are armed again. A notification is
+ * sent when an alert opens, when a new channel becomes anomalous or the
+ * ppm rises by ANOMALY_ESCALATION over the value notified, and as a
+ * reminder every ANOMALY_REMINDER_MS, never more often than
+ * ANOMALY_MIN_NOTIFY_INTERVAL_MS.
+ * No Arduino dependency: the detector also builds on the host.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef ANOMALY_H
+#define ANOMALY_H
+
+#include <stdint.h>
+
+#define ANOMALY_ALPHA 0.05f                 // EWMA weight of a new sample, ~3 minutes with a sample every 10 s
+#define ANOMALY_ALERT_ALPHA 0.005f          // during an alert the baseline follows a lasting change only slowly
+#define ANOMALY_WARMUP_SAMPLES 12           // before this, and after an alert, only the hard limit is used
+#define ANOMALY_Z_ENTER 4.0f
+#define ANOMALY_Z_EXIT 1.5f
+#define ANOMALY_CUSUM_K 0.5f                // allowance of the CUSUM, in standard deviations
+#define ANOMALY_CUSUM_H 5.0f                // decision threshold of the CUSUM
+#define ANOMALY_CLIP 3.0f                   // deviations clipped in the baseline, in standard deviations
+#define ANOMALY_CLEAR_SAMPLES 6             // normal samples in a row to close an alert
+#define ANOMALY_PPM_LIMIT 760.0f            // dangerous CO, alert at once
+#define ANOMALY_PPM_EXIT 700.0f
+#define ANOMALY_PPM_MIN_STD 2.0f            // the model is deterministic: its variance can be ~0
+#define ANOMALY_CLASS_MIN_STD 0.3f          // one dangerous prediction alone is not enough for the z-score
+#define ANOMALY_ESCALATION 1.25f
+#define ANOMALY_MIN_NOTIFY_INTERVAL_MS 600000UL     // 10 minutes
+#define ANOMALY_REMINDER_MS 21600000UL              // 6 hours
+
+enum AnomalyChannelId : uint8_t {
+    ANOMALY_PPM = 0,
+    ANOMALY_DANGER_CLASS,
+    ANOMALY_CHANNELS
+};
+
+struct AnomalyChannel {
+    float mean;
+    float variance;
+    float z;            // z-score of the last sample
+    float cusum;
+    uint32_t samples;
+};
+
+struct AnomalyStats {
+    uint32_t samples;
+    uint32_t alerts;            // alerts opened
+    uint32_t notifications;
+    uint32_t rateLimited;       // notifications due but delayed by the minimum interval
+};
+
+struct AnomalyDetector {
+    AnomalyChannel channels[ANOMALY_CHANNELS];
+    bool alerting;
+    uint8_t causes;             // anomalous channels at the last sample (bit per channel)
+    uint8_t notifiedCauses;     // channels already notified in this alert
+    uint8_t clearSamples;
+    uint8_t holdoff;            // samples after an alert with only the hard limit
+    bool notified;              // a notification was sent in this alert
+    float notifiedPpm;
+    bool notifiedOnce;
+    uint32_t lastNotifyMs;
+    AnomalyStats stats;
+};
+
+void anomalyInit(AnomalyDetector &detector);
+// one prediction of the model, true when an alert must be notified now
+bool anomalyUpdate(AnomalyDetector &detector, float ppm, float dangerProbability, uint32_t nowMs);
+
+#endif
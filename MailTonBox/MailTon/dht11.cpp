@@ -0,0 +1,34 @@
+/**
+ * @file dht11.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Decoder of the DHT11 frame captured by the RMT (see dht11.h).
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include "dht11.h"
+
+Dht11Result dht11Decode(const uint16_t *highUs, int count, uint8_t data[5]) {
+    if (count < DHT11_BITS) return DHT11_SHORT_FRAME;
+    const uint16_t *bits = highUs + count - DHT11_BITS;
+    for (int i = 0; i < 5; i++) data[i] = 0;
+    for (int i = 0; i < DHT11_BITS; i++) {
+        if (bits[i] > DHT11_BIT_THRESHOLD_US) data[i / 8] |= 0x80 >> (i % 8);
+    }
+    if ((uint8_t)(data[0] + data[1] + data[2] + data[3]) != data[4]) return DHT11_BAD_CHECKSUM;
+    return DHT11_OK;
+}
+
+// integer part, bit 7 of the decimals is the sign on the recent DHT11 (same as the Adafruit driver)
+float dht11Temperature(const uint8_t data[5]) {
+    float temperature = data[2];
+    if (data[3] & 0x80) temperature = -1 - temperature;
+    return temperature + (data[3] & 0x0f) * 0.1f;
+}
+
+float dht11Humidity(const uint8_t data[5]) {
+    return data[0] + data[1] * 0.1f;
+}
@@ -0,0 +1,39 @@
+/**
+ * @file dht11.h
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Decoder of the DHT11 frame captured by the RMT (see dht_sampler.h).
+ *
+ * After the start signal the DHT11 answers with 80 us low and 80 us high,
+ * then sends 40 bits, each one 50 us low followed by 26-28 us high for a 0
+ * or 70 us high for a 1: humidity, its decimals, temperature, its decimals
+ * and a checksum. The decoder only looks at the width of the high pulses
+ * captured, so it does not depend on when the capture started.
+ * No Arduino dependency: the decoder also builds on the host.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef DHT11_H
+#define DHT11_H
+
+#include <stdint.h>
+
+#define DHT11_BITS 40
+#define DHT11_BIT_THRESHOLD_US 48   // high pulses longer than this are 1
+#define DHT11_MAX_HIGH_US 200       // longer high pulses are not part of the frame
+
+enum Dht11Result : uint8_t {
+    DHT11_OK = 0,
+    DHT11_SHORT_FRAME,      // less than 40 bits captured
+    DHT11_BAD_CHECKSUM
+};
+
+// widths of the high pulses in order of capture, the last DHT11_BITS are the data bits
+Dht11Result dht11Decode(const uint16_t *highUs, int count, uint8_t data[5]);
+float dht11Temperature(const uint8_t data[5]);
+float dht11Humidity(const uint8_t data[5]);
+
+#endif
@@ -0,0 +1,153 @@
+/**
+ * @file dht_sampler.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Background sampling of the DHT11 with the RMT peripheral (see dht_sampler.h).
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <Arduino.h>
+#include <driver/gpio.h>
+#include <driver/rmt_rx.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include "dht_sampler.h"
+
+#define DHT_RMT_RESOLUTION_HZ 1000000   // 1 us ticks
+#define DHT_RMT_MIN_PULSE_NS 1250       // shorter glitches are filtered out
+#define DHT_RMT_IDLE_NS 1000000         // 1 ms without edges ends the frame
+#define DHT_MAX_SYMBOLS 64              // the frame is about 42 symbols
+#define DHT_MAX_PULSES 64
+
+static gpio_num_t dhtGpio;
+static uint32_t samplePeriodMs;
+static rmt_channel_handle_t rxChannel = nullptr;
+static QueueHandle_t rxDone = nullptr;      // number of symbols of each captured frame
+static rmt_symbol_word_t symbols[DHT_MAX_SYMBOLS];
+
+// last good reading, copied under the lock by the task and by the readers
+static portMUX_TYPE sampleLock = portMUX_INITIALIZER_UNLOCKED;
+static DhtSample latest = {};
+static DhtStats stats = {};
+
+// called from the RMT interrupt at the end of the frame
+static bool IRAM_ATTR onReceiveDone(rmt_channel_handle_t, const rmt_rx_done_event_data_t *event, void *) {
+    BaseType_t woken = pdFALSE;
+    size_t count = event->num_symbols;
+    xQueueSendFromISR(rxDone, &count, &woken);
+    return woken == pdTRUE;
+}
+
+// one transaction: start signal, capture of the answer by the RMT, decoding
+static Dht11Result readSensor(uint8_t data[5], bool *timeout) {
+    *timeout = false;
+    xQueueReset(rxDone);
+
+    gpio_set_level(dhtGpio, 0);
+    vTaskDelay(pdMS_TO_TICKS(DHT_START_SIGNAL_MS));
+    rmt_receive_config_t config = {};
+    config.signal_range_min_ns = DHT_RMT_MIN_PULSE_NS;
+    config.signal_range_max_ns = DHT_RMT_IDLE_NS;
+    if (rmt_receive(rxChannel, symbols, sizeof(symbols), &config) != ESP_OK) {
+        gpio_set_level(dhtGpio, 1);
+        *timeout = true;
+        return DHT11_SHORT_FRAME;
+    }
+    gpio_set_level(dhtGpio, 1); // released, the pull-up takes the line high and the sensor answers
+
+    size_t count = 0;
+    if (xQueueReceive(rxDone, &count, pdMS_TO_TICKS(DHT_READ_TIMEOUT_MS)) != pdTRUE) {
+        // no end of frame: the channel is restarted to drop the pending receive
+        rmt_disable(rxChannel);
+        rmt_enable(rxChannel);
+        *timeout = true;
+        return DHT11_SHORT_FRAME;
+    }
+
+    uint16_t highs[DHT_MAX_PULSES];
+    int pulses = 0;
+    for (size_t i = 0; i < count && i < DHT_MAX_SYMBOLS && pulses < DHT_MAX_PULSES; i++) {
+        const rmt_symbol_word_t &s = symbols[i];
+        if (s.level0 && s.duration0 > 0 && s.duration0 < DHT11_MAX_HIGH_US) highs[pulses++] = s.duration0;
+        if (pulses < DHT_MAX_PULSES && s.level1 && s.duration1 > 0 && s.duration1 < DHT11_MAX_HIGH_US) {
+            highs[pulses++] = s.duration1;
+        }
+    }
+    return dht11Decode(highs, pulses, data);
+}
+
+static void samplerTask(void *) {
+    vTaskDelay(pdMS_TO_TICKS(DHT11_MIN_INTERVAL_MS)); // the sensor is not ready right after the power-on
+    TickType_t lastWake = xTaskGetTickCount();
+    while (true) {
+        uint8_t data[5];
+        bool timeout;
+        Dht11Result result = readSensor(data, &timeout);
+        uint32_t now = millis();
+        float temperature = result == DHT11_OK ? dht11Temperature(data) : 0;
+        float humidity = result == DHT11_OK ? dht11Humidity(data) : 0;
+
+        portENTER_CRITICAL(&sampleLock);
+        stats.transactions++;
+        if (timeout) stats.timeouts++;
+        else if (result == DHT11_SHORT_FRAME) stats.shortFrames++;
+        else if (result == DHT11_BAD_CHECKSUM) stats.badChecksums++;
+        if (result == DHT11_OK) {
+            latest.temperature = temperature;
+            latest.humidity = humidity;
+            latest.timestampMs = now;
+            latest.sequence++;
+        }
+        portEXIT_CRITICAL(&sampleLock);
+
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(samplePeriodMs));
+    }
+}
+
+bool dhtSamplerStart(uint8_t pin, uint32_t periodMs) {
+#ifdef BOARD_HAS_PIN_REMAP
+    dhtGpio = (gpio_num_t)digitalPinToGPIONumber(pin);
+#else
+    dhtGpio = (gpio_num_t)pin;
+#endif
+    samplePeriodMs = periodMs < DHT11_MIN_INTERVAL_MS ? DHT11_MIN_INTERVAL_MS : periodMs;
+
+    rxDone = xQueueCreate(1, sizeof(size_t));
+    if (rxDone == nullptr) return false;
+    rmt_rx_channel_config_t config = {};
+    config.gpio_num = dhtGpio;
+    config.clk_src = RMT_CLK_SRC_DEFAULT;
+    config.resolution_hz = DHT_RMT_RESOLUTION_HZ;
+    config.mem_block_symbols = DHT_MAX_SYMBOLS;
+    if (rmt_new_rx_channel(&config, &rxChannel) != ESP_OK) return false;
+    rmt_rx_event_callbacks_t callbacks = {};
+    callbacks.on_recv_done = onReceiveDone;
+    if (rmt_rx_register_event_callbacks(rxChannel, &callbacks, nullptr) != ESP_OK) return false;
+    if (rmt_enable(rxChannel) != ESP_OK) return false;
+
+    // open drain: the task drives the start signal, the RMT listens on the same pin
+    gpio_set_direction(dhtGpio, GPIO_MODE_INPUT_OUTPUT_OD);
+    gpio_set_pull_mode(dhtGpio, GPIO_PULLUP_ONLY);
+    gpio_set_level(dhtGpio, 1);
+
+    // core 0, with the lowest priority: loop() and the LoRa interrupt run on core 1
+    return xTaskCreatePinnedToCore(samplerTask, "dht", 3072, nullptr, 1, nullptr, 0) == pdPASS;
+}
+
+bool dhtLatest(DhtSample *sample) {
+    portENTER_CRITICAL(&sampleLock);
+    *sample = latest;
+    portEXIT_CRITICAL(&sampleLock);
+    return sample->sequence > 0;
+}
+
+DhtStats dhtSamplerStats() {
+    portENTER_CRITICAL(&sampleLock);
+    DhtStats copy = stats;
+    portEXIT_CRITICAL(&sampleLock);
+    return copy;
+}
@@ -0,0 +1,55 @@
+/**
+ * @file dht_sampler.h
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Background sampling of the DHT11 with the RMT peripheral.
+ *
+ * The DHT library bit-bangs every read with the interrupts disabled for
+ * about 5 ms, and MailTon read temperature and humidity with two separate
+ * transactions from loop(). Here a FreeRTOS task sends the start signal,
+ * lets the RMT capture the edges of the answer and decodes them (dht11.h):
+ * the interrupts stay enabled and the LoRa IRQ is served during the read.
+ * One transaction per period gives both values, never closer than the
+ * DHT11_MIN_INTERVAL_MS required by the sensor. The last good reading is
+ * published with its timestamp: the inference and the /ai command read it
+ * without touching the bus.
+ * The RMT is driven with the channel API of ESP-IDF 5 (driver/rmt_rx.h), the
+ * one used by the arduino-esp32 3.x core: the legacy driver/rmt.h cannot be
+ * linked next to the RMT support of that core.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef DHT_SAMPLER_H
+#define DHT_SAMPLER_H
+
+#include <stdint.h>
+#include "dht11.h"
+
+#define DHT11_MIN_INTERVAL_MS 2000  // the sensor needs this between two transactions
+#define DHT_START_SIGNAL_MS 20      // start signal, at least 18 ms for the DHT11
+#define DHT_READ_TIMEOUT_MS 50      // the frame lasts about 5 ms
+
+struct DhtSample {
+    float temperature;      // °C
+    float humidity;         // %
+    uint32_t timestampMs;   // millis() of the transaction
+    uint32_t sequence;      // number of good readings so far
+};
+
+struct DhtStats {
+    uint32_t transactions;
+    uint32_t timeouts;      // no answer from the sensor
+    uint32_t shortFrames;
+    uint32_t badChecksums;
+};
+
+// starts the task that reads the sensor on the Arduino pin every periodMs, false on errors
+bool dhtSamplerStart(uint8_t pin, uint32_t periodMs);
+// last good reading, false if there is none yet
+bool dhtLatest(DhtSample *sample);
+DhtStats dhtSamplerStats();
+
+#endif
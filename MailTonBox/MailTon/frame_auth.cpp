@@ -0,0 +1,255 @@
+/**
+ * @file frame_auth.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Authentication of the LoRa frames exchanged by MailTon and CtrlMailBox (see frame_auth.h).
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <string.h>
+#include "frame_auth.h"
+
+#ifdef ESP_PLATFORM
+#include <Arduino.h>
+
+static void aesEncrypt(const FrameAuthKey &authKey, const uint8_t in[16], uint8_t out[16]) {
+    // the context is only read by the hardware accelerator
+    mbedtls_aes_crypt_ecb(const_cast<mbedtls_aes_context *>(&authKey.aes), MBEDTLS_AES_ENCRYPT, in, out);
+}
+
+static void aesSetKey(FrameAuthKey &authKey, const uint8_t key[FRAME_AUTH_KEY_LENGTH]) {
+    if (authKey.valid) mbedtls_aes_free(&authKey.aes);
+    mbedtls_aes_init(&authKey.aes);
+    mbedtls_aes_setkey_enc(&authKey.aes, key, 128);
+}
+
+static uint32_t nowUs() {
+    return micros();
+}
+
+#else
+
+#include <time.h>
+
+// portable AES-128, encryption only (FIPS-197)
+static const uint8_t SBOX[256] = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+
+static uint8_t xtime(uint8_t x) {
+    return (uint8_t)((x << 1) ^ ((x & 0x80) ? 0x1b : 0x00));
+}
+
+static void aesSetKey(FrameAuthKey &authKey, const uint8_t key[FRAME_AUTH_KEY_LENGTH]) {
+    uint8_t *w = authKey.roundKeys;
+    memcpy(w, key, 16);
+    uint8_t rcon = 0x01;
+    for (int i = 16; i < 176; i += 4) {
+        uint8_t t[4] = {w[i - 4], w[i - 3], w[i - 2], w[i - 1]};
+        if (i % 16 == 0) {
+            // RotWord, SubWord and round constant
+            uint8_t first = t[0];
+            t[0] = SBOX[t[1]] ^ rcon;
+            t[1] = SBOX[t[2]];
+            t[2] = SBOX[t[3]];
+            t[3] = SBOX[first];
+            rcon = xtime(rcon);
+        }
+        for (int j = 0; j < 4; j++) w[i + j] = w[i - 16 + j] ^ t[j];
+    }
+}
+
+static void aesEncrypt(const FrameAuthKey &authKey, const uint8_t in[16], uint8_t out[16]) {
+    uint8_t s[16];
+    for (int i = 0; i < 16; i++) s[i] = in[i] ^ authKey.roundKeys[i];
+
+    for (int round = 1; round <= 10; round++) {
+        // SubBytes and ShiftRows (the state is column-major)
+        uint8_t t[16];
+        for (int c = 0; c < 4; c++) {
+            for (int r = 0; r < 4; r++) t[c * 4 + r] = SBOX[s[((c + r) % 4) * 4 + r]];
+        }
+        // MixColumns, skipped in the last round
+        if (round < 10) {
+            for (int c = 0; c < 4; c++) {
+                uint8_t *col = &t[c * 4];
+                uint8_t all = col[0] ^ col[1] ^ col[2] ^ col[3];
+                uint8_t first = col[0];
+                col[0] ^= all ^ xtime(col[0] ^ col[1]);
+                col[1] ^= all ^ xtime(col[1] ^ col[2]);
+                col[2] ^= all ^ xtime(col[2] ^ col[3]);
+                col[3] ^= all ^ xtime(col[3] ^ first);
+            }
+        }
+        const uint8_t *roundKey = &authKey.roundKeys[round * 16];
+        for (int i = 0; i < 16; i++) s[i] = t[i] ^ roundKey[i];
+    }
+    memcpy(out, s, 16);
+}
+
+static uint32_t nowUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+}
+
+#endif
+
+// doubling in GF(2^128), used for the CMAC subkeys
+static void leftShift(const uint8_t in[16], uint8_t out[16]) {
+    uint8_t overflow = in[0] & 0x80;
+    for (int i = 0; i < 15; i++) out[i] = (uint8_t)(in[i] << 1 | in[i + 1] >> 7);
+    out[15] = (uint8_t)(in[15] << 1);
+    if (overflow) out[15] ^= 0x87;
+}
+
+void frameAuthSetKey(FrameAuthKey &authKey, const uint8_t key[FRAME_AUTH_KEY_LENGTH]) {
+    aesSetKey(authKey, key);
+    uint8_t zero[16] = {};
+    uint8_t l[16];
+    aesEncrypt(authKey, zero, l);
+    leftShift(l, authKey.k1);
+    leftShift(authKey.k1, authKey.k2);
+    authKey.valid = true;
+}
+
+// CMAC computed block by block over data given in more pieces
+struct CmacState {
+    uint8_t x[16];       // chaining value
+    uint8_t block[16];   // data not processed yet
+    size_t used;
+};
+
+static void cmacUpdate(const FrameAuthKey &authKey, CmacState &state, const uint8_t *data, size_t length) {
+    while (length > 0) {
+        // the last block is kept, it is processed with the subkey by cmacFinish()
+        if (state.used == 16) {
+            for (int i = 0; i < 16; i++) state.x[i] ^= state.block[i];
+            aesEncrypt(authKey, state.x, state.x);
+            state.used = 0;
+        }
+        size_t n = 16 - state.used;
+        if (n > length) n = length;
+        memcpy(state.block + state.used, data, n);
+        state.used += n;
+        data += n;
+        length -= n;
+    }
+}
+
+static void cmacFinish(const FrameAuthKey &authKey, CmacState &state, uint8_t mac[16]) {
+    const uint8_t *subkey = authKey.k1;
+    if (state.used < 16) {
+        // incomplete (or empty) last block: 10* padding and K2
+        state.block[state.used] = 0x80;
+        memset(state.block + state.used + 1, 0, 15 - state.used);
+        subkey = authKey.k2;
+    }
+    for (int i = 0; i < 16; i++) state.x[i] ^= state.block[i] ^ subkey[i];
+    aesEncrypt(authKey, state.x, mac);
+}
+
+void frameAuthCmac(const FrameAuthKey &authKey, const uint8_t *data, size_t length, uint8_t mac[16]) {
+    CmacState state = {};
+    cmacUpdate(authKey, state, data, length);
+    cmacFinish(authKey, state, mac);
+}
+
+void frameAuthDeriveKey(const char *ctrlMailBoxKey, const char *mailTonKey, const char *name,
+                        uint8_t key[FRAME_AUTH_KEY_LENGTH]) {
+    // the key of the CtrlMailBox (zero padded) authenticates the MailTon key and the name
+    uint8_t rootKey[FRAME_AUTH_KEY_LENGTH] = {};
+    size_t rootLength = strlen(ctrlMailBoxKey);
+    memcpy(rootKey, ctrlMailBoxKey, rootLength < sizeof(rootKey) ? rootLength : sizeof(rootKey));
+
+    FrameAuthKey authKey = {};
+    frameAuthSetKey(authKey, rootKey);
+    CmacState state = {};
+    static const uint8_t LABEL[] = "MailTonBox";
+    cmacUpdate(authKey, state, LABEL, sizeof(LABEL));  // label with its terminator as separator
+    cmacUpdate(authKey, state, (const uint8_t *)mailTonKey, strlen(mailTonKey) + 1);
+    cmacUpdate(authKey, state, (const uint8_t *)name, strlen(name));
+    cmacFinish(authKey, state, key);
+#ifdef ESP_PLATFORM
+    mbedtls_aes_free(&authKey.aes);
+#endif
+}
+
+static void computeMic(const FrameAuthKey &authKey, FrameDirection direction, const uint8_t header[FRAME_AUTH_HEADER_LENGTH],
+                       uint32_t frameCounter, const uint8_t *payload, size_t length, uint8_t mic[16]) {
+    // first block: direction, header and frame counter
+    uint8_t b0[1 + FRAME_AUTH_HEADER_LENGTH + 4];
+    b0[0] = direction;
+    memcpy(b0 + 1, header, FRAME_AUTH_HEADER_LENGTH);
+    for (int i = 0; i < 4; i++) b0[1 + FRAME_AUTH_HEADER_LENGTH + i] = (uint8_t)(frameCounter >> (8 * i));
+
+    CmacState state = {};
+    cmacUpdate(authKey, state, b0, sizeof(b0));
+    cmacUpdate(authKey, state, payload, length);
+    cmacFinish(authKey, state, mic);
+}
+
+void frameAuthSign(const FrameAuthKey &authKey, FrameDirection direction, const uint8_t header[FRAME_AUTH_HEADER_LENGTH],
+                   uint32_t frameCounter, const uint8_t *payload, size_t length, uint8_t trailer[FRAME_AUTH_TRAILER_LENGTH]) {
+    uint8_t mic[16];
+    computeMic(authKey, direction, header, frameCounter, payload, length, mic);
+    for (int i = 0; i < 4; i++) trailer[i] = (uint8_t)(frameCounter >> (8 * i)); // little endian
+    memcpy(trailer + 4, mic, FRAME_AUTH_MIC_LENGTH);
+}
+
+bool frameAuthVerify(const FrameAuthKey &authKey, FrameDirection direction, const uint8_t header[FRAME_AUTH_HEADER_LENGTH],
+                     const uint8_t *payload, size_t length, const uint8_t trailer[FRAME_AUTH_TRAILER_LENGTH],
+                     uint32_t *frameCounter) {
+    if (!authKey.valid) return false;
+    uint32_t counter = 0;
+    for (int i = 0; i < 4; i++) counter |= (uint32_t)trailer[i] << (8 * i);
+
+    uint8_t mic[16];
+    computeMic(authKey, direction, header, counter, payload, length, mic);
+    // constant time comparison
+    uint8_t diff = 0;
+    for (int i = 0; i < FRAME_AUTH_MIC_LENGTH; i++) diff |= mic[i] ^ trailer[4 + i];
+    *frameCounter = counter;
+    return diff == 0;
+}
+
+uint32_t frameAuthBenchmarkNs(uint32_t frames, size_t length) {
+    uint8_t key[FRAME_AUTH_KEY_LENGTH] = {};
+    uint8_t payload[255] = {};
+    uint8_t header[FRAME_AUTH_HEADER_LENGTH] = {0x02, 0x03, 0x00, 0x00};
+    uint8_t trailer[FRAME_AUTH_TRAILER_LENGTH];
+    if (length > sizeof(payload)) length = sizeof(payload);
+    if (frames == 0) frames = 1;
+
+    FrameAuthKey authKey = {};
+    frameAuthSetKey(authKey, key);
+    frameAuthSign(authKey, FRAME_UPLINK, header, 1, payload, length, trailer);
+
+    uint32_t counter;
+    uint32_t valid = 0;
+    uint32_t start = nowUs();
+    for (uint32_t i = 0; i < frames; i++) valid += frameAuthVerify(authKey, FRAME_UPLINK, header, payload, length, trailer, &counter);
+    uint32_t elapsedUs = nowUs() - start;
+#ifdef ESP_PLATFORM
+    mbedtls_aes_free(&authKey.aes);
+#endif
+    return valid == frames ? (uint32_t)((uint64_t)elapsedUs * 1000 / frames) : 0;
+}
@@ -0,0 +1,73 @@
+/**
+ * @file frame_auth.h
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Authentication of the LoRa frames exchanged by MailTon and CtrlMailBox.
+ *
+ * Shared by MailTon and CtrlMailBox (keep the two copies identical).
+ * The shared keys are no longer sent on air: every CtrlMailBox has a 128-bit
+ * key, derived from its key, the MailTon key and its name, and kept in the
+ * registry of MailTon. Each frame ends with a trailer of 8 bytes: a 32-bit
+ * frame counter and the AES-CMAC (RFC 4493) of the frame truncated to 4 bytes.
+ * The MIC covers the direction, the header, the counter and the payload;
+ * a frame with a counter not greater than the last accepted one is a replay.
+ * AES uses the hardware accelerator of the ESP32 through mbedtls, a portable
+ * implementation is used elsewhere (host builds).
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef FRAME_AUTH_H
+#define FRAME_AUTH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef ESP_PLATFORM
+#include "mbedtls/aes.h"
+#endif
+
+#define FRAME_AUTH_KEY_LENGTH 16
+#define FRAME_AUTH_MIC_LENGTH 4
+#define FRAME_AUTH_TRAILER_LENGTH (4 + FRAME_AUTH_MIC_LENGTH)  // frame counter + MIC
+#define FRAME_AUTH_HEADER_LENGTH 4                             // recipient, sender, msg ID, length
+#define FRAME_COUNTER_SAVE_PERIOD 64  // the counter is saved in the flash every 64 frames
+#define FRAME_COUNTER_JUMP 256        // and moved forward by 256 at startup, more than LINK_MAX_FRAME_GAP after
+                                      // the last frame sent, so the receiver does not count the reboot as losses
+
+enum FrameDirection : uint8_t {
+    FRAME_UPLINK = 0,   // CtrlMailBox -> MailTon
+    FRAME_DOWNLINK = 1  // MailTon -> CtrlMailBox
+};
+
+// key with the CMAC subkeys, computed once by frameAuthSetKey()
+struct FrameAuthKey {
+#ifdef ESP_PLATFORM
+    mbedtls_aes_context aes;
+#else
+    uint8_t roundKeys[176];
+#endif
+    uint8_t k1[16];
+    uint8_t k2[16];
+    bool valid;
+};
+
+// 128-bit key of a CtrlMailBox from the secrets provisioned on both devices
+void frameAuthDeriveKey(const char *ctrlMailBoxKey, const char *mailTonKey, const char *name,
+                        uint8_t key[FRAME_AUTH_KEY_LENGTH]);
+void frameAuthSetKey(FrameAuthKey &authKey, const uint8_t key[FRAME_AUTH_KEY_LENGTH]);
+// full AES-CMAC of the data
+void frameAuthCmac(const FrameAuthKey &authKey, const uint8_t *data, size_t length, uint8_t mac[16]);
+// writes the trailer (frame counter and MIC) of a frame
+void frameAuthSign(const FrameAuthKey &authKey, FrameDirection direction, const uint8_t header[FRAME_AUTH_HEADER_LENGTH],
+                   uint32_t frameCounter, const uint8_t *payload, size_t length, uint8_t trailer[FRAME_AUTH_TRAILER_LENGTH]);
+// checks the MIC of the trailer, returns its frame counter in `frameCounter`
+bool frameAuthVerify(const FrameAuthKey &authKey, FrameDirection direction, const uint8_t header[FRAME_AUTH_HEADER_LENGTH],
+                     const uint8_t *payload, size_t length, const uint8_t trailer[FRAME_AUTH_TRAILER_LENGTH],
+                     uint32_t *frameCounter);
+// average time in ns to verify a frame with a payload of `length` bytes
+uint32_t frameAuthBenchmarkNs(uint32_t frames, size_t length);
+
+#endif
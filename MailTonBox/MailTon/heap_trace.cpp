@@ -0,0 +1,174 @@
+/**
+ * @file heap_trace.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Opt-in heap instrumentation for MailTon (see heap_trace.h).
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include "heap_trace.h"
+
+#ifdef MAILTON_HEAP_TRACE
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef ESP_PLATFORM
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#define heapTraceUsableSize(ptr) heap_caps_get_allocated_size(ptr)
+#define heapTraceCurrentOwner() ((void *)xTaskGetCurrentTaskHandle())
+#else
+#include <malloc.h>
+#define heapTraceUsableSize(ptr) malloc_usable_size(ptr)
+#define heapTraceCurrentOwner() ((void *)nullptr)
+#endif
+
+extern "C" {
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+}
+
+static HeapTraceStats stats = {};
+static volatile HeapSite currentSite = HEAP_SITE_OTHER;
+// task that opened the current site, allocations of other tasks go in HEAP_SITE_OTHER
+static void *volatile currentOwner = nullptr;
+
+static const char *const HEAP_SITE_NAMES[HEAP_SITE_COUNT] = {
+    "other",
+    "onLoRaReceive",
+    "handleLoRaPacket",
+    "extractValue",
+    "handleNewMessages",
+    "loadCtrlMailBoxCredentials",
+    "formatMessage"
+};
+
+const char *heapSiteName(HeapSite site) {
+    return site < HEAP_SITE_COUNT ? HEAP_SITE_NAMES[site] : "?";
+}
+
+static void recordAllocation(void *ptr) {
+    if (ptr == nullptr) return;
+    uint32_t size = heapTraceUsableSize(ptr);
+
+    __atomic_fetch_add(&stats.allocations, 1, __ATOMIC_RELAXED);
+    uint32_t live = __atomic_add_fetch(&stats.liveBytes, size, __ATOMIC_RELAXED);
+    if (live > stats.peakLiveBytes) stats.peakLiveBytes = live; // best effort, races only lose a peak
+
+    HeapSite site = currentSite;
+    if (site != HEAP_SITE_OTHER && currentOwner != heapTraceCurrentOwner()) site = HEAP_SITE_OTHER;
+    __atomic_fetch_add(&stats.sites[site].allocations, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats.sites[site].bytes, size, __ATOMIC_RELAXED);
+}
+
+static void recordFree(uint32_t size) {
+    __atomic_fetch_add(&stats.frees, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&stats.liveBytes, size, __ATOMIC_RELAXED);
+}
+
+extern "C" void *__wrap_malloc(size_t size) {
+    void *ptr = __real_malloc(size);
+    recordAllocation(ptr);
+    return ptr;
+}
+
+extern "C" void *__wrap_calloc(size_t count, size_t size) {
+    void *ptr = __real_calloc(count, size);
+    recordAllocation(ptr);
+    return ptr;
+}
+
+extern "C" void *__wrap_realloc(void *ptr, size_t size) {
+    uint32_t oldSize = ptr ? heapTraceUsableSize(ptr) : 0;
+    void *newPtr = __real_realloc(ptr, size);
+    // on failure the old block is still valid, unless it was a realloc(ptr, 0)
+    if (ptr && (newPtr || size == 0)) recordFree(oldSize);
+    recordAllocation(newPtr);
+    return newPtr;
+}
+
+extern "C" void __wrap_free(void *ptr) {
+    if (ptr) recordFree(heapTraceUsableSize(ptr));
+    __real_free(ptr);
+}
+
+HeapTraceScope::HeapTraceScope(HeapSite site) : previous(currentSite), previousOwner(currentOwner) {
+    currentOwner = heapTraceCurrentOwner();
+    currentSite = site;
+}
+
+HeapTraceScope::~HeapTraceScope() {
+    currentSite = previous;
+    currentOwner = previousOwner;
+}
+
+void heapTraceSample() {
+#ifdef ESP_PLATFORM
+    uint32_t freeHeap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    uint32_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    uint32_t minFree = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+#else
+    // the host build only has the allocation counters
+    uint32_t freeHeap = 0, largest = 0, minFree = 0;
+#endif
+    stats.freeHeap = freeHeap;
+    stats.largestFreeBlock = largest;
+    if (stats.minFreeHeap == 0 || minFree < stats.minFreeHeap) stats.minFreeHeap = minFree;
+
+    // fragmentation: how much of the free memory is not usable for the biggest allocation
+    stats.fragmentation = freeHeap ? (uint8_t)(100 - (uint64_t)largest * 100 / freeHeap) : 0;
+    if (stats.fragmentation > stats.maxFragmentation) stats.maxFragmentation = stats.fragmentation;
+}
+
+HeapTraceStats heapTraceSnapshot() {
+    return stats;
+}
+
+uint32_t heapTraceAllocations() {
+    return __atomic_load_n(&stats.allocations, __ATOMIC_RELAXED);
+}
+
+uint32_t heapTraceSiteAllocations(HeapSite site) {
+    return site < HEAP_SITE_COUNT ? __atomic_load_n(&stats.sites[site].allocations, __ATOMIC_RELAXED) : 0;
+}
+
+#ifdef ARDUINO
+void heapTracePrint(Print &out) {
+    HeapTraceStats s = heapTraceSnapshot();
+    out.printf("HEAP free=%u min=%u largest=%u frag=%u%% maxfrag=%u%%\n",
+               (unsigned)s.freeHeap, (unsigned)s.minFreeHeap, (unsigned)s.largestFreeBlock,
+               (unsigned)s.fragmentation, (unsigned)s.maxFragmentation);
+    out.printf("HEAP allocs=%u frees=%u live=%u peak=%u\n",
+               (unsigned)s.allocations, (unsigned)s.frees, (unsigned)s.liveBytes, (unsigned)s.peakLiveBytes);
+    for (int i = 0; i < HEAP_SITE_COUNT; i++) {
+        out.printf("HEAP  %s: allocs=%u bytes=%u\n",
+                   heapSiteName((HeapSite)i), (unsigned)s.sites[i].allocations, (unsigned)s.sites[i].bytes);
+    }
+}
+#endif
+
+size_t heapTraceJson(char *buffer, size_t size) {
+    HeapTraceStats s = heapTraceSnapshot();
+    int n = snprintf(buffer, size,
+                     "{\"free\":%u,\"min_free\":%u,\"largest_block\":%u,\"fragmentation\":%u,"
+                     "\"max_fragmentation\":%u,\"allocations\":%u,\"frees\":%u,\"live\":%u,\"peak_live\":%u,\"sites\":{",
+                     (unsigned)s.freeHeap, (unsigned)s.minFreeHeap, (unsigned)s.largestFreeBlock,
+                     (unsigned)s.fragmentation, (unsigned)s.maxFragmentation, (unsigned)s.allocations,
+                     (unsigned)s.frees, (unsigned)s.liveBytes, (unsigned)s.peakLiveBytes);
+    for (int i = 0; i < HEAP_SITE_COUNT && n > 0 && (size_t)n < size; i++) {
+        n += snprintf(buffer + n, size - n, "%s\"%s\":{\"allocations\":%u,\"bytes\":%u}",
+                      i ? "," : "", heapSiteName((HeapSite)i),
+                      (unsigned)s.sites[i].allocations, (unsigned)s.sites[i].bytes);
+    }
+    if (n > 0 && (size_t)n < size) n += snprintf(buffer + n, size - n, "}}");
+    return (n > 0 && (size_t)n < size) ? n : 0;
+}
+
+#endif
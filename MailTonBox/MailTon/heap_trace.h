@@ -0,0 +1,99 @@
+/**
+ * @file heap_trace.h
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Opt-in heap instrumentation for MailTon.
+ *
+ * Enabled by building with -DMAILTON_HEAP_TRACE and the linker flags
+ * -Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc -Wl,--wrap=free
+ * (both work in PlatformIO `build_flags` and in a host build with GCC, where
+ * everything but the Serial report is available; on the host also link with
+ * -static-libstdc++, or operator new calls the unwrapped malloc).
+ * Every allocation is counted globally and charged to the call site that is
+ * currently open with HEAP_TRACE_SCOPE(). The heap is also sampled to keep
+ * the low-water mark of free memory and the worst fragmentation seen.
+ * Without the flag the macros expand to nothing.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef HEAP_TRACE_H
+#define HEAP_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// call sites that are tracked separately, everything else goes in HEAP_SITE_OTHER
+enum HeapSite : uint8_t {
+    HEAP_SITE_OTHER = 0,
+    HEAP_SITE_LORA_RECEIVE,
+    HEAP_SITE_LORA_PACKET,
+    HEAP_SITE_EXTRACT_VALUE,
+    HEAP_SITE_HANDLE_MESSAGES,
+    HEAP_SITE_LOAD_CREDENTIALS,
+    HEAP_SITE_FORMAT_MESSAGE,       // must stay at zero, the reports are heap-free (test/test_allocations.cpp)
+    HEAP_SITE_COUNT
+};
+
+struct HeapSiteStats {
+    uint32_t allocations;
+    uint32_t bytes;
+};
+
+struct HeapTraceStats {
+    uint32_t allocations;        // malloc/calloc/realloc calls
+    uint32_t frees;
+    uint32_t liveBytes;          // bytes currently allocated through the wrappers
+    uint32_t peakLiveBytes;
+    uint32_t freeHeap;           // last sample
+    uint32_t minFreeHeap;        // lowest free heap ever seen
+    uint32_t largestFreeBlock;   // last sample
+    uint8_t fragmentation;       // last sample, 0-100 %
+    uint8_t maxFragmentation;
+    HeapSiteStats sites[HEAP_SITE_COUNT];
+};
+
+#ifdef MAILTON_HEAP_TRACE
+
+#ifdef ARDUINO
+#include <Print.h>
+#endif
+
+const char *heapSiteName(HeapSite site);
+
+// opens a call site for the lifetime of the object, nested scopes restore the previous one
+class HeapTraceScope {
+public:
+    explicit HeapTraceScope(HeapSite site);
+    ~HeapTraceScope();
+private:
+    HeapSite previous;
+    void *previousOwner;
+};
+
+#define HEAP_TRACE_SCOPE(site) HeapTraceScope heapTraceScope_(site)
+
+// sample free heap, largest free block and fragmentation
+void heapTraceSample();
+// copy of the counters, taken at the time of the call
+HeapTraceStats heapTraceSnapshot();
+// allocations made so far, used to check that a code path does not allocate
+uint32_t heapTraceAllocations();
+// allocations charged to a call site so far, only those of the task that opened it
+uint32_t heapTraceSiteAllocations(HeapSite site);
+#ifdef ARDUINO
+// report on Serial (or any other Print)
+void heapTracePrint(Print &out);
+#endif
+// JSON report for the /heap route
+size_t heapTraceJson(char *buffer, size_t size);
+
+#else
+
+#define HEAP_TRACE_SCOPE(site)
+
+#endif
+
+#endif
@@ -369,7 +369,7 @@ const char index_html[] = R"rawliteral(
                     <label for="ctrlmailboxkey">CtrlMailBox KEY*:</label><br>
                     <input placeholder="Enter your CtrlMailBox KEY" type="password" id="ctrlmailboxkey" name="ctrlmailboxkey" required><br>
                     <label for="ctrlmailboxname">CtrlMailBox Name*:</label><br>
-                    <input type="text" placeholder="Enter your CtrlMailBox Name" id="ctrlmailboxname" name="ctrlmailboxname" required>
+                    <input type="text" placeholder="Enter your CtrlMailBox Name" id="ctrlmailboxname" name="ctrlmailboxname" maxlength="16" required>
                     <label for="ctrlmailboxaddress">CtrlMailBox address*:</label><br>
                     <input type="text" id="ctrlmailboxaddress" name="ctrlmailboxaddress" placeholder="0xABCD" pattern="0x[0-9A-Fa-f]{1,4}" required><br><br>
                 </div>
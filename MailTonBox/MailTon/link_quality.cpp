@@ -0,0 +1,78 @@
+/**
+ * @file link_quality.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Statistics of the LoRa link of every CtrlMailBox (see link_quality.h).
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <stdio.h>
+#include "link_quality.h"
+#include "frame_auth.h"
+
+// the first frame after a restart is at least FRAME_COUNTER_JUMP - FRAME_COUNTER_SAVE_PERIOD + 1 after the last one
+static_assert(FRAME_COUNTER_JUMP - FRAME_COUNTER_SAVE_PERIOD + 1 > LINK_MAX_FRAME_GAP,
+              "a restart of the CtrlMailBox would be counted as lost frames");
+
+void linkQualityReset(LinkQuality &link) {
+    link = {};
+    sketchReset(link.rssi);
+    sketchReset(link.snr);
+    sketchReset(link.rtt);
+}
+
+void linkQualityRecordUplink(LinkQuality &link, uint32_t frameCounter, int rssi, float snr, uint32_t nowMs) {
+    if (link.frameCounterValid) {
+        uint32_t gap = frameCounter - link.lastFrameCounter;
+        if (gap > 1 && gap <= LINK_MAX_FRAME_GAP) link.lost += gap - 1;
+    }
+    link.lastFrameCounter = frameCounter;
+    link.frameCounterValid = true;
+    link.packets++;
+    link.lastSeenMs = nowMs;
+    sketchAdd(link.rssi, rssi);
+    sketchAdd(link.snr, snr);
+}
+
+void linkQualityRecordRtt(LinkQuality &link, uint32_t rttMs) {
+    sketchAdd(link.rtt, rttMs);
+}
+
+void linkQualityMerge(LinkQuality &summary, const LinkQuality &link) {
+    if (link.packets > 0 && (summary.packets == 0 || (int32_t)(link.lastSeenMs - summary.lastSeenMs) > 0)) {
+        summary.lastSeenMs = link.lastSeenMs;
+    }
+    summary.packets += link.packets;
+    summary.lost += link.lost;
+    summary.retries += link.retries;
+    summary.checksumFailures += link.checksumFailures;
+    sketchMerge(summary.rssi, link.rssi);
+    sketchMerge(summary.snr, link.snr);
+    sketchMerge(summary.rtt, link.rtt);
+}
+
+static int sketchJson(char *buffer, size_t size, const char *name, const QuantileSketch &sketch) {
+    if (sketch.count == 0) return snprintf(buffer, size, ",\"%s\":{\"n\":0}", name);
+    return snprintf(buffer, size, ",\"%s\":{\"n\":%u,\"min\":%.1f,\"p5\":%.1f,\"p50\":%.1f,\"p95\":%.1f,\"max\":%.1f}",
+                    name, (unsigned)sketch.count, sketch.min, sketchQuantile(sketch, 0.05f),
+                    sketchQuantile(sketch, 0.5f), sketchQuantile(sketch, 0.95f), sketch.max);
+}
+
+size_t linkQualityJson(char *buffer, size_t size, const LinkQuality &link, uint32_t nowMs) {
+    uint32_t sent = link.packets + link.lost;
+    int n = snprintf(buffer, size, "{\"packets\":%u,\"lost\":%u,\"loss\":%.3f,\"retries\":%u,\"checksum_failures\":%u",
+                     (unsigned)link.packets, (unsigned)link.lost, sent ? (float)link.lost / sent : 0.0f,
+                     (unsigned)link.retries, (unsigned)link.checksumFailures);
+    if (n > 0 && (size_t)n < size) {
+        n += link.packets ? snprintf(buffer + n, size - n, ",\"last_seen_s\":%u", (unsigned)((nowMs - link.lastSeenMs) / 1000))
+                          : snprintf(buffer + n, size - n, ",\"last_seen_s\":null");
+    }
+    if (n > 0 && (size_t)n < size) n += sketchJson(buffer + n, size - n, "rssi", link.rssi);
+    if (n > 0 && (size_t)n < size) n += sketchJson(buffer + n, size - n, "snr", link.snr);
+    if (n > 0 && (size_t)n < size) n += sketchJson(buffer + n, size - n, "rtt_ms", link.rtt);
+    if (n > 0 && (size_t)n < size) n += snprintf(buffer + n, size - n, "}");
+    return (n > 0 && (size_t)n < size) ? n : 0;
+}
@@ -0,0 +1,57 @@
+/**
+ * @file link_quality.h
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Statistics of the LoRa link of every CtrlMailBox, kept by MailTon.
+ *
+ * For every CtrlMailBox MailTon counts the uplinks, the frames lost (gaps in
+ * the frame counter of the trailer, which grows at every transmission), the
+ * retransmissions received again after a lost ACK and the checksum failures,
+ * and keeps the distribution of RSSI, SNR and round trip of the ACK (RTT=ms,
+ * measured by the CtrlMailBox) in three quantile sketches. About 460 bytes
+ * per device. The links merge into a summary of the gateway and are exported
+ * as JSON on /status, to spot the weak links of a building at a glance.
+ * No Arduino dependency: the statistics also build on the host.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef LINK_QUALITY_H
+#define LINK_QUALITY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "quantile_sketch.h"
+
+// bigger jumps of the frame counter are restarts of the CtrlMailBox, not losses
+// (its counter restarts FRAME_COUNTER_JUMP after the last value saved in the flash)
+#define LINK_MAX_FRAME_GAP 64
+
+// size of the JSON object of a link
+#define LINK_QUALITY_JSON_SIZE 512
+
+struct LinkQuality {
+    uint32_t packets;           // authentic uplinks
+    uint32_t lost;              // frames missing in the frame counter sequence
+    uint32_t retries;           // retransmissions of a message already received
+    uint32_t checksumFailures;
+    uint32_t lastFrameCounter;
+    bool frameCounterValid;
+    uint32_t lastSeenMs;
+    QuantileSketch rssi;        // dBm
+    QuantileSketch snr;         // dB
+    QuantileSketch rtt;         // ms
+};
+
+void linkQualityReset(LinkQuality &link);
+void linkQualityRecordUplink(LinkQuality &link, uint32_t frameCounter, int rssi, float snr, uint32_t nowMs);
+void linkQualityRecordRtt(LinkQuality &link, uint32_t rttMs);
+// adds `link` to the summary of the gateway: counters summed and sketches merged
+void linkQualityMerge(LinkQuality &summary, const LinkQuality &link);
+// JSON object with the counters, the loss ratio and min/p5/p50/p95/max of the sketches,
+// returns its length (0 if it does not fit)
+size_t linkQualityJson(char *buffer, size_t size, const LinkQuality &link, uint32_t nowMs);
+
+#endif
@@ -0,0 +1,85 @@
+/**
+ * @file lora_airtime.h
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief LoRa time-on-air calculator and EU868 duty-cycle scheduler.
+ *
+ * Shared by MailTon and CtrlMailBox (keep the two copies identical).
+ * The time on air follows the Semtech formula (AN1200.13) for the radio
+ * settings below, which both firmwares apply at startup.
+ * The duty cycle is enforced per ETSI sub-band over a rolling window of one
+ * hour, split in one-minute slots: a transmission is deferred until enough
+ * old slots leave the window to fit its airtime in the sub-band budget.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef LORA_AIRTIME_H
+#define LORA_AIRTIME_H
+
+#include <stdint.h>
+
+// radio settings shared by MailTon and CtrlMailBox
+#define LORA_FREQUENCY 868000000UL  // must match the frequency used by IoTBoard::init_lora()
+#define LORA_SPREADING_FACTOR 7
+#define LORA_BANDWIDTH 125000UL
+#define LORA_CODING_RATE 5           // 4/5
+#define LORA_PREAMBLE_LENGTH 8
+#define LORA_CRC false
+#define LORA_HEADER_LENGTH 5         // recipient, sender, msg ID, length, checksum
+
+// rolling window of the duty cycle
+#define DUTY_CYCLE_WINDOW_MS 3600000UL
+#define DUTY_CYCLE_SLOTS 60
+#define DUTY_CYCLE_SLOT_MS (DUTY_CYCLE_WINDOW_MS / DUTY_CYCLE_SLOTS)
+#define DUTY_CYCLE_BANDS 6
+
+struct LoRaAirtimeConfig {
+    uint8_t spreadingFactor;    // 6-12
+    uint32_t bandwidth;         // Hz
+    uint8_t codingRate;         // denominator of 4/x, 5-8
+    uint16_t preambleLength;    // symbols
+    bool crc;
+    bool implicitHeader;
+};
+
+struct DutyCycleStats {
+    uint32_t transmissions;     // transmissions allowed
+    uint32_t deferrals;         // transmissions postponed because the budget was exhausted
+    uint32_t deferredMs;        // total waiting time requested to the callers
+    uint32_t maxDeferralMs;
+    uint32_t airtimeMs;         // total airtime of the allowed transmissions
+};
+
+// airtime of the window kept in the RTC memory during a deep sleep of CtrlMailBox
+struct DutyCycleSnapshot {
+    uint32_t lastSlot[DUTY_CYCLE_BANDS];
+    uint16_t usedMs[DUTY_CYCLE_BANDS][DUTY_CYCLE_SLOTS];
+    uint32_t clockOffsetMs;
+    DutyCycleStats stats;
+};
+
+// configuration applied by both firmwares
+extern const LoRaAirtimeConfig LORA_AIRTIME_CONFIG;
+
+// time on air of a LoRa packet with `payloadLength` bytes (everything after the preamble)
+uint32_t loraTimeOnAirUs(const LoRaAirtimeConfig &config, uint8_t payloadLength);
+// time on air with the shared configuration, rounded up to ms
+uint32_t loraTimeOnAirMs(uint8_t payloadLength);
+
+/**
+ * @brief checks the duty cycle of the sub-band of `frequency` before a transmission.
+ * If the airtime fits in the rolling budget it is accounted and the function returns true,
+ * otherwise the transmission must be deferred by `*waitMs` milliseconds.
+ */
+bool dutyCycleTryTransmit(uint32_t frequency, uint32_t airtimeMs, uint32_t nowMs, uint32_t *waitMs);
+// budget left in the sub-band of `frequency` over the last hour
+uint32_t dutyCycleRemainingMs(uint32_t frequency, uint32_t nowMs);
+const DutyCycleStats &dutyCycleStats();
+void dutyCycleSave(DutyCycleSnapshot &snapshot);
+// the clock restarted after the deep sleep: it was shiftMs ahead of the clock of the snapshot
+void dutyCycleRestore(const DutyCycleSnapshot &snapshot, uint32_t shiftMs);
+
+#endif
@@ -0,0 +1,63 @@
+/**
+ * @file lora_tx.h
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Non-blocking LoRa transmission, completed by the TxDone interrupt.
+ *
+ * Shared by MailTon and CtrlMailBox (keep the two copies identical).
+ * The firmware starts the transmission with endPacket(true) and returns to
+ * loop() at once. The TxDone callback runs in the interrupt of the radio: it
+ * only records the time and marks the frame as sent. loop() then polls the
+ * state, puts the radio back in receive (or asleep) and records the TX
+ * latency, from endPacket() to TxDone, against the expected time on air. A
+ * lost interrupt ends the transmission after the time on air plus
+ * LORA_TX_TIMEOUT_MARGIN_MS. No new frame and no change of mode of the radio
+ * is allowed while a frame is on air.
+ * No Arduino dependency: the state machine also builds on the host.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef LORA_TX_H
+#define LORA_TX_H
+
+#include <stdint.h>
+
+#define LORA_TX_TIMEOUT_MARGIN_MS 500
+
+enum LoraTxState : uint8_t {
+    LORA_TX_IDLE = 0,
+    LORA_TX_ON_AIR,     // endPacket(true) called, waiting for TxDone
+    LORA_TX_DONE        // TxDone received, loop() has not seen it yet
+};
+
+struct LoraTxStats {
+    uint32_t frames;
+    uint32_t timeouts;      // TxDone lost, the frame was ended by the timeout
+    uint32_t lastMs;        // endPacket() to TxDone of the last frame
+    uint32_t avgMs;         // moving average
+    uint32_t maxMs;
+    int32_t lastOverrunMs;  // latency minus time on air of the last frame
+};
+
+struct LoraTx {
+    volatile LoraTxState state;
+    volatile uint32_t doneAt;
+    uint32_t startedAt;
+    uint32_t airtimeMs;     // expected time on air of the frame
+    LoraTxStats stats;
+};
+
+void loraTxInit(LoraTx &tx);
+// the frame was handed to the radio with endPacket(true)
+void loraTxStart(LoraTx &tx, uint32_t airtimeMs, uint32_t nowMs);
+// from the TxDone callback (interrupt)
+void loraTxOnDone(LoraTx &tx, uint32_t nowMs);
+// from loop(): true once when the frame is over (TxDone or timeout), `*doneMs` is its end
+bool loraTxPoll(LoraTx &tx, uint32_t nowMs, uint32_t *doneMs);
+// a frame is on air: the radio must not be touched
+bool loraTxBusy(const LoraTx &tx);
+
+#endif
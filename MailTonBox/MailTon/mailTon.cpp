@@ -15,7 +15,7 @@
  * - Web server to serve configuration pages and handle form submissions.
  * 
  * The system uses various libraries including Arduino, WiFi, AsyncTCP, ESPAsyncWebServer, DNSServer, Preferences, 
- * ArduinoJson, WiFiClientSecure, UniversalTelegramBot, Adafruit_Sensor, DHT, and EloquentTinyML.
+ * ArduinoJson, WiFiClientSecure, UniversalTelegramBot, and EloquentTinyML.
  * 
  * @version 3.5
  * @date 2025-03-05
@@ -35,20 +35,44 @@
 #include <ArduinoJson.h>
 #include <WiFiClientSecure.h>
 #include <UniversalTelegramBot.h>
-#include <Adafruit_Sensor.h>
-#include <DHT.h>
 #include <EloquentTinyML.h>
 #include "model.h"  // AI model
+#include "msg_format.h"
+#include "heap_trace.h"
+#include "metrics.h"
+#include "lora_airtime.h"
+#include "lora_tx.h"
+#include "packet_pool.h"
+#include "link_quality.h"
+#include "anomaly.h"
+#include "dht_sampler.h"
+#include "adr.h"
+#include "replay_window.h"
+#include "frame_auth.h"
+#include "tdma.h"
+#include "class_a.h"
+#include "telemetry.h"
 #include <index_html.h>
 
 #define DHTPIN  D1   
-#define DHTTYPE DHT11 
-DHT dht(DHTPIN, DHTTYPE);
-
-
-#define NUMBER_OF_INPUTS 3  // used number of features
-#define NUMBER_OF_OUTPUTS 3 // regression output
+#define DHT_SAMPLE_PERIOD_MS 10000  // one reading for every prediction
+#define DHT_STALE_MS 30000          // older readings are reported as an error
+
+
+#define NUMBER_OF_INPUTS 2  // temperature and humidity, the features of the model (model.ipynb)
+// the three heads of the multi-task model, concatenated in one output tensor by the export of model.ipynb:
+// ppm scaled in 0-1, probabilities of the temperature/humidity classes, probabilities of the ppm classes
+#define TH_CLASS_COUNT 9
+#define PPM_CLASS_COUNT 4
+#define OUTPUT_PPM 0
+#define OUTPUT_TH_CLASSES 1
+#define OUTPUT_PPM_CLASSES (OUTPUT_TH_CLASSES + TH_CLASS_COUNT)
+#define NUMBER_OF_OUTPUTS (OUTPUT_PPM_CLASSES + PPM_CLASS_COUNT)
+#define TH_DANGER_CLASS 6   // from here on the temperature/humidity classes are dangerous (high temperature)
+#define PPM_DANGER_CLASS 3  // from here on the ppm classes are dangerous (very poor air quality)
 #define TENSOR_ARENA_SIZE 8*1024  // memory size for Tensorflow Lite
+static_assert(TH_CLASS_COUNT == sizeof(TEMP_HUMIDITY_CLASS_NAMES) / sizeof(TEMP_HUMIDITY_CLASS_NAMES[0]), "one name per class");
+static_assert(PPM_CLASS_COUNT == sizeof(PPM_CLASS_NAMES) / sizeof(PPM_CLASS_NAMES[0]), "one name per class");
 
 // init object tinyml
 Eloquent::TinyML::TfLite<NUMBER_OF_INPUTS, NUMBER_OF_OUTPUTS, TENSOR_ARENA_SIZE> ml;
@@ -60,7 +84,7 @@ Eloquent::TinyML::TfLite<NUMBER_OF_INPUTS, NUMBER_OF_OUTPUTS, TENSOR_ARENA_SIZE>
 // minimum and maximum of the second feature
 #define INPUT_MIN_2 0.0  
 #define INPUT_MAX_2 100.0 
-// minimum and maximum of the third feature
+// minimum and maximum of the ppm, to decode the regression output
 #define INPUT_MIN_3 0.0 
 #define INPUT_MAX_3 50.0
 
@@ -68,10 +92,13 @@ float temperature, humidity = 0.0;
 float ppm_value = 0.0;
 int temp_humidity_class = 0;
 int ppm_class = 0;
+AnomalyDetector anomalyDetector;    // decides when the predictions are worth an alert
 
 void DetectionAndPrediction();
-String tempHumidityClassToText(int value);
-String ppmClassToText(int value);
+const char *renderAiReport(const char *reportTemplate);
+
+// preallocated buffer for the Telegram reports
+char messageBuffer[MSG_BUFFER_SIZE];
 
 //server object port 80 
 AsyncWebServer server(80);
@@ -133,11 +160,56 @@ const size_t MAX_CTRLMBOX_DEVICES = 10;
 String CTRLMAILBOX_KEYS[MAX_CTRLMBOX_DEVICES];
 String CTRLMAILBOX_NAMES[MAX_CTRLMBOX_DEVICES];
 uint16_t CTRLMAILBOX_ADDR[MAX_CTRLMBOX_DEVICES];
+// keys of the frames (derived from the keys above, which are not sent on air) and frame counters
+FrameAuthKey CTRLMAILBOX_FRAME_KEYS[MAX_CTRLMBOX_DEVICES];
+uint32_t uplinkCounters[MAX_CTRLMBOX_DEVICES];     // last frame counter accepted from every CtrlMailBox
+bool uplinkCounterValid[MAX_CTRLMBOX_DEVICES];
+uint32_t downlinkCounter = 0;                      // frame counter of the next reply
+uint32_t savedDownlinkCounter = 0;                 // last value written in the preferences
+AdrLinkStats linkStats[MAX_CTRLMBOX_DEVICES]; // link margin of every CtrlMailBox, for the ADR
+LinkQuality linkQuality[MAX_CTRLMBOX_DEVICES]; // counters and RSSI/SNR/RTT quantiles of every link, on /status
+// ARQ receiver of every CtrlMailBox: highest sequence received in order and the ones received after it
+struct ArqReceiver {
+    uint8_t cumulative;
+    uint8_t received;   // bit i = sequence cumulative + 1 + i received
+    bool valid;
+};
+ArqReceiver arqReceivers[MAX_CTRLMBOX_DEVICES];
+ReplayTable replayTable; // message IDs already received from every sender, to drop the retransmissions
+static_assert(REPLAY_TABLE_SIZE >= 2 * MAX_CTRLMBOX_DEVICES, "the replay table must stay at most half full");
+TelemetrySample lastTelemetry[MAX_CTRLMBOX_DEVICES]; // last state reported by every CtrlMailBox
+bool lastTelemetryValid[MAX_CTRLMBOX_DEVICES];
+bool deviceClassA[MAX_CTRLMBOX_DEVICES];  // the CtrlMailBox asked for class A windows: it gets no TDMA slot
 unsigned int devicesCounter = 0;
-// variables for ACK and NACK
-String pendingReplyMessage = "";
-uint16_t pendingReplyAddress = 0;
-bool loraAckPending = false;
+// ACK and NACK: every reply is a timed job, the packets received while it waits are still handled
+#define REPLY_QUEUE_SIZE PACKET_POOL_SIZE
+#define CLASS_A_REPLY_STEP_MS 10  // starts tried in a class A window, also the time left to the radio to listen
+struct PendingReply {
+    bool used;
+    String message;                 // ACK or NACK
+    String events;                  // events of the frame, notified once the ACK is sent
+    uint16_t address;
+    int seq;                        // sequence of the message to acknowledge
+    bool duplicate;                 // the message was already processed, only the ACK is repeated
+    bool classA;                    // the CtrlMailBox listens only in its class A windows
+    unsigned long rxEnd;            // end of the uplink, the slot and the windows are counted from here
+    unsigned long deferredUntil;    // the reply waits for the duty cycle budget
+};
+PendingReply pendingReplies[REPLY_QUEUE_SIZE];
+PendingReply *newPendingReply(uint16_t address, int seq, unsigned long rxEnd, bool classA);
+bool sendMessageLoRa(PendingReply &reply);
+// beacons with the TDMA slots of the registry
+FrameAuthKey beaconKey;
+bool beaconSent = false;
+unsigned long lastBeaconTime = 0;    // end of the last beacon, time base of the slots
+TdmaSync gatewaySchedule = {};      // slots announced by the last beacon, the replies stay in them
+unsigned long beaconDeferredUntil = 0;
+// replies and beacons go on air without waiting, onLoRaSend() ends them (see lora_tx.h)
+LoraTx loraTx;
+bool beaconOnAir = false;
+uint8_t beaconId = 0;
+// the beacon with the whole registry, it is not sent if a reply is due before it ends
+const uint32_t BEACON_MAX_AIRTIME_MS = loraTimeOnAirMs(LORA_HEADER_LENGTH + TDMA_BEACON_FIXED_LENGTH + MAX_CTRLMBOX_DEVICES + FRAME_AUTH_TRAILER_LENGTH);
 
 void resetDevice() {
     // opens all preferences to delete them
@@ -173,6 +245,16 @@ struct CtrlMailboxInfo {
     String key;
 };
 
+// index of the CtrlMailBox in the registry, -1 if not found
+int getCtrlMailboxIndexByAddress(const uint16_t &address) {
+    for (int i = 0; i < MAX_CTRLMBOX_DEVICES; i++) {
+        if ((uint16_t)CTRLMAILBOX_ADDR[i] == (uint16_t)address) {
+            return i;
+        }
+    }
+    return -1;
+}
+
 CtrlMailboxInfo getCtrlMailboxInfoByAddress(const uint16_t &address) {
     for (int i = 0; i < MAX_CTRLMBOX_DEVICES; i++) {
         if ((uint16_t)CTRLMAILBOX_ADDR[i] == (uint16_t)address) {
@@ -182,8 +264,30 @@ CtrlMailboxInfo getCtrlMailboxInfoByAddress(const uint16_t &address) {
     return {"UNKNOWN=^.^=", "UNKNOWN=^.^="};
 }
 
+// the downlink counter must never go back: after a restart it starts after the last
+// value saved, which is saved again every FRAME_COUNTER_SAVE_PERIOD frames
+void loadFrameCounter() {
+    preferences.begin("lora", false);
+    downlinkCounter = preferences.getUInt("fcnt", 0) + FRAME_COUNTER_JUMP;
+    preferences.putUInt("fcnt", downlinkCounter);
+    preferences.end();
+    savedDownlinkCounter = downlinkCounter;
+}
+
+uint32_t nextFrameCounter() {
+    uint32_t counter = downlinkCounter++;
+    if (downlinkCounter - savedDownlinkCounter >= FRAME_COUNTER_SAVE_PERIOD) {
+        preferences.begin("lora", false);
+        preferences.putUInt("fcnt", downlinkCounter);
+        preferences.end();
+        savedDownlinkCounter = downlinkCounter;
+    }
+    return counter;
+}
+
 // load CtrlMailBox data with Preferences
 bool loadCtrlMailBoxCredentials() {
+    HEAP_TRACE_SCOPE(HEAP_SITE_LOAD_CREDENTIALS);
     preferences.begin("devices", true);
     bool found = false;
     devicesCounter = preferences.getUInt("devicesCounter", 0);
@@ -193,6 +297,13 @@ bool loadCtrlMailBoxCredentials() {
         CTRLMAILBOX_NAMES[i] = preferences.getString(("cmbname" + String(i)).c_str(), "");
         CTRLMAILBOX_ADDR[i] = preferences.getUShort(("cmbaddr" + String(i)).c_str(), 0);
 
+        // key of the frames, derived again for the devices saved before it was provisioned
+        uint8_t frameKey[FRAME_AUTH_KEY_LENGTH];
+        if (preferences.getBytes(("cmbaes" + String(i)).c_str(), frameKey, sizeof(frameKey)) != sizeof(frameKey)) {
+            frameAuthDeriveKey(CTRLMAILBOX_KEYS[i].c_str(), MAILTON_KEY.c_str(), CTRLMAILBOX_NAMES[i].c_str(), frameKey);
+        }
+        frameAuthSetKey(CTRLMAILBOX_FRAME_KEYS[i], frameKey);
+
         // Verifica che i dati siano stati letti correttamente
         Serial.print("Loaded CMB =^.^=");
         Serial.print(i);
@@ -246,7 +357,13 @@ bool isCtrlMailBoxConfiguredFresh(const String &key, const String &name, const u
 }
 
 bool saveCtrlMailBoxCredentials(const String &newKey, const String &newName, const uint16_t &newAddress) {
-    
+    // the TDMA slots have room for the replies to names up to TDMA_MAX_NAME_LENGTH characters
+    if (newName.length() > TDMA_MAX_NAME_LENGTH) {
+        display->printf("Error: name longer than %d characters.\n", TDMA_MAX_NAME_LENGTH);
+        display->display();
+        return false;
+    }
+
     // Controllo preliminare per evitare duplicati (se implementato)
     if (isCtrlMailBoxConfiguredFresh(newKey, newName, newAddress)) {
         display->println("CtrlMailBox already exists:");
@@ -275,7 +392,20 @@ bool saveCtrlMailBoxCredentials(const String &newKey, const String &newName, con
     preferences.putString(("cmbkey" + String(index)).c_str(), newKey);
     preferences.putString(("cmbname" + String(index)).c_str(), newName);
     preferences.putUShort(("cmbaddr" + String(index)).c_str(), newAddress);
+    uint8_t frameKey[FRAME_AUTH_KEY_LENGTH];
+    frameAuthDeriveKey(newKey.c_str(), MAILTON_KEY.c_str(), newName.c_str(), frameKey);
+    preferences.putBytes(("cmbaes" + String(index)).c_str(), frameKey, sizeof(frameKey));
     preferences.end();
+    // the registry in RAM is updated at once: the next beacon gives a slot to the device
+    CTRLMAILBOX_KEYS[index] = newKey;
+    CTRLMAILBOX_NAMES[index] = newName;
+    CTRLMAILBOX_ADDR[index] = newAddress;
+    ::devicesCounter = index + 1;
+    frameAuthSetKey(CTRLMAILBOX_FRAME_KEYS[index], frameKey);
+    uplinkCounterValid[index] = false;
+    lastTelemetryValid[index] = false;
+    deviceClassA[index] = false;
+    linkQualityReset(linkQuality[index]);
 
     Serial.print("Saved CMB ");
     Serial.print(index);
@@ -415,6 +545,54 @@ void handleManifestRoute(AsyncWebServerRequest *request) {
     request->send(200, "application/json", manifest_json);
 }
 
+#ifdef MAILTON_METRICS
+// Callback for the Prometheus metrics
+void handleMetricsRoute(AsyncWebServerRequest *request) {
+    AsyncResponseStream *response = request->beginResponseStream("text/plain; version=0.0.4");
+    metricsRender(*response);
+    request->send(response);
+}
+#endif
+
+// Callback for the status of the links: every CtrlMailBox and the summary of the gateway
+void handleStatusRoute(AsyncWebServerRequest *request) {
+    static char linkReport[LINK_QUALITY_JSON_SIZE];
+    static LinkQuality summary;
+    linkQualityReset(summary);
+    uint32_t now = millis();
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    response->print("{\"devices\":[");
+    bool first = true;
+    for (size_t i = 0; i < MAX_CTRLMBOX_DEVICES; i++) {
+        if (CTRLMAILBOX_ADDR[i] == 0) continue;
+        linkQualityMerge(summary, linkQuality[i]);
+        linkQualityJson(linkReport, sizeof(linkReport), linkQuality[i], now);
+        response->printf("%s{\"name\":\"%s\",\"address\":%u,\"link\":%s}", first ? "" : ",",
+                         CTRLMAILBOX_NAMES[i].c_str(), (unsigned)CTRLMAILBOX_ADDR[i], linkReport);
+        first = false;
+    }
+    linkQualityJson(linkReport, sizeof(linkReport), summary, now);
+    const AnomalyStats &ai = anomalyDetector.stats;
+    response->printf("],\"gateway\":%s,\"ai\":{\"alerting\":%s,\"alerts\":%u,\"notifications\":%u,\"rate_limited\":%u}",
+                     linkReport, anomalyDetector.alerting ? "true" : "false", (unsigned)ai.alerts,
+                     (unsigned)ai.notifications, (unsigned)ai.rateLimited);
+    DhtStats dhtStats = dhtSamplerStats();
+    response->printf(",\"dht\":{\"transactions\":%u,\"timeouts\":%u,\"short_frames\":%u,\"bad_checksums\":%u}}",
+                     (unsigned)dhtStats.transactions, (unsigned)dhtStats.timeouts,
+                     (unsigned)dhtStats.shortFrames, (unsigned)dhtStats.badChecksums);
+    request->send(response);
+}
+
+#ifdef MAILTON_HEAP_TRACE
+// Callback for the heap report
+void handleHeapRoute(AsyncWebServerRequest *request) {
+    static char heapReport[768];
+    heapTraceSample();
+    heapTraceJson(heapReport, sizeof(heapReport));
+    request->send(200, "application/json", heapReport);
+}
+#endif
+
 // Callback to manage the form
 void handleSave(AsyncWebServerRequest *request) {
     if(request->hasParam("ssid", true) && request->hasParam("password", true)) {
@@ -511,6 +689,13 @@ void configureWiFi(wifi_mode_t mode) {
             server.on("/", HTTP_GET, handleRoot);
             server.on("/manifest.json", HTTP_GET, handleManifestRoute);
             server.on("/", HTTP_POST, handleSave);
+            server.on("/status", HTTP_GET, handleStatusRoute);
+#ifdef MAILTON_HEAP_TRACE
+            server.on("/heap", HTTP_GET, handleHeapRoute);
+#endif
+#ifdef MAILTON_METRICS
+            server.on("/metrics", HTTP_GET, handleMetricsRoute);
+#endif
             server.begin();
             
             break;
@@ -526,6 +711,13 @@ void configureWiFi(wifi_mode_t mode) {
             server.on("/", HTTP_GET, handleRoot);
             server.on("/", HTTP_POST, handleSave);
             server.on("/manifest.json", HTTP_GET, handleManifestRoute);
+            server.on("/status", HTTP_GET, handleStatusRoute);
+#ifdef MAILTON_HEAP_TRACE
+            server.on("/heap", HTTP_GET, handleHeapRoute);
+#endif
+#ifdef MAILTON_METRICS
+            server.on("/metrics", HTTP_GET, handleMetricsRoute);
+#endif
             server.begin();
 
             // configure Station mode
@@ -574,6 +766,8 @@ void configureWiFi(wifi_mode_t mode) {
  * of type `telegramMessage` struct, containing the message details
  */
 void handleNewMessages(telegramMessage m) {
+    HEAP_TRACE_SCOPE(HEAP_SITE_HANDLE_MESSAGES);
+    METRICS_TIME(TIMER_HANDLE_NEW_MESSAGES);
     bot_active = true;
     chat_id = m.chat_id;
     from_name = m.from_name;
@@ -629,16 +823,7 @@ void handleNewMessages(telegramMessage m) {
         return;
     } else if(text == "/ai"){
         DetectionAndPrediction();
-        String message = "🏠 Here are values ​​in your room in real time!  \n\n";
-        message += "    📟  Real real values ​​from Mailton: \n\n";
-        message += "        🌡️  Temperature: " + String(temperature) + " °C\n\n";
-        message += "        💧  Moisture: " + String(humidity) + " %\n\n";
-        message += "    🤖  Values ​​predicted by the AI: \n\n";
-        message += "        🔮  PPM CO predicted: " + String(ppm_value) + "\n\n";
-        message += "        📋  Temperature & Humidity Class: \n";
-        message += "               " + String(temp_humidity_class) + " = " + tempHumidityClassToText(temp_humidity_class) + "\n\n";
-        message += "        🛡️  PPM CO Class: " + String(ppm_class) + " = " + ppmClassToText(ppm_class) + "\n\n";
-        bot.sendMessage(chat_id, message);
+        if (!bot.sendMessage(chat_id, renderAiReport(AI_REPORT_TEMPLATE))) METRICS_COUNT(COUNTER_TELEGRAM_ERRORS);
         botConfigureWiFi = false;
     }else if(text == "/allert_ai"){
         allertAI = !allertAI;
@@ -701,6 +886,12 @@ void handleNewMessages(telegramMessage m) {
     }
 }
 
+// download the new messages of the bot
+int getBotUpdates() {
+    METRICS_TIME(TIMER_BOT_GET_UPDATES);
+    return bot.getUpdates(bot.last_message_received + 1);
+}
+
 /**
  * @brief Manager to send messages to the bot 
  * in relation to the messages received with LoRa
@@ -711,14 +902,16 @@ void handlerSendMessage() {
     
     if(bot_active){
         if (lora_msg == "Mailbox Opened") {
-            bot.sendMessage(chat_id, "📬 Mailbox Opened, someone is already withdrawing the mail 📭");
+            if (!bot.sendMessage(chat_id, "📬 Mailbox Opened, someone is already withdrawing the mail 📭")) METRICS_COUNT(COUNTER_TELEGRAM_ERRORS);
             digitalWrite(LED_YELLOW, LOW);
             display->println("Send to bot: Mailbox Opened");
             display->display();
         }else if (lora_msg == "New Mail"){
             static bool mFlag= false;
-            if(mFlag) bot.sendMessage(chat_id, "🔔 Lino the Postino warned me that there is placed in the mailbox! 📬");
-            else bot.sendMessage(chat_id, "🔔 PostaLino warned me that there is placed in the mailbox! 📬");
+            bool sent;
+            if(mFlag) sent = bot.sendMessage(chat_id, "🔔 Lino the Postino warned me that there is placed in the mailbox! 📬");
+            else sent = bot.sendMessage(chat_id, "🔔 PostaLino warned me that there is placed in the mailbox! 📬");
+            if (!sent) METRICS_COUNT(COUNTER_TELEGRAM_ERRORS);
             mFlag = !mFlag;
             digitalWrite(LED_YELLOW, HIGH);
             display->println("Send to bot: mail in the mailbox!");
@@ -735,6 +928,36 @@ void handlerSendMessage() {
     }
 }
 
+bool isKnownEvent(const String &event) {
+    return event == "Mailbox Opened" || event == "New Mail";
+}
+
+// notifies the events aggregated in a frame (separated by ','), one by one
+void handlerSendEvents(const String &events) {
+    int start = 0;
+    while (start < (int)events.length()) {
+        int end = events.indexOf(',', start);
+        if (end == -1) end = events.length();
+        lora_msg = events.substring(start, end);
+        if (isKnownEvent(lora_msg)) handlerSendMessage();
+        start = end + 1;
+    }
+}
+
+// counts the known and the unknown events of a DATA field
+void countEvents(const String &events, int *known, int *unknown) {
+    *known = 0;
+    *unknown = 0;
+    int start = 0;
+    while (start < (int)events.length()) {
+        int end = events.indexOf(',', start);
+        if (end == -1) end = events.length();
+        if (isKnownEvent(events.substring(start, end))) (*known)++;
+        else (*unknown)++;
+        start = end + 1;
+    }
+}
+
 // Restart message, to reactivate the sending of messages to the bot
 void SendRestartMessageBot(){
     telegramMessage restartMsg;
@@ -747,6 +970,7 @@ void SendRestartMessageBot(){
 
 // function to extract values ​​from a "key = value" string
 String extractValue(String message, String key) {
+    HEAP_TRACE_SCOPE(HEAP_SITE_EXTRACT_VALUE);
     int startIndex = message.indexOf(key + "=");
     if (startIndex == -1) return "";
     startIndex += key.length() + 1;
@@ -755,68 +979,175 @@ String extractValue(String message, String key) {
     return message.substring(startIndex, endIndex);
 }
 
-// function to receive messages Lora
+// updates the ARQ receiver with the oldest sequence not acknowledged (base) of the CtrlMailBox
+// and, if the message was accepted, with its sequence
+void arqReceiverUpdate(ArqReceiver &receiver, uint8_t base, uint8_t seq, bool accepted) {
+    uint8_t cumulative = base - 1; // everything before the base was acknowledged or given up
+    int8_t shift = (int8_t)(cumulative - receiver.cumulative);
+    if (!receiver.valid || shift < -8) {
+        // first message or the CtrlMailBox restarted with new sequences
+        receiver.cumulative = cumulative;
+        receiver.received = 0;
+        receiver.valid = true;
+    } else if (shift > 0) {
+        receiver.received = shift >= 8 ? 0 : receiver.received >> shift;
+        receiver.cumulative = cumulative;
+    }
+
+    int8_t offset = (int8_t)(seq - receiver.cumulative);
+    if (accepted && offset >= 1 && offset <= 8) receiver.received |= 1 << (offset - 1);
+    while (receiver.received & 1) {
+        receiver.cumulative++;
+        receiver.received >>= 1;
+    }
+}
+
+// function to receive messages Lora: the packet is read at once in a buffer of the pool
+// and parsed by loop(), nothing is allocated here
 void onLoRaReceive(int packetSize) {
-    if (loraAckPending) return;  // jump if there is already an answer in the queue
-    
-    lora_priority = true;
+    HEAP_TRACE_SCOPE(HEAP_SITE_LORA_RECEIVE);
     if (packetSize == 0) return;
 
-    // read packet header bytes:
-    uint16_t recipient = lora->read();    // recipient address
-    uint16_t sender = lora->read();       // sender address
-    byte incomingMsgId = lora->read();    // incoming msg ID
-    byte incomingLength = lora->read();   // incoming msg length
-    byte receivedChecksum = lora->read(); // read checksum
+    PacketBuffer *packet = packetAcquire();
+    if (packet == nullptr) {
+        METRICS_COUNT(COUNTER_LORA_RX_DROPPED);
+        return;
+    }
+    packet->length = lora->readBytes(packet->data, packetSize < PACKET_BUFFER_SIZE ? packetSize : PACKET_BUFFER_SIZE);
+    packet->rssi = lora->packetRssi();
+    packet->snr = lora->packetSnr();
+    packet->receivedAt = millis();
+    // the Telegram bot waits until loop() has handled the packet
+    if (packetQueuePush(packet)) lora_priority = true;
+    else METRICS_COUNT(COUNTER_LORA_RX_DROPPED);
+    packetRelease(packet);
+}
 
-    String incoming = ""; // payload of packet
+// function to handle the LoRa messages received, called by loop() for each packet of the queue
+void handleLoRaPacket(const PacketBuffer &packet) {
+    HEAP_TRACE_SCOPE(HEAP_SITE_LORA_PACKET);
+    METRICS_TIME(TIMER_LORA_RECEIVE);
+    METRICS_COUNT(COUNTER_LORA_PACKETS);
 
-    while (lora->available()) {         // can't use readString() in callback, so
-        incoming += (char)lora->read(); // add bytes one by one
-    }
+    // packet header bytes: recipient, sender, msg ID, msg length, checksum
+    const uint8_t *header = packet.data;
+    uint16_t recipient = header[0];
+    uint16_t sender = header[1];
+    byte incomingMsgId = header[2];
+    byte incomingLength = header[3];
+    byte receivedChecksum = header[4];
+
+    const uint8_t *payload = packet.data + LORA_HEADER_LENGTH;
+    int payloadLength = packet.length > LORA_HEADER_LENGTH ? packet.length - LORA_HEADER_LENGTH : 0;
 
     byte calculatedChecksum = 0;
-    for (int i = 0; i < incoming.length(); i++) {
-        calculatedChecksum ^= incoming[i];
+    for (int i = 0; i < payloadLength; i++) {
+        calculatedChecksum ^= payload[i];
     }
 
     // in case of errors in the checksum ignore the message, 
     // because the info of the Ctrlmailbox are inside the payload and we can't send the NACK
-    if (incomingLength != incoming.length() || receivedChecksum != calculatedChecksum) { 
+    if (packet.length < LORA_HEADER_LENGTH || incomingLength != payloadLength || payloadLength < FRAME_AUTH_TRAILER_LENGTH || receivedChecksum != calculatedChecksum) { 
         display->clearDisplay();
         display->setCursor(0,0);
         display->println("Error: checksum mismatch");
+        METRICS_COUNT(COUNTER_LORA_CHECKSUM_FAILURES);
+        // the sender may be corrupted too, the failure is charged to it when it is a known CtrlMailBox
+        int failedIndex = packet.length >= LORA_HEADER_LENGTH && sender != 0 ? getCtrlMailboxIndexByAddress(sender) : -1;
+        if (failedIndex >= 0) linkQuality[failedIndex].checksumFailures++;
         loraFlagError = true;
         return;
     }
 
-    // Extract names, key and data
+    // the text is followed by the frame counter and the MIC
+    int textLength = payloadLength - FRAME_AUTH_TRAILER_LENGTH;
+    String incoming = "";
+    incoming.concat((const char *)payload, textLength);
+
+    // Extract name and data
     String senderName = extractValue(incoming, "NAME");
-    String senderKey = extractValue(incoming, "CTRLMAILBOX_KEY");
-    String receiverKey = extractValue(incoming, "MAILTON_KEY");
     String data = extractValue(incoming, "DATA");
 
-    // If the device is not configured, the package received is ignored, 
+    // If the device is not configured or the MIC is wrong, the package received is ignored, 
     // the NACK does not take place because otherwise it communicates with an unauthorized device
-    if(!isCtrlMailBoxConfigured(senderKey, senderName, sender) || receiverKey != MAILTON_KEY){
+    int deviceIndex = getCtrlMailboxIndexByAddress(sender);
+    uint32_t frameCounter = 0;
+    bool authentic = false;
+    if (deviceIndex >= 0 && CTRLMAILBOX_NAMES[deviceIndex] == senderName) {
+        METRICS_TIME(TIMER_FRAME_VERIFY);
+        authentic = frameAuthVerify(CTRLMAILBOX_FRAME_KEYS[deviceIndex], FRAME_UPLINK, header,
+                                    payload, textLength, payload + textLength, &frameCounter);
+    }
+    if (!authentic) {
+        METRICS_COUNT(COUNTER_LORA_AUTH_FAILURES);
         display->println("Sender Name: " + senderName + ", Expected: " + CTRLMAILBOX_NAME);
-        display->println("Sender Key: " + senderKey + ", Expected: " + CTRLMAILBOX_KEY);
-        display->println("Receiver Key: " + receiverKey + ", Expected: " + MAILTON_KEY);
+        display->printf("Sender: %04X, MIC mismatch\n", sender);
         //pendingReplyMessage = "NACK";
         //pendingReplyAddress = sender;
         //loraAckPending = true; 
         return;
     }
 
-    lora_msg = data.c_str();
-    if (lora_msg != "Mailbox Opened" && lora_msg != "New Mail") {
+    // a frame counter already seen is a replay of an old frame
+    if (uplinkCounterValid[deviceIndex] && frameCounter <= uplinkCounters[deviceIndex]) {
+        METRICS_COUNT(COUNTER_LORA_AUTH_FAILURES);
+        display->printf("Replayed frame: %u\n", (unsigned)frameCounter);
+        return;
+    }
+    uplinkCounters[deviceIndex] = frameCounter;
+    uplinkCounterValid[deviceIndex] = true;
+    linkQualityRecordUplink(linkQuality[deviceIndex], frameCounter, packet.rssi, packet.snr, packet.receivedAt);
+    String rtt = extractValue(incoming, "RTT");
+    if (!rtt.isEmpty()) linkQualityRecordRtt(linkQuality[deviceIndex], rtt.toInt());
+
+    // link margin for the ADR, with the TX power declared by the CtrlMailBox
+    String txPower = extractValue(incoming, "TXP");
+    adrRecordUplink(linkStats[deviceIndex], packet.rssi, packet.snr,
+                    txPower.isEmpty() ? ADR_MAX_TX_POWER : txPower.toInt());
+
+    // the frame passed the checks, a previous error must not turn its ACK into a NACK;
+    // it is accepted if it carries a known event or some telemetry, the unknown events are ignored
+    loraFlagError = false;
+    int knownEvents, unknownEvents;
+    countEvents(data, &knownEvents, &unknownEvents);
+    String telemetry = extractValue(incoming, "TLM");
+    TelemetrySample samples[TELEMETRY_MAX_SAMPLES];
+    int sampleCount = telemetry.isEmpty() ? 0 : telemetryDecode(telemetry.c_str(), packet.receivedAt, samples, TELEMETRY_MAX_SAMPLES);
+    bool accepted = knownEvents > 0 || sampleCount > 0;
+    deviceClassA[deviceIndex] = extractValue(incoming, "RXW") == "1";
+    PendingReply *reply = newPendingReply(sender, incomingMsgId, packet.receivedAt, deviceClassA[deviceIndex]);
+    if (reply == nullptr) return; // loop() handles a packet only with room for its reply
+    reply->events = data;
+    String base = extractValue(incoming, "BASE");
+    arqReceiverUpdate(arqReceivers[deviceIndex], base.isEmpty() ? incomingMsgId : base.toInt(), incomingMsgId, accepted);
+
+    if (!accepted) {
         loraFlagError = true;
-        pendingReplyMessage = "NACK";
-        pendingReplyAddress = sender;
-        loraAckPending = true;
+        reply->message = "NACK";
         return;
     }
 
+    // a retransmission after a lost ACK is acknowledged again but not processed
+    // (only the accepted messages are recorded, a NACK does not consume the message ID)
+    ReplayResult replay;
+    {
+        METRICS_TIME(TIMER_REPLAY_LOOKUP);
+        replay = replayCheck(replayTable, sender, incomingMsgId);
+    }
+    if (replay == REPLAY_DUPLICATE) {
+        METRICS_COUNT(COUNTER_LORA_DUPLICATES);
+        linkQuality[deviceIndex].retries++;
+        reply->message = "ACK";
+        reply->duplicate = true;
+        lora->receive();
+        return;
+    }
+
+    if (sampleCount > 0) {
+        lastTelemetry[deviceIndex] = samples[sampleCount - 1];
+        lastTelemetryValid[deviceIndex] = true;
+    }
+
     count++;
     display->clearDisplay();
     display->setCursor(0,0);
@@ -826,56 +1157,263 @@ void onLoRaReceive(int packetSize) {
     display->printf("Count: %d\n", count);
     display->printf("Name: %s\n", senderName.c_str());
     display->printf("Message: %s\n", data.c_str());
-    display->printf("RSSI: %d\n", lora->packetRssi());
-    display->printf("Snr: %02f\n", lora->packetSnr());
+    if (sampleCount > 0) display->printf("Telemetry: %d samples\n", sampleCount);
+    if (unknownEvents > 0) display->printf("Unknown events: %d\n", unknownEvents);
+    display->printf("RSSI: %d\n", packet.rssi);
+    display->printf("Snr: %02f\n", packet.snr);
 
     if(!loraFlagError){
-        lora_msg = data.c_str();
-        pendingReplyMessage = "ACK";
+        reply->message = "ACK";
     } else {
-        pendingReplyMessage = "NACK";
+        reply->message = "NACK";
     }
 
-    
-    pendingReplyAddress = sender;
-    loraAckPending = true;
     lora->receive();
-    lora_priority = false;
 }
 
-void onLoRaSend(){    
+void onLoRaSend(){
+    loraTxOnDone(loraTx, millis());
 }
 
-// send message LoRa 
-void sendMessageLoRa(const String &loraSendMsg, uint16_t recipientAddress) {
-    digitalWrite(LED_RED, HIGH);
+// free entry of the reply queue for the uplink of a CtrlMailBox, nullptr if the queue is full
+PendingReply *newPendingReply(uint16_t address, int seq, unsigned long rxEnd, bool classA) {
+    for (PendingReply &reply : pendingReplies) {
+        if (reply.used) continue;
+        reply.used = true;
+        reply.message = "NACK";
+        reply.events = "";
+        reply.address = address;
+        reply.seq = seq;
+        reply.duplicate = false;
+        reply.classA = classA;
+        reply.rxEnd = rxEnd;
+        reply.deferredUntil = rxEnd;
+        return &reply;
+    }
+    return nullptr;
+}
+
+bool replyQueueFull() {
+    for (const PendingReply &reply : pendingReplies) {
+        if (!reply.used) return false;
+    }
+    return true;
+}
+
+bool replyQueueEmpty() {
+    for (const PendingReply &reply : pendingReplies) {
+        if (reply.used) return false;
+    }
+    return true;
+}
+
+// the reply can no longer reach the CtrlMailBox: it will send the message again
+void dropPendingReply(PendingReply &reply) {
+    reply.used = false;
+    METRICS_COUNT(COUNTER_LORA_REPLY_DROPPED);
+    // the retransmission is a duplicate and will not be processed: notify the events now
+    if (reply.message == "ACK" && !reply.duplicate) handlerSendEvents(reply.events);
+}
+
+// true if a TDMA reply is waiting in a slot of fromMs-toMs (at most two slots): the rest of the slot is for it
+bool slotReplyPending(uint32_t fromMs, uint32_t toMs) {
+    uint32_t fromEnd, toEnd, replyEnd;
+    if (!tdmaSlotEnd(gatewaySchedule, fromMs, &fromEnd) || !tdmaSlotEnd(gatewaySchedule, toMs, &toEnd)) return false;
+    for (const PendingReply &reply : pendingReplies) {
+        if (!reply.used || reply.classA || !tdmaSlotEnd(gatewaySchedule, reply.rxEnd, &replyEnd)) continue;
+        if (replyEnd == fromEnd || replyEnd == toEnd) return true;
+    }
+    return false;
+}
+
+// earliest start of a reply, false if it was dropped. A class A reply goes in the first receive window
+// still reachable (duty cycle included), at the first start that does not disturb the TDMA: in the
+// contention slots, or in an owned slot after the uplink of its CtrlMailBox when no reply to it is waiting
+bool replyStartTime(PendingReply &reply, uint32_t nowMs, uint32_t *startMs) {
+    if (!reply.classA) {
+        *startMs = reply.deferredUntil;
+        return true;
+    }
+    const uint32_t delays[] = {CLASS_A_RX1_DELAY_MS, CLASS_A_RX2_DELAY_MS};
+    for (uint32_t delayMs : delays) {
+        // the preamble must start while the window is open, with some time for the radio to listen
+        uint32_t windowStart = reply.rxEnd + delayMs;
+        uint32_t start = windowStart - CLASS_A_MARGIN_MS + CLASS_A_REPLY_STEP_MS;
+        uint32_t latest = windowStart + CLASS_A_MARGIN_MS - CLASS_A_REPLY_STEP_MS;
+        if ((long)(nowMs - start) > 0) start = nowMs;
+        if ((long)(reply.deferredUntil - start) > 0) start = reply.deferredUntil;  // duty cycle budget
+        for (; (long)(start - latest) <= 0; start += CLASS_A_REPLY_STEP_MS) {
+            uint32_t end = start + CLASS_A_MAX_REPLY_MS + TDMA_GUARD_MS;
+            if (tdmaContentionOnly(gatewaySchedule, start, end) ||
+                (tdmaUplinkFree(gatewaySchedule, start, end) && !slotReplyPending(start, end))) {
+                *startMs = start;
+                return true;
+            }
+        }
+    }
+    METRICS_COUNT(COUNTER_CLASS_A_MISSED);
+    dropPendingReply(reply);
+    return false;
+}
+
+// first reply of the queue to go on air and its start, nullptr if there is none
+PendingReply *nextPendingReply(uint32_t nowMs, uint32_t *startMs) {
+    PendingReply *next = nullptr;
+    for (PendingReply &reply : pendingReplies) {
+        uint32_t start;
+        if (!reply.used || !replyStartTime(reply, nowMs, &start)) continue;
+        if (next == nullptr || (long)(start - *startMs) < 0) {
+            next = &reply;
+            *startMs = start;
+        }
+    }
+    return next;
+}
+
+// sends the reply that is due; one that is not due yet is sent by a later iteration of loop()
+void sendDueReply() {
+    uint32_t start;
+    PendingReply *reply = nextPendingReply(millis(), &start);
+    if (reply == nullptr || (long)(start - millis()) > 0) return;
 
+    display->display();
+    digitalWrite(LED_RED, LOW);
+    if (sendMessageLoRa(*reply)) {
+        reply->used = false;
+        if (reply->message == "ACK" && !reply->duplicate) handlerSendEvents(reply->events);
+    }
+}
+
+// number of CtrlMailBox in the registry that use the TDMA, with their addresses in slot order
+// (a class A CtrlMailBox never uses its slot, which would only keep its replies out)
+uint8_t getBeaconAddresses(uint8_t *addresses) {
+    uint8_t count = 0;
+    for (size_t i = 0; i < MAX_CTRLMBOX_DEVICES; i++) {
+        if (CTRLMAILBOX_ADDR[i] != 0 && !deviceClassA[i]) addresses[count++] = (uint8_t)CTRLMAILBOX_ADDR[i];
+    }
+    return count;
+}
+
+// broadcast the beacon with the slots of the registry, returns false if postponed by the duty cycle
+bool sendBeaconLoRa() {
+    uint8_t addresses[MAX_CTRLMBOX_DEVICES];
+    uint8_t count = getBeaconAddresses(addresses);
+    uint8_t payload[TDMA_BEACON_FIXED_LENGTH + MAX_CTRLMBOX_DEVICES];
+    size_t length = tdmaBuildBeacon(payload, sizeof(payload), addresses, count);
+    size_t payloadLength = length + FRAME_AUTH_TRAILER_LENGTH;
+    uint32_t airtimeMs = loraTimeOnAirMs(LORA_HEADER_LENGTH + payloadLength);
+
+    uint32_t waitMs;
+    if (!dutyCycleTryTransmit(LORA_FREQUENCY, airtimeMs, millis(), &waitMs)) {
+        beaconDeferredUntil = millis() + waitMs;
+        return false;
+    }
+
+    uint8_t header[FRAME_AUTH_HEADER_LENGTH] = {
+        TDMA_BROADCAST_ADDRESS,              // every CtrlMailBox
+        (uint8_t)localAddress,               // sender address
+        beaconId++,                          // message ID
+        (uint8_t)payloadLength               // payload length, trailer included
+    };
+    uint8_t trailer[FRAME_AUTH_TRAILER_LENGTH];
+    frameAuthSign(beaconKey, FRAME_DOWNLINK, header, nextFrameCounter(), payload, length, trailer);
+
+    byte checksum = 0;
+    for (size_t i = 0; i < length; i++) checksum ^= payload[i];
+    for (int i = 0; i < FRAME_AUTH_TRAILER_LENGTH; i++) checksum ^= trailer[i];
+
+    lora->beginPacket();
+    lora->write(header, sizeof(header));
+    lora->write(checksum);
+    lora->write(payload, length);
+    lora->write(trailer, sizeof(trailer));
+    lora->endPacket(true);
+    loraTxStart(loraTx, airtimeMs, millis());
+    // the CtrlMailBoxes start counting the slots at the end of the beacon, corrected by the TxDone
+    lastBeaconTime = millis() + airtimeMs;
+    tdmaParseBeacon(gatewaySchedule, payload, length, (uint8_t)localAddress, lastBeaconTime);
+    beaconSent = true;
+    beaconOnAir = true;
+    return true;
+}
+
+// send a reply, returns false if it was not sent: dropped (unknown device, out of its slot) or postponed by the duty cycle
+bool sendMessageLoRa(PendingReply &reply) {
+    METRICS_TIME(TIMER_LORA_SEND);
+
+    const String &loraSendMsg = reply.message;
+    uint16_t recipientAddress = reply.address;
     CtrlMailboxInfo info = getCtrlMailboxInfoByAddress(recipientAddress);
     if (info.name == "UNKNOWN=^.^="){
-        loraAckPending = false;
-        return;
+        reply.used = false;
+        return false;
     }
-    String messageToSend = "NAME=" + info.name + ";CTRLMAILBOX_KEY=" + info.key + ";MAILTON_KEY=" + MAILTON_KEY + ";DATA=" + loraSendMsg;
+    String messageToSend = "NAME=" + info.name + ";DATA=" + loraSendMsg;
 
-    lora->beginPacket();
-    lora->write(recipientAddress);           // recipient address
-    lora->write(localAddress);               // sender address
-    lora->write(count_sent);                 // message ID
-    lora->write(messageToSend.length());     // payload length
+    // piggyback the TX power recommended by the ADR in the ACK
+    int deviceIndex = getCtrlMailboxIndexByAddress(recipientAddress);
+    if (loraSendMsg == "ACK" && deviceIndex >= 0) {
+        messageToSend += ";ADR_PW=" + String(adrRecommendTxPower(linkStats[deviceIndex], LORA_SPREADING_FACTOR));
+    }
+    // selective (SEQ) and cumulative (CUM) acknowledgement for the ARQ of the CtrlMailBox
+    if (reply.seq >= 0) {
+        messageToSend += ";SEQ=" + String(reply.seq);
+        if (deviceIndex >= 0 && arqReceivers[deviceIndex].valid) {
+            messageToSend += ";CUM=" + String(arqReceivers[deviceIndex].cumulative);
+        }
+    }
+    size_t payloadLength = messageToSend.length() + FRAME_AUTH_TRAILER_LENGTH;
+    uint32_t airtimeMs = loraTimeOnAirMs(LORA_HEADER_LENGTH + payloadLength);
+
+    // the reply must end in the slot of the uplink: later it would fall on the frame of the next CtrlMailBox
+    uint32_t slotEnd;
+    if (!reply.classA && tdmaSlotEnd(gatewaySchedule, reply.rxEnd, &slotEnd) &&
+        (long)(millis() + airtimeMs + TDMA_GUARD_MS - slotEnd) > 0) {
+        METRICS_COUNT(COUNTER_LORA_REPLY_LATE);
+        dropPendingReply(reply);
+        return false;
+    }
+
+    // respect the duty cycle of the sub-band, the reply stays pending until there is budget
+    uint32_t waitMs;
+    if (!dutyCycleTryTransmit(LORA_FREQUENCY, airtimeMs, millis(), &waitMs)) {
+        reply.deferredUntil = millis() + waitMs;
+        METRICS_COUNT(COUNTER_LORA_REPLY_DEFERRED);
+        return false;
+    }
+
+    digitalWrite(LED_RED, HIGH);
+
+    uint8_t header[FRAME_AUTH_HEADER_LENGTH] = {
+        (uint8_t)recipientAddress,           // recipient address
+        (uint8_t)localAddress,               // sender address
+        (uint8_t)count_sent,                 // message ID
+        (uint8_t)payloadLength               // payload length, trailer included
+    };
+    uint8_t trailer[FRAME_AUTH_TRAILER_LENGTH];
+    frameAuthSign(CTRLMAILBOX_FRAME_KEYS[deviceIndex], FRAME_DOWNLINK, header, nextFrameCounter(),
+                  (const uint8_t *)messageToSend.c_str(), messageToSend.length(), trailer);
 
     byte checksum = 0;
     for (int i = 0; i < messageToSend.length(); i++) {
         checksum ^= messageToSend[i];
     }
+    for (int i = 0; i < FRAME_AUTH_TRAILER_LENGTH; i++) {
+        checksum ^= trailer[i];
+    }
+
+    lora->beginPacket();
+    lora->write(header, sizeof(header));     // recipient, sender, message ID, length
     lora->write(checksum);                   // checksum
     lora->print(messageToSend);              // message payload
+    lora->write(trailer, sizeof(trailer));   // frame counter and MIC
 
     lora->endPacket(true);
+    loraTxStart(loraTx, airtimeMs, millis());
     count_sent++;
-    delay(100);
-    loraAckPending = false;
-    lora->receive();
-    digitalWrite(LED_RED, LOW);
+    if (loraSendMsg == "ACK") METRICS_COUNT(COUNTER_LORA_ACKS);
+    else METRICS_COUNT(COUNTER_LORA_NACKS);
+    return true;
 }
 
 //? ************ debug for AI model *************
@@ -900,30 +1438,14 @@ void printClassAndProbability(float* arr, int size) {
 }
 //? *******************************************
 
-// classes conversion
-String tempHumidityClassToText(int value) {
-    switch(value) {
-        case 0: return "Low Temperature, Dry Humidity";
-        case 1: return "Low Temperature, Normal Humidity";
-        case 2: return "Low Temperature, Humid";
-        case 3: return "Medium Temperature, Dry Humidity";
-        case 4: return "Medium Temperature, Normal Humidity";
-        case 5: return "Medium Temperature, Humid";
-        case 6: return "High Temperature, Dry Humidity";
-        case 7: return "High Temperature, Normal Humidity";
-        case 8: return "High Temperature, Humid";
-        default: return "Unknown Class";
-    }
-}
-
-String ppmClassToText(int value) {
-    switch(value) {
-        case 0: return "Good Air Quality";
-        case 1: return "Moderate Air Quality";
-        case 2: return "Poor Air Quality";
-        case 3: return "Very Poor Air Quality";
-        default: return "Unknown Class";
-    }
+// render the AI report in the preallocated buffer, with no heap allocations
+const char *renderAiReport(const char *reportTemplate) {
+    HEAP_TRACE_SCOPE(HEAP_SITE_FORMAT_MESSAGE);
+    formatMessage(messageBuffer, sizeof(messageBuffer), reportTemplate,
+                  temperature, humidity, ppm_value,
+                  temp_humidity_class, classToText(TEMP_HUMIDITY_CLASS_NAMES, temp_humidity_class),
+                  ppm_class, classToText(PPM_CLASS_NAMES, ppm_class));
+    return messageBuffer;
 }
 
 // search and return the index that contains the highest probability
@@ -941,76 +1463,59 @@ int maxIndex(float* arr, int size) {
 
 void SendAllertMsgBot(){
     if (bot_active && allertAI) {
-            String message = "⚠️ Attention these are the values ​​in your room in real time!\n\n";
-            message += "    📟  Real real values ​​from Mailton: \n\n";
-            message += "        🌡️  Temperature: " + String(temperature) + " °C\n\n";
-            message += "        💧  Moisture: " + String(humidity) + " %\n\n";
-            message += "    🤖  Values ​​predicted by the AI: \n\n";
-            message += "        🔮  PPM CO predicted: " + String(ppm_value) + "\n\n";
-            message += "        📋  Temperature & Humidity Class: \n";
-            message += "               " + String(temp_humidity_class) + " = " + tempHumidityClassToText(temp_humidity_class) + "\n\n";
-            message += "        🛡️  PPM CO Class: " + String(ppm_class) + " = " + ppmClassToText(ppm_class) + "\n\n";
-            bot.sendMessage(chat_id, message);
+            if (!bot.sendMessage(chat_id, renderAiReport(AI_ALERT_TEMPLATE))) METRICS_COUNT(COUNTER_TELEGRAM_ERRORS);
     }   
 }
 
 // measurements and predictions of model values ​​ai
 void DetectionAndPrediction(){
+    METRICS_TIME(TIMER_DETECTION_PREDICTION);
 
-    // Detection with dht11 sensor
-    //display->clearDisplay();
+    // Detection with dht11 sensor: last reading of the sampler task, the bus is not touched here
     display->clearDisplay();
     display->setCursor(0,16);
-    float newT = dht.readTemperature();
-
-    if (isnan(newT)) {
+    DhtSample sample;
+    if (!dhtLatest(&sample) || millis() - sample.timestampMs > DHT_STALE_MS) {
         display->println(F("X DHT ERROR"));
         display->display();
     } else {
-    temperature = newT;
-    display->print("TEMPERATURE = ");
-    display->println(temperature);
-    display->display();
-    }
-
-    float newH = dht.readHumidity();
-
-    if (isnan(newH)) {
-    display->println(F("X DHT ERROR"));
-    display->display();
-    } else {
-    humidity = newH;
-    display->print("HUMIDITY = ");
-    display->println(humidity);
-    display->display();
-
+        temperature = sample.temperature;
+        humidity = sample.humidity;
+        display->print("TEMPERATURE = ");
+        display->println(temperature);
+        display->print("HUMIDITY = ");
+        display->println(humidity);
+        display->display();
     }
 
     // -------------------- PREDICTION AND CLASSIFICATION -----------------------
 
-    float raw_input[NUMBER_OF_INPUTS] = {temperature, humidity, ppm_value}; 
-
     // MinMaxScaler normalization
     float input[NUMBER_OF_INPUTS];
-    input[0] = (raw_input[0] - INPUT_MIN_1) / (INPUT_MAX_1 - INPUT_MIN_1);
-    input[1] = (raw_input[1] - INPUT_MIN_2) / (INPUT_MAX_2 - INPUT_MIN_2);
-    input[2] = (raw_input[2] - INPUT_MIN_3) / (INPUT_MAX_3 - INPUT_MIN_3);
+    input[0] = (temperature - INPUT_MIN_1) / (INPUT_MAX_1 - INPUT_MIN_1);
+    input[1] = (humidity - INPUT_MIN_2) / (INPUT_MAX_2 - INPUT_MIN_2);
 
     // Inference
     float y_pred[NUMBER_OF_OUTPUTS];
-    ml.predict(input, y_pred);
+    {
+        METRICS_TIME(TIMER_ML_PREDICT);
+        ml.predict(input, y_pred);
+    }
 
     // the aforementioned value of PPM decodes (if it has been climbed between 0-1)
-    ppm_value = y_pred[0] * (INPUT_MAX_3 - INPUT_MIN_3) + INPUT_MIN_3;
-    
-    temp_humidity_class = y_pred[1];
-    ppm_class = y_pred[2];
+    ppm_value = y_pred[OUTPUT_PPM] * (INPUT_MAX_3 - INPUT_MIN_3) + INPUT_MIN_3;
+
+    temp_humidity_class = maxIndex(y_pred + OUTPUT_TH_CLASSES, TH_CLASS_COUNT);
+    ppm_class = maxIndex(y_pred + OUTPUT_PPM_CLASSES, PPM_CLASS_COUNT);
 
-    temp_humidity_class = maxIndex(y_pred, 8);
-    ppm_class = maxIndex(y_pred + 9, 3);
+    // probability of a dangerous class in either head, taken as independent
+    float thDanger = 0, ppmDanger = 0;
+    for (int i = TH_DANGER_CLASS; i < TH_CLASS_COUNT; i++) thDanger += y_pred[OUTPUT_TH_CLASSES + i];
+    for (int i = PPM_DANGER_CLASS; i < PPM_CLASS_COUNT; i++) ppmDanger += y_pred[OUTPUT_PPM_CLASSES + i];
+    float dangerProbability = 1.0f - (1.0f - thDanger) * (1.0f - ppmDanger);
     
     //! debug for class value =^.^=
-    //printArray(y_pred, 13);
+    //printArray(y_pred, NUMBER_OF_OUTPUTS);
     
     Serial.print("PPM CO PREDICT: ");
     Serial.println(ppm_value);
@@ -1028,22 +1533,11 @@ void DetectionAndPrediction(){
     display->display();
 
 
-    // allert with bot every 2 hours
-    static unsigned long lastDetectionTime = 0;
-    unsigned long currentMillis = millis();
-
-    if (lastDetectionTime == 0) {
-        if (ppm_value > 760 || ppm_class >= 3 || temp_humidity_class >= 6) {
-            SendAllertMsgBot();
-        }
-        lastDetectionTime = currentMillis;
+    // allert with bot as soon as the detector finds an excursion, without repeating it (see anomaly.h)
+    if (anomalyUpdate(anomalyDetector, ppm_value, dangerProbability, millis())) {
+        Serial.printf("AI alert: causes %u, z %.1f\n", anomalyDetector.causes, anomalyDetector.channels[ANOMALY_PPM].z);
+        SendAllertMsgBot();
     }
-    if (currentMillis - lastDetectionTime >= 7200000) { // 7200000 ms = 2 hours
-        if (ppm_value > 760 || ppm_class >= 3 || temp_humidity_class >= 6) {
-            SendAllertMsgBot();
-        }
-        lastDetectionTime = currentMillis;
-    }    
 }
 
 void onBtn1Released(uint8_t pinBtn){
@@ -1063,8 +1557,16 @@ void setup() {
     display->display();
 
     if (IoTBoard::init_lora()) {
+        // radio settings used by the time-on-air calculator
+        lora->setSpreadingFactor(LORA_SPREADING_FACTOR);
+        lora->setSignalBandwidth(LORA_BANDWIDTH);
+        lora->setCodingRate4(LORA_CODING_RATE);
+        lora->setPreambleLength(LORA_PREAMBLE_LENGTH);
+        lora->disableCrc();
         lora->onReceive(onLoRaReceive);
         lora->onTxDone(onLoRaSend);
+        loraTxInit(loraTx);
+        packetPoolInit();
         lora->receive();
         display->println(F("LoRa enabled"));
     } else {
@@ -1076,7 +1578,22 @@ void setup() {
         CTRLMAILBOX_KEYS[i] = "";
         CTRLMAILBOX_NAMES[i] = "";
         CTRLMAILBOX_ADDR[i] = 0;
+        adrReset(linkStats[i]);
+        linkQualityReset(linkQuality[i]);
+        arqReceivers[i] = {};
+        uplinkCounterValid[i] = false;
+        lastTelemetryValid[i] = false;
+        deviceClassA[i] = false;
     }   
+    loadFrameCounter();
+    uint8_t beaconKeyBytes[FRAME_AUTH_KEY_LENGTH];
+    frameAuthDeriveKey(MAILTON_KEY.c_str(), MAILTON_KEY.c_str(), TDMA_BEACON_KEY_NAME, beaconKeyBytes);
+    frameAuthSetKey(beaconKey, beaconKeyBytes);
+    replayReset(replayTable);
+#ifdef MAILTON_METRICS
+    replayBenchmark(Serial, MAX_CTRLMBOX_DEVICES);
+    Serial.printf("Frame MIC verify: %u ns (40 bytes)\n", (unsigned)frameAuthBenchmarkNs(1000, 40));
+#endif
     
     if(loadCtrlMailBoxCredentials()){
         Serial.println("=^.^=");
@@ -1119,14 +1636,15 @@ void setup() {
         SendRestartMessageBot();
     }
 
-    // init dht11 sensor
-    dht.begin();
+    // init dht11 sensor, read in background
+    if (!dhtSamplerStart(DHTPIN, DHT_SAMPLE_PERIOD_MS)) Serial.println("Error in starting the DHT11 sampler!");
 
     // init AI model
     if (!ml.begin(model_data)) {
         Serial.println("Error in loading the model!");
         while (true);
     }
+    anomalyInit(anomalyDetector);
 
 }
 
@@ -1167,30 +1685,61 @@ void loop() {
         }
     }
 
-    // message received from telegram bot (TonyBot)
-    if (!lora_priority){
+    // message received from telegram bot (TonyBot); a request to Telegram blocks loop() for a while,
+    // not while a reply waits for its start
+    if (!lora_priority && replyQueueEmpty()){
         // download messages received every (Bot_lasttime + Bot_mtbs)ms
         if (connected && millis() > Bot_lasttime + Bot_mtbs) {
-            int numNewMessages = bot.getUpdates(bot.last_message_received + 1);
+            int numNewMessages = getBotUpdates();
             while (numNewMessages) {
                 for (int i = 0; i < numNewMessages; i++) {
                     handleNewMessages(bot.messages[i]);
                 }
-                numNewMessages = bot.getUpdates(bot.last_message_received + 1);
+                numNewMessages = getBotUpdates();
             }
             Bot_lasttime = millis();
         }
     } 
 
-    // reaction to the LoRa messages received
-    if (loraAckPending) {
-        display->display();
+    // end of the frame on air: the radio goes back to receive
+    uint32_t txTimeouts = loraTx.stats.timeouts;
+    uint32_t txDoneTime;
+    if (loraTxPoll(loraTx, millis(), &txDoneTime)) {
+        if (loraTx.stats.timeouts != txTimeouts) METRICS_COUNT(COUNTER_LORA_TX_TIMEOUTS);
+        else METRICS_OBSERVE_US(TIMER_LORA_TX, loraTx.stats.lastMs * 1000);
+        if (beaconOnAir) {
+            lastBeaconTime = txDoneTime;
+            gatewaySchedule.beaconAtMs = txDoneTime;
+        }
+        beaconOnAir = false;
         digitalWrite(LED_RED, LOW);
-        sendMessageLoRa(pendingReplyMessage, pendingReplyAddress);
-        delay(100);
-        if (pendingReplyMessage == "ACK") 
-            handlerSendMessage();  
-    }       
+        lora->receive();
+    }
+
+    // a LoRa packet received by the callback, parsed when there is room for its reply and no frame is on air
+    if (!replyQueueFull() && !loraTxBusy(loraTx)) {
+        PacketBuffer *packet = packetQueuePop();
+        if (packet != nullptr) {
+            handleLoRaPacket(*packet);
+            packetRelease(packet);
+            // cleared here, whatever path handleLoRaPacket() returned from
+            lora_priority = false;
+        }
+    }
+
+    // beacon with the slots, at the end of a cycle and never over a reply that is due before it ends
+    uint8_t beaconAddresses[MAX_CTRLMBOX_DEVICES];
+    uint32_t beaconPeriod = tdmaBeaconPeriodMs(getBeaconAddresses(beaconAddresses));
+    uint32_t replyStart;
+    bool replyFirst = nextPendingReply(millis(), &replyStart) != nullptr &&
+                      (long)(replyStart - millis()) < (long)(BEACON_MAX_AIRTIME_MS + TDMA_GUARD_MS);
+    if (!replyFirst && !loraTxBusy(loraTx) && (long)(millis() - beaconDeferredUntil) >= 0 &&
+        (!beaconSent || (long)(millis() - lastBeaconTime) >= (long)beaconPeriod)) {
+        sendBeaconLoRa();
+    }
+
+    // reaction to the LoRa messages received
+    if (!loraTxBusy(loraTx)) sendDueReply();
 
     // detection and prediction value wiht AI model every 10s
     static unsigned long lastDetectionTime = 0;
@@ -1221,7 +1770,30 @@ void loop() {
         display->printf("CMB addr: %04X\n",ctrlmbAddress);
         display->println("CMB Name: " + CTRLMAILBOX_NAME);
         display->println("CMB KEY: " + CTRLMAILBOX_KEY);
+        const DutyCycleStats &duty = dutyCycleStats();
+        display->printf("Duty left: %u ms\n", (unsigned)dutyCycleRemainingMs(LORA_FREQUENCY, millis()));
+        display->printf("Deferred: %u (%u ms)\n", (unsigned)duty.deferrals, (unsigned)duty.deferredMs);
+        const ReplayEntry *replay = replayFind(replayTable, ctrlmbAddress);
+        if (replay != nullptr) display->printf("Lost: %u Dup: %u\n", replay->lost, replay->duplicates);
+        int infoIndex = getCtrlMailboxIndexByAddress(ctrlmbAddress);
+        if (infoIndex >= 0 && lastTelemetryValid[infoIndex]) {
+            const TelemetrySample &state = lastTelemetry[infoIndex];
+            display->printf("Box %d/%d cm %s%s\n", state.distance, state.baseline,
+                            state.flags & TELEMETRY_MAILBOX_OPEN ? "open" : "closed",
+                            state.flags & TELEMETRY_MAIL_DETECTED ? " mail" : "");
+        }
         display->display();
         digitalWrite(LED_GREEN, HIGH);
     }
+
+#ifdef MAILTON_HEAP_TRACE
+    // sample the heap every 10s and print the report on serial every minute
+    static unsigned long lastHeapSample = 0;
+    static int heapSamples = 0;
+    if (millis() - lastHeapSample >= 10000) {
+        heapTraceSample();
+        if (++heapSamples % 6 == 0) heapTracePrint(Serial);
+        lastHeapSample = millis();
+    }
+#endif
 }
\ No newline at end of file
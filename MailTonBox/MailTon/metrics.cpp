@@ -0,0 +1,119 @@
+/**
+ * @file metrics.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Latency histograms and counters of MailTon (see metrics.h).
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include "metrics.h"
+
+#ifdef MAILTON_METRICS
+
+#ifdef ESP_PLATFORM
+#include <Arduino.h>
+#define metricsCyclesPerUs() getCpuFrequencyMhz()
+#else
+#include <time.h>
+#define metricsCyclesPerUs() 1
+#endif
+
+const uint32_t METRICS_BUCKET_BOUNDS_US[METRICS_BUCKETS] = {
+    10, 100, 1000, 10000, 100000, 1000000, 10000000
+};
+
+static MetricHistogram histograms[TIMER_COUNT] = {};
+static uint32_t counters[COUNTER_COUNT] = {};
+
+static const char *const TIMER_NAMES[TIMER_COUNT] = {
+    "mailton_lora_receive_duration_us",
+    "mailton_lora_send_duration_us",
+    "mailton_detection_prediction_duration_us",
+    "mailton_ml_predict_duration_us",
+    "mailton_bot_get_updates_duration_us",
+    "mailton_handle_new_messages_duration_us",
+    "mailton_replay_lookup_duration_us",
+    "mailton_frame_verify_duration_us",
+    "mailton_lora_tx_duration_us"
+};
+
+static const char *const COUNTER_NAMES[COUNTER_COUNT] = {
+    "mailton_lora_packets_total",
+    "mailton_lora_acks_total",
+    "mailton_lora_nacks_total",
+    "mailton_lora_checksum_failures_total",
+    "mailton_telegram_errors_total",
+    "mailton_lora_duplicates_total",
+    "mailton_lora_auth_failures_total",
+    "mailton_class_a_missed_total",
+    "mailton_lora_tx_timeouts_total",
+    "mailton_lora_rx_dropped_total",
+    "mailton_lora_replies_late_total",
+    "mailton_lora_replies_dropped_total",
+    "mailton_lora_replies_deferred_total"
+};
+
+uint32_t metricsCycles() {
+#ifdef ESP_PLATFORM
+    return ESP.getCycleCount();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+#endif
+}
+
+void metricsObserve(MetricTimer timer, uint32_t cycles) {
+    metricsObserveUs(timer, cycles / metricsCyclesPerUs());
+}
+
+void metricsObserveUs(MetricTimer timer, uint32_t us) {
+    int bucket = 0;
+    while (bucket < METRICS_BUCKETS && us > METRICS_BUCKET_BOUNDS_US[bucket]) bucket++;
+
+    MetricHistogram &h = histograms[timer];
+    __atomic_fetch_add(&h.buckets[bucket], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h.count, 1, __ATOMIC_RELAXED);
+    h.sumUs += us; // 64 bit, not atomic: a concurrent update can only skew the sum
+}
+
+void metricsIncrement(MetricCounter counter) {
+    __atomic_fetch_add(&counters[counter], 1, __ATOMIC_RELAXED);
+}
+
+MetricHistogram metricsHistogram(MetricTimer timer) {
+    return histograms[timer];
+}
+
+uint32_t metricsCounter(MetricCounter counter) {
+    return __atomic_load_n(&counters[counter], __ATOMIC_RELAXED);
+}
+
+#ifdef ARDUINO
+void metricsRender(Print &out) {
+    for (int t = 0; t < TIMER_COUNT; t++) {
+        const MetricHistogram &h = histograms[t];
+        const char *name = TIMER_NAMES[t];
+        uint32_t cumulative = 0;
+
+        out.printf("# TYPE %s histogram\n", name);
+        for (int b = 0; b < METRICS_BUCKETS; b++) {
+            cumulative += h.buckets[b];
+            out.printf("%s_bucket{le=\"%u\"} %u\n", name, (unsigned)METRICS_BUCKET_BOUNDS_US[b], (unsigned)cumulative);
+        }
+        cumulative += h.buckets[METRICS_BUCKETS];
+        out.printf("%s_bucket{le=\"+Inf\"} %u\n", name, (unsigned)cumulative);
+        out.printf("%s_sum %llu\n", name, (unsigned long long)h.sumUs);
+        out.printf("%s_count %u\n", name, (unsigned)h.count);
+    }
+    for (int c = 0; c < COUNTER_COUNT; c++) {
+        out.printf("# TYPE %s counter\n", COUNTER_NAMES[c]);
+        out.printf("%s %u\n", COUNTER_NAMES[c], (unsigned)counters[c]);
+    }
+}
+#endif
+
+#endif
@@ -0,0 +1,106 @@
+/**
+ * @file metrics.h
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Latency histograms and counters of MailTon, exported in Prometheus text format on /metrics.
+ *
+ * Enabled by building with -DMAILTON_METRICS. The scoped timers read the CPU
+ * cycle counter and feed histograms with fixed buckets, so recording a value
+ * is a handful of instructions and never allocates.
+ * Without the flag the macros expand to nothing and the route is not registered.
+ * Everything but the Prometheus output also builds on the host.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+
+// timed code paths
+enum MetricTimer : uint8_t {
+    TIMER_LORA_RECEIVE = 0,
+    TIMER_LORA_SEND,
+    TIMER_DETECTION_PREDICTION,
+    TIMER_ML_PREDICT,
+    TIMER_BOT_GET_UPDATES,
+    TIMER_HANDLE_NEW_MESSAGES,
+    TIMER_REPLAY_LOOKUP,
+    TIMER_FRAME_VERIFY,
+    TIMER_LORA_TX,          // endPacket() to TxDone, measured with millis()
+    TIMER_COUNT
+};
+
+// event counters
+enum MetricCounter : uint8_t {
+    COUNTER_LORA_PACKETS = 0,
+    COUNTER_LORA_ACKS,
+    COUNTER_LORA_NACKS,
+    COUNTER_LORA_CHECKSUM_FAILURES,
+    COUNTER_TELEGRAM_ERRORS,
+    COUNTER_LORA_DUPLICATES,
+    COUNTER_LORA_AUTH_FAILURES,
+    COUNTER_CLASS_A_MISSED,
+    COUNTER_LORA_TX_TIMEOUTS,
+    COUNTER_LORA_RX_DROPPED,   // packet pool exhausted
+    COUNTER_LORA_REPLY_LATE,   // reply dropped, it would overrun the TDMA slot of the uplink
+    COUNTER_LORA_REPLY_DROPPED,    // every cause: late, class A window missed
+    COUNTER_LORA_REPLY_DEFERRED,   // no duty cycle budget, the reply waits
+    COUNTER_COUNT
+};
+
+#ifdef MAILTON_METRICS
+
+#ifdef ARDUINO
+#include <Print.h>
+#endif
+
+// upper bounds of the histogram buckets in microseconds, the last bucket is +Inf
+#define METRICS_BUCKETS 7
+extern const uint32_t METRICS_BUCKET_BOUNDS_US[METRICS_BUCKETS];
+
+struct MetricHistogram {
+    uint32_t buckets[METRICS_BUCKETS + 1]; // not cumulative, the last one is +Inf
+    uint64_t sumUs;
+    uint32_t count;
+};
+
+uint32_t metricsCycles();
+void metricsObserve(MetricTimer timer, uint32_t cycles);
+// durations not measured with the cycle counter
+void metricsObserveUs(MetricTimer timer, uint32_t us);
+void metricsIncrement(MetricCounter counter);
+// copies of the values, taken at the time of the call
+MetricHistogram metricsHistogram(MetricTimer timer);
+uint32_t metricsCounter(MetricCounter counter);
+#ifdef ARDUINO
+// writes all the metrics in Prometheus text format
+void metricsRender(Print &out);
+#endif
+
+// measures the lifetime of the object
+class MetricsScopedTimer {
+public:
+    explicit MetricsScopedTimer(MetricTimer timer) : timer(timer), start(metricsCycles()) {}
+    ~MetricsScopedTimer() { metricsObserve(timer, metricsCycles() - start); }
+private:
+    MetricTimer timer;
+    uint32_t start;
+};
+
+#define METRICS_TIME(timer) MetricsScopedTimer metricsTimer_##timer(timer)
+#define METRICS_COUNT(counter) metricsIncrement(counter)
+#define METRICS_OBSERVE_US(timer, us) metricsObserveUs(timer, us)
+
+#else
+
+#define METRICS_TIME(timer)
+#define METRICS_COUNT(counter)
+#define METRICS_OBSERVE_US(timer, us)
+
+#endif
+
+#endif
@@ -0,0 +1,101 @@
+/**
+ * @file msg_format.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Heap-free formatting of the Telegram messages sent by MailTon.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include "msg_format.h"
+
+// larger values are printed as "ovf", the integer part must fit in 32 bits
+#define MSG_FLOAT_MAX 4294967040.0
+
+// small writer that never goes past the end of the buffer
+struct MsgWriter {
+    char *buffer;
+    size_t size;
+    size_t length;
+
+    void putChar(char c) {
+        if (length + 1 < size) buffer[length++] = c;
+    }
+
+    void putString(const char *s) {
+        while (s && *s) putChar(*s++);
+    }
+
+    void putUnsigned(unsigned long value) {
+        char digits[12];
+        int n = 0;
+        do {
+            digits[n++] = '0' + (value % 10);
+            value /= 10;
+        } while (value);
+        while (n) putChar(digits[--n]);
+    }
+
+    void putInt(long value) {
+        if (value < 0) {
+            putChar('-');
+            putUnsigned((unsigned long)(-(value + 1)) + 1);
+        } else {
+            putUnsigned((unsigned long)value);
+        }
+    }
+
+    // same output of the Arduino float printing: 2 decimals, rounded, nan/inf/ovf
+    void putFixed2(double value) {
+        if (isnan(value)) { putString("nan"); return; }
+        if (isinf(value)) { putString("inf"); return; }
+        if (value > MSG_FLOAT_MAX || value < -MSG_FLOAT_MAX) { putString("ovf"); return; }
+        if (value < 0) {
+            putChar('-');
+            value = -value;
+        }
+        // integer part and decimals apart, value * 100 would not fit in 32 bits
+        uint32_t integer = (uint32_t)value;
+        uint32_t hundredths = (uint32_t)((value - integer) * 100.0 + 0.5);
+        if (hundredths >= 100) {
+            integer++;
+            hundredths -= 100;
+        }
+        putUnsigned(integer);
+        putChar('.');
+        putChar('0' + hundredths / 10);
+        putChar('0' + hundredths % 10);
+    }
+};
+
+size_t formatMessage(char *buffer, size_t size, const char *format, ...) {
+    if (buffer == nullptr || size == 0) return 0;
+
+    MsgWriter w = {buffer, size, 0};
+    va_list args;
+    va_start(args, format);
+
+    for (const char *p = format; *p; p++) {
+        if (*p != '%') {
+            w.putChar(*p);
+            continue;
+        }
+        switch (*++p) {
+            case 's': w.putString(va_arg(args, const char *)); break;
+            case 'd': w.putInt(va_arg(args, int)); break;
+            case 'f': w.putFixed2(va_arg(args, double)); break;
+            case '%': w.putChar('%'); break;
+            case '\0': p--; break; // lone '%' at the end of the template
+            default: w.putChar('%'); w.putChar(*p); break;
+        }
+    }
+
+    va_end(args);
+    buffer[w.length] = '\0';
+    return w.length;
+}
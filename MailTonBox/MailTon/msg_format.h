@@ -0,0 +1,80 @@
+/**
+ * @file msg_format.h
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Heap-free formatting of the Telegram messages sent by MailTon.
+ *
+ * The messages are described by compile-time template strings and rendered
+ * into a caller-provided buffer, so a report never touches the heap.
+ * Supported placeholders: %s (C string), %d (int), %f (float, 2 decimals), %%.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef MSG_FORMAT_H
+#define MSG_FORMAT_H
+
+#include <stddef.h>
+
+// size of the preallocated buffer used for the Telegram reports
+#define MSG_BUFFER_SIZE 640
+
+// names of the classes predicted by the AI model, indexed by class value
+constexpr const char *TEMP_HUMIDITY_CLASS_NAMES[] = {
+    "Low Temperature, Dry Humidity",
+    "Low Temperature, Normal Humidity",
+    "Low Temperature, Humid",
+    "Medium Temperature, Dry Humidity",
+    "Medium Temperature, Normal Humidity",
+    "Medium Temperature, Humid",
+    "High Temperature, Dry Humidity",
+    "High Temperature, Normal Humidity",
+    "High Temperature, Humid"
+};
+
+constexpr const char *PPM_CLASS_NAMES[] = {
+    "Good Air Quality",
+    "Moderate Air Quality",
+    "Poor Air Quality",
+    "Very Poor Air Quality"
+};
+
+constexpr const char *UNKNOWN_CLASS_NAME = "Unknown Class";
+
+// returns the name of a class, or "Unknown Class" if out of range
+template <size_t N>
+constexpr const char *classToText(const char *const (&names)[N], int value) {
+    return (value >= 0 && (size_t)value < N) ? names[value] : UNKNOWN_CLASS_NAME;
+}
+
+// common body of the AI report: temperature, humidity, ppm, th class, th name, ppm class, ppm name
+#define AI_REPORT_BODY \
+    "    📟  Real real values ​​from Mailton: \n\n" \
+    "        🌡️  Temperature: %f °C\n\n" \
+    "        💧  Moisture: %f %%\n\n" \
+    "    🤖  Values ​​predicted by the AI: \n\n" \
+    "        🔮  PPM CO predicted: %f\n\n" \
+    "        📋  Temperature & Humidity Class: \n" \
+    "               %d = %s\n\n" \
+    "        🛡️  PPM CO Class: %d = %s\n\n"
+
+// answer to the /ai command
+constexpr char AI_REPORT_TEMPLATE[] = "🏠 Here are values ​​in your room in real time!  \n\n" AI_REPORT_BODY;
+
+// alert sent when the AI detects dangerous values
+constexpr char AI_ALERT_TEMPLATE[] = "⚠️ Attention these are the values ​​in your room in real time!\n\n" AI_REPORT_BODY;
+
+/**
+ * @brief renders a template into `buffer` without allocating memory.
+ * The output is always null-terminated and truncated if it does not fit.
+ *
+ * @param buffer destination buffer
+ * @param size size of the destination buffer
+ * @param format template with %s, %d, %f and %% placeholders
+ * @return the number of characters written (excluding the terminator)
+ */
+size_t formatMessage(char *buffer, size_t size, const char *format, ...);
+
+#endif
@@ -0,0 +1,61 @@
+/**
+ * @file packet_pool.h
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Preallocated buffers for the LoRa packets received.
+ *
+ * Shared by MailTon and CtrlMailBox (keep the two copies identical).
+ * The receive callback takes a free buffer of the pool, reads the whole
+ * packet into it with a single readBytes() and queues it for loop(), which
+ * parses it and gives it back. The buffers are reference counted: the
+ * callback and the queue hold one reference each, a consumer that keeps a
+ * packet after loop() takes its own with packetRetain(). The buffer returns
+ * to the pool when the last reference is released. Nothing is allocated per
+ * packet: when the pool or the queue are full the packet is dropped and
+ * counted. The queue has a single producer (the callback) and a single
+ * consumer (loop()), the counters are updated with atomic operations.
+ * No Arduino dependency: the pool also builds on the host.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef PACKET_POOL_H
+#define PACKET_POOL_H
+
+#include <stdint.h>
+
+#define PACKET_BUFFER_SIZE 256  // a LoRa packet is at most 255 bytes
+#define PACKET_POOL_SIZE 4      // buffers, also the capacity of the queue (power of two)
+
+struct PacketBuffer {
+    uint8_t data[PACKET_BUFFER_SIZE];
+    uint16_t length;
+    int16_t rssi;
+    float snr;
+    uint32_t receivedAt;    // millis() at the end of the reception
+    uint8_t refs;           // references, 0 = free
+};
+
+struct PacketPoolStats {
+    uint32_t received;      // packets queued for loop()
+    uint32_t dropped;       // pool or queue full
+    uint8_t inUse;          // buffers taken now
+    uint8_t peakInUse;
+};
+
+void packetPoolInit();
+// a free buffer with one reference, nullptr when the pool is exhausted
+PacketBuffer *packetAcquire();
+void packetRetain(PacketBuffer *packet);
+// the buffer goes back to the pool with the last reference
+void packetRelease(PacketBuffer *packet);
+// from the callback: the queue takes its own reference, false (and dropped) when it is full
+bool packetQueuePush(PacketBuffer *packet);
+// from loop(): the oldest packet, the caller owns the reference of the queue; nullptr when empty
+PacketBuffer *packetQueuePop();
+bool packetQueueEmpty();
+PacketPoolStats packetPoolStats();
+
+#endif
@@ -0,0 +1,111 @@
+/**
+ * @file quantile_sketch.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Fixed-size streaming quantile sketch (see quantile_sketch.h).
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include "quantile_sketch.h"
+
+void sketchReset(QuantileSketch &sketch) {
+    sketch = {};
+}
+
+// merges the pair of neighbouring centroids that costs less precision
+static void compress(QuantileSketch &sketch) {
+    int best = 0;
+    float bestCost = 0;
+    uint32_t before = 0;
+    for (int i = 0; i + 1 < sketch.centroids; i++) {
+        uint32_t pair = sketch.weight[i] + sketch.weight[i + 1];
+        float cost = 0;
+        if (sketch.mean[i] != sketch.mean[i + 1]) {
+            float q = (before + pair / 2.0f) / sketch.count;
+            float limit = q * (1 - q);
+            if (limit < 1.0f / sketch.count) limit = 1.0f / sketch.count;
+            cost = pair / limit;
+        }
+        if (i == 0 || cost < bestCost) {
+            best = i;
+            bestCost = cost;
+        }
+        before += sketch.weight[i];
+    }
+
+    uint32_t weight = sketch.weight[best] + sketch.weight[best + 1];
+    sketch.mean[best] = (sketch.mean[best] * sketch.weight[best] + sketch.mean[best + 1] * sketch.weight[best + 1]) / weight;
+    sketch.weight[best] = weight;
+    for (int i = best + 1; i + 1 < sketch.centroids; i++) {
+        sketch.mean[i] = sketch.mean[i + 1];
+        sketch.weight[i] = sketch.weight[i + 1];
+    }
+    sketch.centroids--;
+}
+
+static void addWeighted(QuantileSketch &sketch, float value, uint32_t weight) {
+    if (sketch.count == 0 || value < sketch.min) sketch.min = value;
+    if (sketch.count == 0 || value > sketch.max) sketch.max = value;
+    sketch.count += weight;
+
+    int position = 0;
+    while (position < sketch.centroids && sketch.mean[position] < value) position++;
+    if (position < sketch.centroids && sketch.mean[position] == value) {
+        sketch.weight[position] += weight;
+        return;
+    }
+
+    if (sketch.centroids == SKETCH_CENTROIDS) {
+        compress(sketch);
+        position = 0;
+        while (position < sketch.centroids && sketch.mean[position] < value) position++;
+    }
+    for (int i = sketch.centroids; i > position; i--) {
+        sketch.mean[i] = sketch.mean[i - 1];
+        sketch.weight[i] = sketch.weight[i - 1];
+    }
+    sketch.mean[position] = value;
+    sketch.weight[position] = weight;
+    sketch.centroids++;
+}
+
+void sketchAdd(QuantileSketch &sketch, float value) {
+    addWeighted(sketch, value, 1);
+}
+
+void sketchMerge(QuantileSketch &into, const QuantileSketch &from) {
+    if (from.count == 0) return;
+    float min = into.count == 0 || from.min < into.min ? from.min : into.min;
+    float max = into.count == 0 || from.max > into.max ? from.max : into.max;
+    for (int i = 0; i < from.centroids; i++) addWeighted(into, from.mean[i], from.weight[i]);
+    // the centroids of `from` are not its extremes
+    into.min = min;
+    into.max = max;
+}
+
+float sketchQuantile(const QuantileSketch &sketch, float q) {
+    if (sketch.count == 0) return 0;
+    if (q <= 0) return sketch.min;
+    if (q >= 1) return sketch.max;
+
+    // every centroid sits at the middle of its weight, the quantile is interpolated between
+    // the neighbouring centroids (and the minimum and maximum at the ends)
+    float rank = q * sketch.count;
+    float previousRank = 0;
+    float previousValue = sketch.min;
+    float cumulative = 0;
+    for (int i = 0; i < sketch.centroids; i++) {
+        float center = cumulative + sketch.weight[i] / 2.0f;
+        if (rank < center) {
+            return previousValue + (sketch.mean[i] - previousValue) * (rank - previousRank) / (center - previousRank);
+        }
+        previousRank = center;
+        previousValue = sketch.mean[i];
+        cumulative += sketch.weight[i];
+    }
+    if (cumulative <= previousRank) return sketch.max;
+    return previousValue + (sketch.max - previousValue) * (rank - previousRank) / (cumulative - previousRank);
+}
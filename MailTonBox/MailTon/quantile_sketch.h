@@ -0,0 +1,45 @@
+/**
+ * @file quantile_sketch.h
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Fixed-size streaming quantile sketch (merging t-digest).
+ *
+ * The values are kept as SKETCH_CENTROIDS weighted centroids sorted by
+ * mean, plus the exact count, minimum and maximum. When the sketch is full
+ * the two neighbouring centroids with the smallest weight, relative to
+ * q(1 - q) of their position, are merged: the tails stay fine-grained and
+ * the quantiles of the tails (p5, p95) stay accurate with a constant memory.
+ * Equal values share a centroid without losing precision, which is the
+ * common case for the integer RSSI. Two sketches merge into one, so the
+ * links of all the CtrlMailBoxes add up to a gateway-wide summary.
+ * No Arduino dependency: the sketch also builds on the host.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef QUANTILE_SKETCH_H
+#define QUANTILE_SKETCH_H
+
+#include <stdint.h>
+
+#define SKETCH_CENTROIDS 16     // 144 bytes per sketch
+
+struct QuantileSketch {
+    float mean[SKETCH_CENTROIDS];
+    uint32_t weight[SKETCH_CENTROIDS];
+    uint8_t centroids;
+    uint32_t count;
+    float min;
+    float max;
+};
+
+void sketchReset(QuantileSketch &sketch);
+void sketchAdd(QuantileSketch &sketch, float value);
+// adds all the values of `from` to `into`
+void sketchMerge(QuantileSketch &into, const QuantileSketch &from);
+// estimated quantile q (0-1), 0 for an empty sketch
+float sketchQuantile(const QuantileSketch &sketch, float q);
+
+#endif
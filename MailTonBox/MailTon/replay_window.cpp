@@ -0,0 +1,115 @@
+/**
+ * @file replay_window.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Duplicate suppression of the LoRa frames received by MailTon (see replay_window.h).
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <new>
+#include <string.h>
+#include "replay_window.h"
+#include "metrics.h"
+
+// Fibonacci hashing, spreads the consecutive addresses over the table
+static uint32_t slotOf(uint16_t address) {
+    return (uint32_t)(address * 2654435769u) >> (32 - REPLAY_TABLE_BITS);
+}
+
+// linear probing, returns the slot of the address or the empty slot where it goes (nullptr if full)
+static ReplayEntry *probe(ReplayTable &table, uint16_t address) {
+    uint32_t slot = slotOf(address);
+    for (uint32_t i = 0; i < REPLAY_TABLE_SIZE; i++) {
+        ReplayEntry &entry = table.entries[(slot + i) & (REPLAY_TABLE_SIZE - 1)];
+        table.probes++;
+        if (!entry.used || entry.address == address) return &entry;
+    }
+    return nullptr;
+}
+
+void replayReset(ReplayTable &table) {
+    memset(&table, 0, sizeof(table));
+}
+
+ReplayResult replayCheck(ReplayTable &table, uint16_t address, uint8_t msgId) {
+    table.lookups++;
+    ReplayEntry *entry = probe(table, address);
+    if (entry == nullptr) return REPLAY_TABLE_FULL;
+
+    if (!entry->used) {
+        entry->used = 1;
+        entry->address = address;
+        entry->highest = msgId;
+        entry->window = 1;
+        table.senders++;
+        return REPLAY_NEW;
+    }
+
+    int8_t distance = (int8_t)(msgId - entry->highest);
+    if (distance >= REPLAY_WINDOW || distance <= -REPLAY_WINDOW) {
+        // too far to be a gap or a retransmission: new sequence after a restart of the sender
+        entry->highest = msgId;
+        entry->window = 1;
+        return REPLAY_RESTART;
+    }
+    if (distance > 0) {
+        // the window moves forward, the IDs in between are lost until they arrive;
+        // the IDs that leave the window without being received stay lost
+        uint32_t skipped = distance - 1;
+        entry->window = entry->window << distance | 1;
+        entry->lost = entry->lost + skipped > 0xFFFF ? 0xFFFF : entry->lost + skipped;
+        entry->highest = msgId;
+        return REPLAY_NEW;
+    }
+
+    uint32_t age = -distance;
+    uint32_t bit = 1UL << age;
+    if (entry->window & bit) {
+        if (entry->duplicates < 0xFFFF) entry->duplicates++;
+        return REPLAY_DUPLICATE;
+    }
+    // late arrival of an ID counted as lost
+    entry->window |= bit;
+    if (entry->lost > 0) entry->lost--;
+    return REPLAY_NEW;
+}
+
+const ReplayEntry *replayFind(const ReplayTable &table, uint16_t address) {
+    uint32_t slot = slotOf(address);
+    for (uint32_t i = 0; i < REPLAY_TABLE_SIZE; i++) {
+        const ReplayEntry &entry = table.entries[(slot + i) & (REPLAY_TABLE_SIZE - 1)];
+        if (!entry.used) return nullptr;
+        if (entry.address == address) return &entry;
+    }
+    return nullptr;
+}
+
+#if defined(MAILTON_METRICS) && defined(ARDUINO)
+
+void replayBenchmark(Print &out, uint16_t senders) {
+    ReplayTable *table = new (std::nothrow) ReplayTable;
+    if (table == nullptr) return;
+    replayReset(*table);
+    if (senders > REPLAY_TABLE_SIZE) senders = REPLAY_TABLE_SIZE;
+
+    const uint32_t rounds = 16;
+    for (uint16_t address = 0; address < senders; address++) replayCheck(*table, address, 0);
+    table->probes = 0;
+    table->lookups = 0;
+
+    uint32_t start = metricsCycles();
+    for (uint32_t round = 1; round <= rounds; round++) {
+        for (uint16_t address = 0; address < senders; address++) replayCheck(*table, address, round);
+    }
+    uint32_t cycles = metricsCycles() - start;
+
+    out.printf("Replay window: %u senders, %u cycles/lookup, %u.%02u probes/lookup\n",
+               (unsigned)senders, (unsigned)(cycles / table->lookups),
+               (unsigned)(table->probes / table->lookups), (unsigned)(table->probes * 100 / table->lookups % 100));
+    delete table;
+}
+
+#endif
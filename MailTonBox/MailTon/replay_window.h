@@ -0,0 +1,69 @@
+/**
+ * @file replay_window.h
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Duplicate suppression of the LoRa frames received by MailTon.
+ *
+ * Every sender has a sliding window of the last REPLAY_WINDOW message IDs
+ * (the highest ID seen plus a bitmap of the previous ones), so a
+ * retransmission whose ACK was lost is recognised and only acknowledged again.
+ * The IDs skipped when the window moves forward are counted as lost, and
+ * given back if they arrive late. An ID a whole window or more away from the
+ * highest, ahead or behind, is a new sequence (the sender rebooted with a
+ * random initial ID): the window starts again and nothing is counted as lost.
+ * The windows live in an open addressing table keyed by the sender address:
+ * 12 bytes for each sender, one hash and usually one probe for each packet.
+ * The table is sized for the device registry of MailTon, at most half full.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef REPLAY_WINDOW_H
+#define REPLAY_WINDOW_H
+
+#include <stdint.h>
+
+#ifndef REPLAY_TABLE_BITS
+#define REPLAY_TABLE_BITS 5     // 32 slots, 384 bytes: twice MAX_CTRLMBOX_DEVICES
+#endif
+#define REPLAY_TABLE_SIZE (1 << REPLAY_TABLE_BITS) // senders tracked
+#define REPLAY_WINDOW 32        // message IDs remembered for each sender
+
+enum ReplayResult : uint8_t {
+    REPLAY_NEW = 0,     // first time the message ID is seen
+    REPLAY_DUPLICATE,   // already received, acknowledge it without processing it
+    REPLAY_RESTART,     // ID a window or more away: the sender restarted its sequence
+    REPLAY_TABLE_FULL   // no room for a new sender, the message is not tracked
+};
+
+struct ReplayEntry {
+    uint16_t address;
+    uint8_t highest;    // highest message ID received
+    uint8_t used;
+    uint32_t window;    // bit i = message ID highest - i received
+    uint16_t lost;      // IDs skipped and not received yet
+    uint16_t duplicates;
+};
+
+struct ReplayTable {
+    ReplayEntry entries[REPLAY_TABLE_SIZE];
+    uint16_t senders;
+    uint32_t probes;    // slots visited by all the lookups
+    uint32_t lookups;
+};
+
+void replayReset(ReplayTable &table);
+// records the message ID of a sender and tells if it is a duplicate
+ReplayResult replayCheck(ReplayTable &table, uint16_t address, uint8_t msgId);
+// window of a sender, nullptr if it never sent anything
+const ReplayEntry *replayFind(const ReplayTable &table, uint16_t address);
+
+#if defined(MAILTON_METRICS) && defined(ARDUINO)
+#include <Print.h>
+// measures the cost of a lookup with the table filled by `senders` senders
+void replayBenchmark(Print &out, uint16_t senders);
+#endif
+
+#endif
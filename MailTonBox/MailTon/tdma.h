@@ -0,0 +1,96 @@
+/**
+ * @file tdma.h
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Slotted access to the channel, scheduled by the beacons of MailTon.
+ *
+ * Shared by MailTon and CtrlMailBox (keep the two copies identical).
+ * MailTon broadcasts a beacon about every TDMA_BEACON_INTERVAL_MS with the slot
+ * length and the addresses of its registry in slot order, so a device added
+ * from the web page gets a slot at the next beacon. The end of the beacon is
+ * the time base: the slots follow one another and the cycle repeats until
+ * the next beacon, which is sent at the end of a cycle. Every TDMA_CONTENTION_PERIOD-th slot is a contention slot,
+ * open to the urgent events of every CtrlMailBox; the other slots belong to
+ * one CtrlMailBox each and carry its non-urgent traffic.
+ * A slot holds a whole exchange: the frame starts within TDMA_TX_WINDOW_MS
+ * after the guard time, MailTon answers within the same slot and the guard
+ * time closes it. Its length is derived from the time on air of the longest
+ * frame and of the longest reply, and travels in the beacon. MailTon drops
+ * a reply that would overrun the slot of the uplink (the ARQ sends the
+ * frame again) and keeps the replies not bound to a slot (class A) in the
+ * contention slots.
+ * Beacon payload: version, interval (s, 2 bytes), slot length (ms, 2 bytes),
+ * contention period, number of devices and one address for each device.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef TDMA_H
+#define TDMA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "frame_auth.h"
+#include "lora_airtime.h"
+
+#define TDMA_BROADCAST_ADDRESS 0xFF
+#define TDMA_BEACON_VERSION 1
+#define TDMA_BEACON_INTERVAL_MS 64000UL
+#define TDMA_CONTENTION_PERIOD 8       // one contention slot every 8 slots
+#define TDMA_GUARD_MS 30               // clock drift and reception delay of the beacon, at both ends of a slot
+#define TDMA_TX_WINDOW_MS 40           // a frame starts at most this long after the guard time
+#define TDMA_TURNAROUND_MS 60          // MailTon: checks of the frame and signature of the reply
+#define TDMA_SLOT_ROUND_MS 10
+#define TDMA_MAX_NAME_LENGTH 16        // longer CtrlMailBox names are refused at registration
+#define TDMA_MAX_UPLINK_LENGTH 96      // longest frame of a CtrlMailBox, header and trailer included
+// longest reply of MailTon, header and trailer included
+#define TDMA_MAX_REPLY_LENGTH (LORA_HEADER_LENGTH + sizeof("NAME=;DATA=NACK;ADR_PW=14;SEQ=255;CUM=255") - 1 + \
+                               TDMA_MAX_NAME_LENGTH + FRAME_AUTH_TRAILER_LENGTH)
+#define TDMA_BEACON_LOST_LIMIT 3       // missed beacons before going back to random access
+#define TDMA_BEACON_FIXED_LENGTH 7
+#define TDMA_MAX_DEVICES 200           // the beacon must fit in a LoRa frame
+#define TDMA_BEACON_KEY_NAME "BEACON"  // name used to derive the beacon key from the MailTon key
+
+// what a CtrlMailBox may send at a given time
+enum TdmaWindow : uint8_t {
+    TDMA_UNSYNCED = 0,  // no beacon: random access with LBT
+    TDMA_CONTENTION,    // contention slot: urgent events only
+    TDMA_OWN_SLOT,      // own slot: any message
+    TDMA_OTHER_SLOT     // slot of another CtrlMailBox: nothing
+};
+
+// schedule of a CtrlMailBox learned from the last beacon
+struct TdmaSync {
+    bool valid;
+    uint32_t beaconAtMs;        // reception of the last beacon
+    uint32_t intervalMs;
+    uint16_t slotMs;
+    uint8_t contentionPeriod;
+    uint16_t slotCount;         // slots in a cycle
+    int16_t ownSlot;            // -1 if not in the beacon
+    uint32_t beacons;
+};
+
+// length of a slot: guard, start window, longest frame, turnaround, longest reply and guard
+uint16_t tdmaSlotMs();
+// position of the slot of the k-th device in the cycle, the contention slots are skipped
+uint16_t tdmaDeviceSlot(uint16_t device, uint8_t contentionPeriod);
+uint16_t tdmaSlotCount(uint16_t devices, uint8_t contentionPeriod);
+// MailTon: time between two beacons, a whole number of cycles of at least TDMA_BEACON_INTERVAL_MS
+uint32_t tdmaBeaconPeriodMs(uint16_t devices);
+// MailTon: writes the beacon payload, returns its length (0 if it does not fit)
+size_t tdmaBuildBeacon(uint8_t *buffer, size_t size, const uint8_t *addresses, uint8_t count);
+// CtrlMailBox: updates the schedule with a beacon received at nowMs
+bool tdmaParseBeacon(TdmaSync &sync, const uint8_t *payload, size_t length, uint8_t localAddress, uint32_t nowMs);
+TdmaWindow tdmaWindow(const TdmaSync &sync, uint32_t nowMs);
+// MailTon: end of the slot that contains atMs, false without a valid schedule
+bool tdmaSlotEnd(const TdmaSync &sync, uint32_t atMs, uint32_t *endMs);
+// MailTon: true if fromMs-toMs lies in contention slots only, or there is no valid schedule
+bool tdmaContentionOnly(const TdmaSync &sync, uint32_t fromMs, uint32_t toMs);
+// MailTon: true if fromMs-toMs keeps out of the part of the owned slots where their CtrlMailBox may
+// be on air (guard, start window, longest uplink and the guard of its clock), or there is no valid schedule
+bool tdmaUplinkFree(const TdmaSync &sync, uint32_t fromMs, uint32_t toMs);
+
+#endif
@@ -0,0 +1,101 @@
+/**
+ * @file telemetry.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Delta encoding of the telemetry samples of CtrlMailBox (see telemetry.h).
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "telemetry.h"
+
+// the fields of a sample, with the trailing zeros omitted (the first field is always written)
+static int encodeFields(const long *fields, int count, char *out, size_t size) {
+    int last = 0;
+    for (int i = 1; i < count; i++) {
+        if (fields[i] != 0) last = i;
+    }
+    int length = 0;
+    for (int i = 0; i <= last; i++) {
+        int written = snprintf(out + length, size - length, i == 0 ? "%ld" : ",%ld", fields[i]);
+        if (written < 0 || (size_t)(length + written) >= size) return -1;
+        length += written;
+    }
+    return length;
+}
+
+int telemetryEncode(const TelemetrySample *samples, int count, uint32_t nowMs, char *out, size_t size) {
+    if (size == 0) return 0;
+    out[0] = '\0';
+    size_t length = 0;
+    int encoded = 0;
+
+    for (int i = 0; i < count; i++) {
+        const TelemetrySample &sample = samples[i];
+        long fields[4];
+        if (i == 0) {
+            fields[0] = (long)((nowMs - sample.atMs + 500) / 1000);
+            fields[1] = sample.distance;
+            fields[2] = sample.baseline;
+            fields[3] = sample.flags;
+        } else {
+            const TelemetrySample &previous = samples[i - 1];
+            fields[0] = (long)((sample.atMs - previous.atMs + 500) / 1000);
+            fields[1] = sample.distance - previous.distance;
+            fields[2] = sample.baseline - previous.baseline;
+            fields[3] = sample.flags ^ previous.flags;
+        }
+
+        char item[48];
+        int itemLength = encodeFields(fields, 4, item, sizeof(item));
+        size_t needed = itemLength + (i > 0 ? 1 : 0);
+        if (itemLength < 0 || length + needed >= size) break;
+        if (i > 0) out[length++] = '/';
+        memcpy(out + length, item, itemLength + 1);
+        length += itemLength;
+        encoded++;
+    }
+    return encoded;
+}
+
+int telemetryDecode(const char *text, uint32_t nowMs, TelemetrySample *samples, int maxSamples) {
+    int count = 0;
+    const char *cursor = text;
+    TelemetrySample previous = {};
+
+    while (*cursor != '\0') {
+        if (count >= maxSamples) return -1;
+        long fields[4] = {0, 0, 0, 0};
+        for (int i = 0; i < 4; i++) {
+            char *end;
+            fields[i] = strtol(cursor, &end, 10);
+            if (end == cursor) return -1;
+            cursor = end;
+            if (*cursor != ',') break;
+            cursor++;
+        }
+        if (*cursor == '/') cursor++;
+        else if (*cursor != '\0') return -1;
+
+        TelemetrySample sample;
+        if (count == 0) {
+            sample.atMs = nowMs - (uint32_t)fields[0] * 1000;
+            sample.distance = (int16_t)fields[1];
+            sample.baseline = (int16_t)fields[2];
+            sample.flags = (uint8_t)fields[3];
+        } else {
+            sample.atMs = previous.atMs + (uint32_t)fields[0] * 1000;
+            sample.distance = (int16_t)(previous.distance + fields[1]);
+            sample.baseline = (int16_t)(previous.baseline + fields[2]);
+            sample.flags = (uint8_t)(previous.flags ^ fields[3]);
+        }
+        samples[count++] = sample;
+        previous = sample;
+    }
+    return count;
+}
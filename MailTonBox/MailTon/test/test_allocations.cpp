@@ -0,0 +1,271 @@
+/**
+ * @file test_allocations.cpp
+ * @author Alessandro Ferrante (github@alessandroferrante.net)
+ * @brief Host test of the code paths of MailTon that must not allocate memory.
+ *
+ * Built with heap_trace.h (-DMAILTON_HEAP_TRACE and -Wl,--wrap=malloc...):
+ * every malloc/calloc/realloc, operator new included, is counted, and each
+ * path is run inside its call site checking that the counters do not move.
+ * The receive path is the one of onLoRaReceive() and handleLoRaPacket()
+ * without the Arduino parts: the packet pool, the checksum, the MIC, the
+ * replay window, the link quality, the ADR and the telemetry decoder. The
+ * text fields are still parsed with Arduino String, not covered here.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "heap_trace.h"
+#include "msg_format.h"
+#include "packet_pool.h"
+#include "frame_auth.h"
+#include "replay_window.h"
+#include "link_quality.h"
+#include "adr.h"
+#include "telemetry.h"
+#include "lora_airtime.h"
+#include "check.h"
+
+// the counters must see an allocation, or the other checks prove nothing
+static void testWrappers() {
+    uint32_t before = heapTraceAllocations();
+    uint32_t siteBefore = heapTraceSiteAllocations(HEAP_SITE_OTHER);
+    void *volatile block = malloc(32);
+    CHECK(block != nullptr);
+    free(block);
+    int *volatile object = new int(1);
+    delete object;
+    CHECK_EQ(heapTraceAllocations(), before + 2);
+    CHECK_EQ(heapTraceSiteAllocations(HEAP_SITE_OTHER), siteBefore + 2);
+}
+
+// as renderAiReport() of mailTon.cpp
+static const char *renderAiReport(char *buffer, size_t size, const char *reportTemplate, float temperature,
+                                  float humidity, float ppm, int thClass, int ppmClass) {
+    HEAP_TRACE_SCOPE(HEAP_SITE_FORMAT_MESSAGE);
+    formatMessage(buffer, size, reportTemplate, temperature, humidity, ppm,
+                  thClass, classToText(TEMP_HUMIDITY_CLASS_NAMES, thClass),
+                  ppmClass, classToText(PPM_CLASS_NAMES, ppmClass));
+    return buffer;
+}
+
+static void testFormatMessage() {
+    static char messageBuffer[MSG_BUFFER_SIZE];
+    static char small[64];
+    uint32_t before = heapTraceAllocations();
+
+    // every class, out of range ones and special floats, in the buffer of MailTon and truncated
+    const float values[] = {21.5f, -4.25f, 0.0f, 1e12f, NAN, INFINITY};
+    for (int thClass = -1; thClass <= 9; thClass++) {
+        for (int ppmClass = -1; ppmClass <= 4; ppmClass++) {
+            for (float value : values) {
+                renderAiReport(messageBuffer, sizeof(messageBuffer), AI_REPORT_TEMPLATE, value, 55.0f, value, thClass, ppmClass);
+                renderAiReport(messageBuffer, sizeof(messageBuffer), AI_ALERT_TEMPLATE, value, 55.0f, value, thClass, ppmClass);
+                renderAiReport(small, sizeof(small), AI_ALERT_TEMPLATE, value, 55.0f, value, thClass, ppmClass);
+            }
+        }
+    }
+    CHECK(strstr(messageBuffer, "Unknown Class") != nullptr);
+    CHECK_EQ(strlen(small), sizeof(small) - 1);
+
+    CHECK_EQ(heapTraceSiteAllocations(HEAP_SITE_FORMAT_MESSAGE), 0);
+    CHECK_EQ(heapTraceAllocations(), before);
+}
+
+// as onLoRaReceive(): a buffer of the pool, filled and queued for loop()
+static bool receive(const uint8_t *data, uint16_t length, uint32_t nowMs) {
+    HEAP_TRACE_SCOPE(HEAP_SITE_LORA_RECEIVE);
+    PacketBuffer *packet = packetAcquire();
+    if (packet == nullptr) return false;
+    memcpy(packet->data, data, length);
+    packet->length = length;
+    packet->rssi = -80;
+    packet->snr = 7.5f;
+    packet->receivedAt = nowMs;
+    bool queued = packetQueuePush(packet);
+    packetRelease(packet);
+    return queued;
+}
+
+static void testPacketPool() {
+    uint32_t before = heapTraceAllocations();
+    packetPoolInit();
+    uint8_t frame[PACKET_BUFFER_SIZE];
+    for (int i = 0; i < PACKET_BUFFER_SIZE; i++) frame[i] = (uint8_t)i;
+
+    // a burst larger than the pool: the extra packets are dropped, not allocated
+    int queued = 0;
+    for (int i = 0; i < PACKET_POOL_SIZE + 3; i++) queued += receive(frame, 40 + i, i);
+    CHECK_EQ(queued, PACKET_POOL_SIZE);
+    CHECK_EQ(packetPoolStats().dropped, 3);
+    CHECK_EQ(packetPoolStats().inUse, PACKET_POOL_SIZE);
+
+    // loop() pops them in order, one is kept after loop() with its own reference
+    PacketBuffer *kept = nullptr;
+    for (int i = 0; i < PACKET_POOL_SIZE; i++) {
+        HEAP_TRACE_SCOPE(HEAP_SITE_LORA_PACKET);
+        PacketBuffer *packet = packetQueuePop();
+        CHECK(packet != nullptr);
+        if (packet == nullptr) break;
+        CHECK_EQ(packet->length, 40 + i);
+        if (i == 1) {
+            packetRetain(packet);
+            kept = packet;
+        }
+        packetRelease(packet);
+    }
+    CHECK(packetQueueEmpty());
+    CHECK_EQ(packetPoolStats().inUse, 1);
+    CHECK(receive(frame, 10, 100));
+    CHECK_EQ(packetPoolStats().inUse, 2);
+    if (kept != nullptr) packetRelease(kept);
+
+    // a long run of packets through the pool
+    for (uint32_t i = 0; i < 10000; i++) {
+        CHECK(receive(frame, 1 + i % PACKET_BUFFER_SIZE, i));
+        HEAP_TRACE_SCOPE(HEAP_SITE_LORA_PACKET);
+        PacketBuffer *packet = packetQueuePop();
+        if (packet != nullptr) packetRelease(packet);
+    }
+    PacketBuffer *packet = packetQueuePop();
+    if (packet != nullptr) packetRelease(packet);
+    CHECK_EQ(packetPoolStats().inUse, 0);
+    CHECK(packetPoolStats().peakInUse <= PACKET_POOL_SIZE);
+
+    CHECK_EQ(heapTraceSiteAllocations(HEAP_SITE_LORA_RECEIVE), 0);
+    CHECK_EQ(heapTraceSiteAllocations(HEAP_SITE_LORA_PACKET), 0);
+    CHECK_EQ(heapTraceAllocations(), before);
+}
+
+// an uplink as sent by CtrlMailBox: header, text, frame counter and MIC
+static uint16_t buildUplink(uint8_t *frame, const FrameAuthKey &key, uint8_t msgId, uint32_t frameCounter,
+                            const char *text) {
+    size_t textLength = strlen(text);
+    frame[0] = 0x01;
+    frame[1] = 0x42;
+    frame[2] = msgId;
+    frame[3] = (uint8_t)(textLength + FRAME_AUTH_TRAILER_LENGTH);
+    uint8_t *payload = frame + LORA_HEADER_LENGTH;
+    memcpy(payload, text, textLength);
+    const uint8_t header[FRAME_AUTH_HEADER_LENGTH] = {frame[0], frame[1], frame[2], frame[3]};
+    frameAuthSign(key, FRAME_UPLINK, header, frameCounter, payload, textLength, payload + textLength);
+    uint8_t checksum = 0;
+    for (int i = 0; i < frame[3]; i++) checksum ^= payload[i];
+    frame[4] = checksum;
+    return LORA_HEADER_LENGTH + frame[3];
+}
+
+struct ReceiverState {
+    FrameAuthKey key;
+    ReplayTable replay;
+    LinkQuality link;
+    AdrLinkStats adr;
+    uint32_t counter;
+    uint32_t accepted;
+    uint32_t duplicates;
+    uint32_t rejected;
+    int samples;
+};
+
+// the checks of handleLoRaPacket() that do not depend on Arduino, in the same order
+static void handlePacket(ReceiverState &state, const PacketBuffer &packet, const char *telemetry) {
+    HEAP_TRACE_SCOPE(HEAP_SITE_LORA_PACKET);
+    const uint8_t *header = packet.data;
+    const uint8_t *payload = packet.data + LORA_HEADER_LENGTH;
+    int payloadLength = packet.length - LORA_HEADER_LENGTH;
+    uint8_t checksum = 0;
+    for (int i = 0; i < payloadLength; i++) checksum ^= payload[i];
+    if (header[3] != payloadLength || payloadLength < FRAME_AUTH_TRAILER_LENGTH || header[4] != checksum) {
+        state.rejected++;
+        return;
+    }
+    int textLength = payloadLength - FRAME_AUTH_TRAILER_LENGTH;
+    uint32_t frameCounter;
+    if (!frameAuthVerify(state.key, FRAME_UPLINK, header, payload, textLength, payload + textLength, &frameCounter) ||
+        frameCounter <= state.counter) {
+        state.rejected++;
+        return;
+    }
+    state.counter = frameCounter;
+    linkQualityRecordUplink(state.link, frameCounter, packet.rssi, packet.snr, packet.receivedAt);
+    linkQualityRecordRtt(state.link, 420);
+    adrRecordUplink(state.adr, packet.rssi, packet.snr, ADR_MAX_TX_POWER);
+    TelemetrySample samples[TELEMETRY_MAX_SAMPLES];
+    int count = telemetryDecode(telemetry, packet.receivedAt, samples, TELEMETRY_MAX_SAMPLES);
+    if (count > 0) state.samples += count;
+    if (replayCheck(state.replay, header[1], header[2]) == REPLAY_DUPLICATE) {
+        state.duplicates++;
+        return;
+    }
+    state.accepted++;
+}
+
+static void testReceivePath() {
+    static ReceiverState state;
+    uint8_t key[FRAME_AUTH_KEY_LENGTH];
+    frameAuthDeriveKey("ctrl-secret", "mailton-secret", "CtrlMailBox", key);
+    frameAuthSetKey(state.key, key);
+    replayReset(state.replay);
+    linkQualityReset(state.link);
+    adrReset(state.adr);
+
+    // telemetry as CtrlMailBox encodes it, the frames are built before the measure
+    TelemetrySample sent[4] = {{1000, 30, 30, 0}, {31000, 30, 30, 0}, {61000, 24, 30, TELEMETRY_MAIL_DETECTED}, {91000, 24, 30, TELEMETRY_MAIL_DETECTED}};
+    char telemetry[64];
+    CHECK(telemetryEncode(sent, 4, 92000, telemetry, sizeof(telemetry)) == 4);
+    char text[128];
+    snprintf(text, sizeof(text), "NAME=CtrlMailBox;DATA=New Mail;TLM=%s;TXP=14;BASE=7;RXW=1;RTT=420", telemetry);
+    static uint8_t frames[64][PACKET_BUFFER_SIZE];
+    static uint16_t lengths[64];
+    const int count = 64;
+    for (int i = 0; i < count; i++) {
+        // every 8th frame is a retransmission of the previous message ID, every 16th is corrupted
+        uint8_t msgId = (uint8_t)(i - (i % 8 == 7));
+        lengths[i] = buildUplink(frames[i], state.key, msgId, 100 + i, text);
+        if (i % 16 == 15) frames[i][LORA_HEADER_LENGTH + 3] ^= 0x20;
+    }
+
+    packetPoolInit();
+    uint32_t before = heapTraceAllocations();
+    for (int i = 0; i < count; i++) {
+        {
+            HEAP_TRACE_SCOPE(HEAP_SITE_LORA_RECEIVE);
+            PacketBuffer *packet = packetAcquire();
+            CHECK(packet != nullptr);
+            if (packet == nullptr) continue;
+            memcpy(packet->data, frames[i], lengths[i]);
+            packet->length = lengths[i];
+            packet->rssi = -90 + i % 5;
+            packet->snr = 6.0f;
+            packet->receivedAt = 92000 + i * 1000;
+            CHECK(packetQueuePush(packet));
+            packetRelease(packet);
+        }
+        PacketBuffer *packet = packetQueuePop();
+        if (packet == nullptr) continue;
+        handlePacket(state, *packet, telemetry);
+        packetRelease(packet);
+    }
+    CHECK_EQ(heapTraceSiteAllocations(HEAP_SITE_LORA_RECEIVE), 0);
+    CHECK_EQ(heapTraceSiteAllocations(HEAP_SITE_LORA_PACKET), 0);
+    CHECK_EQ(heapTraceAllocations(), before);
+
+    // the path did its work: corrupted frames rejected, retransmissions recognised, telemetry decoded
+    CHECK_EQ(state.rejected, count / 16);
+    CHECK_EQ(state.duplicates, count / 8 - count / 16);  // the corrupted frames are retransmissions
+    CHECK_EQ(state.accepted + state.duplicates + state.rejected, count);
+    CHECK_EQ(state.samples, 4 * (count - count / 16));
+}
+
+int main() {
+    testWrappers();
+    testFormatMessage();
+    testPacketPool();
+    testReceivePath();
+    return checkResult("allocations");
+}